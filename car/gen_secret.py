@@ -8,32 +8,96 @@
 #  This source file is part of our designed system
 #  for MITRE's 2023 Embedded System CTF (eCTF).
 
-import json
+import sqlite3
+import struct
 import argparse
 from pathlib import Path
 import Crypto.PublicKey.ECC as ecc
 from Crypto.Util.number import bytes_to_long, long_to_bytes
 from Crypto.Random import get_random_bytes
+from Crypto.Hash import SHA256
 
 ECC_PRIVSIZE = 32
 ECC_PUBSIZE = ECC_PRIVSIZE * 2
 
-def main():
-    parser = argparse.ArgumentParser()
-    parser.add_argument("--car-id", type=int, required=True)
-    parser.add_argument("--secrets-dir", type=Path, required=True)
-    parser.add_argument("--header-file", type=Path, required=True)
-    args = parser.parse_args()
+# Features Information, must match firmware.h
+# Feature numbers are sent as a single byte
+NUM_FEATURES = 3
+
+# Car secrets store, must match deployment/gen_host_secrets.py
+SECRETS_STORE = "car_secrets.db"
+SECRETS_SCHEMA = "CREATE TABLE IF NOT EXISTS cars (car_id INTEGER PRIMARY KEY, privkey_pem TEXT NOT NULL, pubkey_pem TEXT NOT NULL)"
+
+# P-256 curve parameters
+P256_P = 0xFFFFFFFF00000001000000000000000000000000FFFFFFFFFFFFFFFFFFFFFFFF
+P256_GX = 0x6B17D1F2E12C4247F8BCE6E563A440F277037D812DEB33A0F4A13945D898C296
+P256_GY = 0x4FE342E2FE1A7F9B8EE7EB4A7C0F9E162BCE33576B315ECECBB6406837BF51F5
+
+# Fixed-base comb layout, must match p256.h
+COMB_TEETH = 8
+COMB_SPACING = 32
+COMB_POINTS = (1 << COMB_TEETH) - 1
+
+
+# @brief Open the car secrets store, shared by every build of a deployment
+# Writers serialize on the database lock, so cars can be built in parallel
+def open_store(secrets_dir):
+    db = sqlite3.connect(secrets_dir / SECRETS_STORE, timeout=60)
+    db.execute("PRAGMA journal_mode=WAL")
+    db.execute(SECRETS_SCHEMA)
+    return db
+
+
+# @brief Add two affine P-256 points, with None as the point at infinity
+def ec_add(a, b):
+    if a is None:
+        return b
+    if b is None:
+        return a
+    if a[0] == b[0]:
+        if (a[1] + b[1]) % P256_P == 0:
+            return None
+        lam = (3 * a[0] * a[0] - 3) * pow(2 * a[1], -1, P256_P)
+    else:
+        lam = (b[1] - a[1]) * pow(b[0] - a[0], -1, P256_P)
+    x = (lam * lam - a[0] - b[0]) % P256_P
+    return (x, (lam * (a[0] - x) - a[1]) % P256_P)
 
-    secret_file = args.secrets_dir / "car_secrets.json"
 
-    # Open the secret file if it exists
-    if secret_file.exists():
-        with open(secret_file, "r") as fp:
-            secrets = json.load(fp)
-    else:
-        secrets = {}
+# @brief Build the fixed-base comb for a point, as laid out in p256.h
+def comb_table(point):
+    teeth = [point]
+    for _ in range(COMB_TEETH - 1):
+        t = teeth[-1]
+        for _ in range(COMB_SPACING):
+            t = ec_add(t, t)
+        teeth.append(t)
+
+    table = [None]
+    for v in range(1, 1 << COMB_TEETH):
+        low = v & -v
+        table.append(ec_add(table[v ^ low], teeth[low.bit_length() - 1]))
+    return table[1:]
 
+
+# @brief Convert a comb to 32-bit words, coordinates in Montgomery form as laid out in p256.h
+def comb_words(table):
+    words = []
+    for point in table:
+        for value in point:
+            value = (value << 256) % P256_P
+            words += [(value >> (32 * i)) & 0xFFFFFFFF for i in range(8)]
+    return words
+
+
+# @brief Format comb words as a C initializer
+def comb_initializer(words):
+    fes = ["{{" + ",".join(hex(w) for w in words[i:i + 8]) + "}}" for i in range(0, len(words), 8)]
+    return ",\n".join(f"{{{fes[i]},{fes[i + 1]}}}" for i in range(0, len(fes), 2))
+
+
+# @brief Generate a car's key, EEPROM and the values of its .secrets section
+def gen_car(car_id, secrets_dir):
     # Generate secret
     privkey = ecc.generate(curve='secp256r1')
     car_pubkey = privkey.public_key()
@@ -41,44 +105,91 @@ def main():
     privkey_pem = privkey.export_key(format="PEM")
     pubkey_pem = car_pubkey.export_key(format="PEM")
 
-    car_secret = { "privkey_pem": privkey_pem, "pubkey_pem": pubkey_pem }
-    secrets[str(args.car_id)] = car_secret
+    # Save the car's keys, replacing any earlier car with the same ID
+    db = open_store(secrets_dir)
+    with db:
+        db.execute("INSERT OR REPLACE INTO cars VALUES (?, ?, ?)", (car_id, privkey_pem, pubkey_pem))
+    db.close()
 
-    # Save the secret file
-    with open(secret_file, "w") as fp:
-        json.dump(secrets, fp, indent=4)
-    
     # Load host pubkey
-    host_pubkey_file = args.secrets_dir / "host_pubkey.PEM"
+    host_pubkey_file = secrets_dir / "host_pubkey.PEM"
     with open(host_pubkey_file) as fp:
         host_pubkey_pem = fp.read()
     host_pubkey = ecc.import_key(host_pubkey_pem)
 
+    # Get Public Keys as Points
+    host_point = (int(host_pubkey._point.x), int(host_pubkey._point.y))
+    car_point = (int(car_pubkey._point.x), int(car_pubkey._point.y))
+
     # Get Public Keys as Bytes
     host_pubkey_bytes = long_to_bytes(host_pubkey._point.x, ECC_PRIVSIZE) + long_to_bytes(host_pubkey._point.y, ECC_PRIVSIZE)
     car_pubkey_bytes = long_to_bytes(car_pubkey._point.x, ECC_PRIVSIZE) + long_to_bytes(car_pubkey._point.y, ECC_PRIVSIZE)
 
+    # Compute the digest each feature package signs, SHA256(car_pubkey || feature number)
+    feature_digests = [
+        SHA256.new(car_pubkey_bytes + i.to_bytes(1, "little")).digest()
+        for i in range(1, NUM_FEATURES + 1)
+    ]
+
     # Generate Entropy
     entropy = get_random_bytes(0x400)
 
-    # Identify the Non-Package
-    non_package = [255]*64
-
     # Pack Car Data for EEPROM
     eeprom_data = host_pubkey_bytes + car_pubkey_bytes
-    eeprom_path = args.secrets_dir / f"car_{args.car_id}_eeprom"
+    eeprom_path = secrets_dir / f"car_{car_id}_eeprom"
 
     # Write EEPROM
     with open(eeprom_path, "wb") as fp:
         fp.write(eeprom_data)
 
+    return entropy, feature_digests, comb_words(comb_table(host_point)), comb_words(comb_table(car_point))
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--car-id", type=int)
+    parser.add_argument("--secrets-dir", type=Path)
+    parser.add_argument("--header-file", type=Path, required=True)
+    parser.add_argument("--blob-file", type=Path, help="Also write the raw .secrets section, for patch_secrets.py")
+    parser.add_argument("--template", action="store_true", help="Write placeholder secrets for a fleet template build")
+    args = parser.parse_args()
+
+    if args.template:
+        # Placeholder secrets with the same layout, patched over for each car
+        entropy = bytes(0x400)
+        feature_digests = [bytes(32)] * NUM_FEATURES
+        host_words = [0] * (16 * COMB_POINTS)
+        car_words = [0] * (16 * COMB_POINTS)
+    else:
+        if args.car_id is None or args.secrets_dir is None:
+            parser.error("--car-id and --secrets-dir are required unless --template is given")
+        entropy, feature_digests, host_words, car_words = gen_car(args.car_id, args.secrets_dir)
+
+    # Pack the section exactly as the SECRETS struct in firmware.h lays it out
+    blob = entropy + b"".join(feature_digests)
+    blob += struct.pack(f"<{len(host_words)}I", *host_words)
+    blob += struct.pack(f"<{len(car_words)}I", *car_words)
+
+    if args.blob_file:
+        with open(args.blob_file, "wb") as fp:
+            fp.write(blob)
+
     # Write to header file
     with open(args.header_file, "w") as fp:
         fp.write("#ifndef __CAR_SECRETS__\n")
         fp.write("#define __CAR_SECRETS__\n\n")
         fp.write('#include "firmware.h"\n')
-        fp.write(f"const uint8_t S_ENTROPY[sizeof(ENTROPY)] = {{ {','.join(hex(b) for b in entropy)} }};\n")
-        fp.write(f"const uint8_t NON_PACKAGE[sizeof(PACKAGE)] = {{ {','.join(hex(b) for b in non_package)} }};\n")
+        fp.write(f"#if NUM_FEATURES != {NUM_FEATURES}\n")
+        fp.write('#error "gen_secret.py NUM_FEATURES does not match firmware.h"\n')
+        fp.write("#endif\n")
+        fp.write('const SECRETS DEVICE_SECRETS __attribute__((section(".secrets"))) = {\n')
+        fp.write(f".entropy = {{{{ {','.join(hex(b) for b in entropy)} }}}},\n")
+        fp.write(".feature_digest = {\n")
+        fp.write(",\n".join(f"{{{{ {','.join(hex(b) for b in d)} }}}}" for d in feature_digests))
+        fp.write(" },\n")
+        fp.write(f".host_pubkey_comb = {{\n{comb_initializer(host_words)} }},\n")
+        fp.write(f".car_pubkey_comb = {{\n{comb_initializer(car_words)} }} }};\n")
+        fp.write(f"const p256_comb_t P256_G_COMB = {{\n{comb_initializer(comb_words(comb_table((P256_GX, P256_GY))))} }};\n")
         fp.write("#endif\n")
 
 
@@ -20,17 +20,38 @@
 #define UNLOCK_MAGIC 0x56
 #define CHAL_START 0x57
 #define RESP_START 0x58
+#define BAUD_OFFER 0x59
+#define BAUD_ACK 0x5A
+#define SIG_START 0x5B
+#define LINK_DONE 0x5C
 
 #define FOB_UART ((uint32_t)UART1_BASE)
 
+// Number of rates in LINK_BAUDS, the first of which is BAUD
+#define LINK_BAUD_COUNT 6
+
+// Rate negotiation timeouts, in milliseconds
+#define LINK_ACK_TIMEOUT 50
+#define LINK_CHECK_TIMEOUT 20
+
+// Time the fob needs to give up on a rate whose check failed, in milliseconds
+#define LINK_SETTLE_TIME 2
+
+// Exchanges completed at a lowered rate before the next is offered one rate faster
+#define LINK_RAISE_AFTER 4
+
 // Setup Functions
 void setup_board_link(void);
 
 // Communications Functions
 bool send_challenge(CHALLENGE *challenge);
 bool fob_requests_unlock(void);
+bool negotiate_baud(void);
 
 // Advanced Communications Functions
-bool get_response(RESPONSE *response);
+bool get_response_features(RESPONSE *response);
+bool get_response_signature(RESPONSE *response);
+void service_response(RESPONSE *response);
+bool finish_response(void);
 
 #endif
@@ -13,6 +13,8 @@
 
 #include "sb_all.h"
 
+#include "p256.h"
+
 /*** Macro Definitions ***/
 // Definitions for unlock message location in EEPROM
 #define UNLOCK_EEPROM_LOC 0x7C0
@@ -22,9 +24,22 @@
 #define NUM_FEATURES 3
 #define FEATURE_END UNLOCK_EEPROM_LOC
 #define FEATURE_SIZE 64
+// Feature presence bitmap of a response, bit i - 1 is set when feature i is included
+#define PRESENT_SIZE ((NUM_FEATURES + 7) / 8)
+#define PRESENT_GET(present, i) (((present)[(i) / 8] >> ((i) % 8)) & 1)
+#define PRESENT_SET(present, i) ((present)[(i) / 8] |= (uint8_t)(1 << ((i) % 8)))
+
+// Unlock report sent to the Host: REPORT_START, the number of feature messages,
+// then the little-endian length of the unlock and feature messages which follow
+#define REPORT_START 0x5D
+#define REPORT_HEADER_SIZE 4
+
+// Verified Feature Cache
+#define FEATURE_CACHE_SIZE 8
 
-// Entropy
-#define ENTROPY_FLASH 0x3FC00
+// Challenge Pool, refilled in one DRBG request once it falls to the low mark
+#define CHALLENGE_POOL_SIZE 8
+#define CHALLENGE_POOL_LOW 4
 
 // System Information
 #define SPEED 80000000
@@ -32,8 +47,10 @@
 #define ENDIAN 1
 
 /*** Structure definitions ***/
-// Defines a struct for a packaged feature
-typedef sb_sw_signature_t PACKAGE;
+// Defines a struct for a packaged feature, the host's signature r || s and its recovery byte
+typedef struct {
+  uint8_t bytes[sizeof(sb_sw_signature_t) + 1];
+} PACKAGE;
 
 // Defines a struct for the challenge in the challenge-response mechanism
 typedef struct {
@@ -41,33 +58,72 @@ typedef struct {
 } CHALLENGE;
 
 // Defines a struct for the response in the challenge-response mechanism
+// On the board link the bitmap and the packages it flags come first, in feature order,
+// and the signature follows once the fob has computed it
 typedef struct {
+  uint8_t present[PRESENT_SIZE];
   sb_sw_signature_t unlock;
-  PACKAGE feature[3];
+  PACKAGE feature[NUM_FEATURES];
 } RESPONSE;
 
+// Defines a struct for the verification of one response, started on its feature packages
+// and finished once the unlock signature arrives
+typedef struct {
+  p256_verify_ctx_t ctx;
+  sb_sw_message_digest_t fresh[NUM_FEATURES]; // cache digests of the packages in the batch
+  uint32_t count;                             // number of packages in the batch
+  sb_sw_message_digest_t hash;                // SHA256 of the challenge, signed by the fob
+} VERIFICATION;
+
 // Defines a struct for storing the car data
 typedef struct {
   sb_sw_public_t host_pubkey;
   sb_sw_public_t car_pubkey;
 } CAR_DATA;
 
+// Defines a struct for remembering a feature package which already verified
+typedef struct {
+  sb_sw_message_digest_t digest; // SHA256(feature number || package)
+  bool valid;
+} FEATURE_CACHE_ENTRY;
+
 // Defines a struct for storing entropy in flash
 typedef struct {
   uint8_t data[0x400];
 } ENTROPY;
 
+// Defines the secrets provisioned into each car, kept in the .secrets section
+// Layout must match gen_secret.py, which patch_secrets.py relies on
+typedef struct {
+  ENTROPY entropy;
+  sb_sw_message_digest_t feature_digest[NUM_FEATURES]; // SHA256(car_pubkey || feature number)
+  p256_comb_t host_pubkey_comb;
+  p256_comb_t car_pubkey_comb;
+} SECRETS;
+
+/*** Constants ***/
+// Generated by gen_secret.py into secrets.h, compiled by secrets.c
+extern const SECRETS DEVICE_SECRETS;
+extern const p256_comb_t P256_G_COMB;
+
 /*** Function definitions ***/
 // Core Functions
 bool tryUnlock(void);
+void tryFillChallenges(void);
 bool startCar(RESPONSE *response);
-bool unlockCar(void);
+bool unlockCar(RESPONSE *response);
 
 // Security Functions
 bool gen_challenge(CHALLENGE *challenge);
-bool verify_response(CHALLENGE *challenge, RESPONSE *response);
+bool gen_weights(uint64_t *weights, uint32_t count);
+bool verify_features(VERIFICATION *verification, RESPONSE *response);
+bool verify_response(VERIFICATION *verification, CHALLENGE *challenge, RESPONSE *response);
+bool verify_sliced(p256_verify_ctx_t *ctx, RESPONSE *response);
 
 // Helper Functions
 bool init_drbg(void);
+void package_digest(uint8_t feature_num, PACKAGE *package, sb_sw_message_digest_t *digest);
+bool feature_cache_lookup(sb_sw_message_digest_t *digest);
+void feature_cache_insert(sb_sw_message_digest_t *digest);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,147 @@
+/**
+ * @file p256.h
+ * @author Spartan State Security Team
+ * @brief Supplementary P-256 arithmetic not exposed by Sweet B
+ * @date 2023
+ *
+ * This source file is part of our designed system
+ * for MITRE's 2023 Embedded System CTF (eCTF).
+ */
+
+#ifndef P256_H
+#define P256_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*** Macro Definitions ***/
+#define P256_WORDS 8
+#define P256_BYTES 32
+
+// Most signatures checked together by one batch
+#define P256_MAX_BATCH 8
+
+// Exponent bits of an inversion or square root processed by one verification slice
+#define P256_INV_SLICE_BITS 32
+
+// Bits of the random weight given to each signature checked through its R point
+#define P256_WEIGHT_BITS 64
+
+// Recovery byte following r || s, telling which point R has x mod n equal to r
+#define P256_RECOVERY_ODD_Y 0x01   // R's y is odd
+#define P256_RECOVERY_HIGH_X 0x02  // R's x is r + n
+
+// Fixed-base comb layout, must match gen_secret.py
+#define P256_COMB_TEETH 8
+#define P256_COMB_SPACING 32
+#define P256_COMB_POINTS ((1 << P256_COMB_TEETH) - 1)
+
+/*** Structure definitions ***/
+// Defines a 256-bit integer as little-endian 32-bit words
+typedef struct {
+  uint32_t w[P256_WORDS];
+} p256_int_t;
+
+// Defines a prime modulus with its Montgomery constants
+typedef struct {
+  p256_int_t m;    // the modulus itself
+  uint32_t m0inv;  // -m^-1 mod 2^32
+  p256_int_t r2;   // R^2 mod m, where R = 2^256
+} p256_mod_t;
+
+// Defines an affine curve point, coordinates in Montgomery form mod p
+typedef struct {
+  p256_int_t x;
+  p256_int_t y;
+} p256_affine_t;
+
+// Defines a Jacobian curve point, coordinates in Montgomery form mod p
+// The point at infinity has z = 0
+typedef struct {
+  p256_int_t x;
+  p256_int_t y;
+  p256_int_t z;
+} p256_jacobian_t;
+
+// Defines a fixed-base comb for a point P
+// Entry v - 1 holds the sum of 2^(SPACING * i) * P over each bit i set in v
+typedef p256_affine_t p256_comb_t[P256_COMB_POINTS];
+
+// Defines one signature to check as part of a batch
+typedef struct {
+  const uint8_t *sig;             // big-endian r || s, then the recovery byte if checked through R
+  const uint8_t *digest;          // big-endian message digest
+  const p256_affine_t *q_comb;    // comb for the signer's public key
+} p256_verify_job_t;
+
+// Defines the stages of a sliced verification
+typedef enum {
+  P256_VERIFY_RECOVER,  // recovering the point R of each signature from its r
+  P256_VERIFY_WEIGHTS,  // walking the weight bits above the comb columns, which only add R points
+  P256_VERIFY_WAIT,     // waiting for the last signature
+  P256_VERIFY_INVERT,   // inverting the product of the s values
+  P256_VERIFY_SCALARS,  // combining the weighted scalars of G and each key
+  P256_VERIFY_COMB,     // walking the weight bits and comb columns with one accumulator
+  P256_VERIFY_CHECK,    // comparing the result against the last r
+  P256_VERIFY_PASSED,
+  P256_VERIFY_FAILED,
+} p256_verify_phase_t;
+
+// Defines a batch verification in progress
+// jobs[0 .. count - 1] are checked through R, jobs[count] is the last signature
+typedef struct {
+  p256_verify_job_t jobs[P256_MAX_BATCH];
+  const p256_affine_t *g_comb;
+  uint32_t count;
+  bool closed;   // whether the last signature was given
+  p256_verify_phase_t phase;
+  int32_t step;  // next exponent bit, or weight bit of the walk
+  uint32_t job;  // signature being recovered, or next operation of the walk step
+  p256_int_t pow;  // running power of the inversion or square root
+  p256_int_t rhs;  // x^3 - 3x + b of the R being recovered
+  uint64_t weight[P256_MAX_BATCH - 1];
+  p256_int_t r[P256_MAX_BATCH];
+  p256_int_t s[P256_MAX_BATCH];     // s in Montgomery form, then weight / s
+  p256_int_t prod[P256_MAX_BATCH];  // running products of the s values
+  p256_affine_t neg_r[P256_MAX_BATCH - 1];
+  p256_int_t a;                     // scalar of G
+  const p256_affine_t *q_comb[P256_MAX_BATCH];
+  p256_int_t b[P256_MAX_BATCH];     // scalar of each distinct key
+  uint32_t keys;
+  p256_jacobian_t acc;
+} p256_verify_ctx_t;
+
+/*** Constants ***/
+// Field prime and order of the P-256 base point
+extern const p256_mod_t P256_P;
+extern const p256_mod_t P256_N;
+
+/*** Function declarations ***/
+// Conversion Functions
+void p256_from_bytes(p256_int_t *dest, const uint8_t src[P256_BYTES]);
+void p256_to_bytes(uint8_t dest[P256_BYTES], const p256_int_t *src);
+bool p256_is_zero(const p256_int_t *a);
+bool p256_equal(const p256_int_t *a, const p256_int_t *b);
+bool p256_in_range(const p256_int_t *a, const p256_mod_t *m);
+
+// Modular Arithmetic Functions
+void p256_mod_reduce(p256_int_t *a, const p256_mod_t *m);
+void p256_mod_add(p256_int_t *dest, const p256_int_t *a, const p256_int_t *b, const p256_mod_t *m);
+void p256_mod_sub(p256_int_t *dest, const p256_int_t *a, const p256_int_t *b, const p256_mod_t *m);
+void p256_mont_mul(p256_int_t *dest, const p256_int_t *a, const p256_int_t *b, const p256_mod_t *m);
+void p256_to_mont(p256_int_t *dest, const p256_int_t *a, const p256_mod_t *m);
+void p256_mont_inv(p256_int_t *dest, const p256_int_t *a, const p256_mod_t *m);
+
+// Curve Functions
+bool p256_comb_matches(const p256_comb_t comb, const uint8_t pub[2 * P256_BYTES]);
+bool p256_verify_comb(const uint8_t sig[2 * P256_BYTES], const uint8_t digest[P256_BYTES],
+                      const p256_comb_t g_comb, const p256_comb_t q_comb);
+bool p256_verify_batch(const p256_verify_job_t *jobs, const uint64_t *weights, uint32_t count,
+                       const p256_comb_t g_comb);
+bool p256_verify_start(p256_verify_ctx_t *ctx, const p256_verify_job_t *jobs, const uint64_t *weights,
+                       uint32_t count, const p256_comb_t g_comb);
+bool p256_verify_last(p256_verify_ctx_t *ctx, const p256_verify_job_t *job);
+bool p256_verify_continue(p256_verify_ctx_t *ctx);
+bool p256_verify_finish(const p256_verify_ctx_t *ctx);
+
+#endif // P256_H
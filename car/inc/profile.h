@@ -0,0 +1,78 @@
+/**
+ * @file profile.h
+ * @author Spartan State Security Team
+ * @brief File that defines the cycle counting unlock profiler
+ * @date 2023
+ *
+ * This source file is part of our designed system
+ * for MITRE's 2023 Embedded System CTF (eCTF).
+ *
+ * Only built with UNLOCK_PROFILE defined, otherwise every
+ * profiling macro expands to the bare expression or to nothing.
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*** Macro Definitions ***/
+// Host command requesting a dump of the counters
+#define PROFILE_CMD 0x50
+
+// Host command requesting the stage durations of the latest unlock
+#define PROFILE_LAST_CMD 0x51
+
+// Marks the start of a dump, followed by the clock speed and stage count
+#define PROFILE_MAGIC 0x50524F46
+
+// Histogram buckets, bucket b counts stages of [4^b, 4^(b+1)) cycles
+#define PROFILE_BUCKETS 16
+
+#ifdef UNLOCK_PROFILE
+
+/*** Structure definitions ***/
+// Defines the profiled stages of an unlock, in order
+// Must match the STAGES list in host_tools/profile_tool
+typedef enum {
+  PROFILE_REQUEST,
+  PROFILE_CHALLENGE,
+  PROFILE_NEGOTIATE,
+  PROFILE_SEND,
+  PROFILE_FEATURES,
+  PROFILE_VERIFY_FEATURES,
+  PROFILE_SIGNATURE,
+  PROFILE_VERIFY,
+  PROFILE_UNLOCK,
+  PROFILE_START,
+  PROFILE_STAGES
+} profile_stage_t;
+
+// Defines the counters kept for one stage
+typedef struct {
+  uint32_t count;
+  uint32_t min;
+  uint32_t max;
+  uint64_t total;
+  uint32_t hist[PROFILE_BUCKETS];
+} PROFILE_STAT;
+
+/*** Function declarations ***/
+void profile_init(void);
+void profile_begin(void);
+bool profile_end(profile_stage_t stage, bool ok);
+void profile_poll(void);
+
+// Time one step of an unlock, evaluating to the step's result
+#define PROFILE(stage, expr) profile_end((stage), (profile_begin(), (expr)))
+
+#else
+
+#define PROFILE(stage, expr) (expr)
+#define profile_init()
+#define profile_poll()
+
+#endif // UNLOCK_PROFILE
+
+#endif // PROFILE_H
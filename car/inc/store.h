@@ -0,0 +1,40 @@
+/**
+ * @file store.h
+ * @author Spartan State Security Team
+ * @brief File that defines the RAM mirror of the car's persistent storage
+ * @date 2023
+ *
+ * This source file is part of our designed system
+ * for MITRE's 2023 Embedded System CTF (eCTF).
+ */
+
+#ifndef STORE_H
+#define STORE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "firmware.h"
+
+/*** Macro Definitions ***/
+// Feature messages sit directly below the unlock message in EEPROM
+#define MESSAGE_EEPROM_LOC (FEATURE_END - NUM_FEATURES * FEATURE_SIZE)
+
+/*** Structure definitions ***/
+// Defines a struct mirroring the car's EEPROM contents in RAM
+typedef struct {
+  CAR_DATA car_data;
+  uint8_t feature_message[NUM_FEATURES][FEATURE_SIZE]; // highest feature first, as laid out in EEPROM
+  uint8_t unlock_message[UNLOCK_EEPROM_SIZE];
+} CAR_STORE;
+
+/*** Function declarations ***/
+// Setup Functions
+bool store_init(void);
+
+// Access Functions
+const CAR_DATA *store_car_data(void);
+const uint8_t *store_unlock_message(void);
+const uint8_t *store_feature_message(uint32_t feature_idx);
+
+#endif // STORE_H
@@ -0,0 +1,103 @@
+#!/usr/bin/python3 -u
+
+# @file patch_secrets
+# @author Spartan State Security Team
+# @brief Script to patch a device's secrets into prebuilt firmware
+# @date 2023
+#
+#  This source file is part of our designed system
+#  for MITRE's 2023 Embedded System CTF (eCTF).
+#
+#  Firmware built once against `gen_secret.py --template` keeps every
+#  secret in the .secrets section. This replaces that section in both
+#  the ELF and the raw binary with the section written by
+#  `gen_secret.py --blob-file`, without recompiling.
+
+import argparse
+import struct
+from pathlib import Path
+
+SECRETS_SECTION = b".secrets"
+
+# ELF constants
+ELF_MAGIC = b"\x7fELF"
+ELFCLASS32 = 1
+ELFDATA2LSB = 1
+SHT_NOBITS = 8
+SHF_ALLOC = 0x2
+
+
+# @brief Function to read the section headers of a 32-bit little-endian ELF
+# @param elf, contents of the ELF file
+# @return list of (name, type, flags, addr, offset, size) tuples
+def read_sections(elf):
+    if elf[:4] != ELF_MAGIC or elf[4] != ELFCLASS32 or elf[5] != ELFDATA2LSB:
+        raise Exception("Firmware is not a 32-bit little-endian ELF")
+
+    shoff, = struct.unpack_from("<I", elf, 0x20)
+    shentsize, shnum, shstrndx = struct.unpack_from("<HHH", elf, 0x2E)
+
+    headers = [struct.unpack_from("<IIIIII", elf, shoff + i * shentsize) for i in range(shnum)]
+    strtab = headers[shstrndx][4]
+
+    sections = []
+    for name, sh_type, flags, addr, offset, size in headers:
+        end = elf.index(b"\0", strtab + name)
+        sections.append((elf[strtab + name:end], sh_type, flags, addr, offset, size))
+    return sections
+
+
+# @brief Function to patch secrets into firmware
+# @param elf_file, prebuilt firmware ELF
+# @param bin_file, prebuilt firmware binary
+# @param secrets_file, raw .secrets section to patch in
+# @param elf_out, where to write the patched ELF
+# @param bin_out, where to write the patched binary
+def patch(elf_file, bin_file, secrets_file, elf_out, bin_out):
+    with open(elf_file, "rb") as fp:
+        elf = bytearray(fp.read())
+    with open(bin_file, "rb") as fp:
+        binary = bytearray(fp.read())
+    with open(secrets_file, "rb") as fp:
+        secrets = fp.read()
+
+    sections = read_sections(elf)
+    matches = [s for s in sections if s[0] == SECRETS_SECTION]
+    if len(matches) != 1:
+        raise Exception("Firmware has no .secrets section")
+    _, _, _, addr, offset, size = matches[0]
+
+    if len(secrets) != size:
+        raise Exception(f"Secrets are {len(secrets)} bytes but the .secrets section is {size}")
+
+    # The binary starts at the lowest address loaded from the ELF
+    base = min(s[3] for s in sections if s[2] & SHF_ALLOC and s[1] != SHT_NOBITS and s[5])
+    position = addr - base
+    if binary[position:position + size] != elf[offset:offset + size]:
+        raise Exception("Firmware binary does not match its ELF")
+
+    elf[offset:offset + size] = secrets
+    binary[position:position + size] = secrets
+
+    with open(elf_out, "wb") as fp:
+        fp.write(elf)
+    with open(bin_out, "wb") as fp:
+        fp.write(binary)
+
+    print(f"Patched {size} bytes of secrets at 0x{addr:08x}")
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--elf", type=Path, required=True, help="Prebuilt firmware ELF")
+    parser.add_argument("--bin", type=Path, required=True, help="Prebuilt firmware binary")
+    parser.add_argument("--secrets", type=Path, required=True, help="Section from gen_secret.py --blob-file")
+    parser.add_argument("--elf-out", type=Path, required=True)
+    parser.add_argument("--bin-out", type=Path, required=True)
+    args = parser.parse_args()
+
+    patch(args.elf, args.bin, args.secrets, args.elf_out, args.bin_out)
+
+
+if __name__ == "__main__":
+    main()
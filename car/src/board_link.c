@@ -10,6 +10,7 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "inc/hw_memmap.h"
 #include "inc/hw_types.h"
@@ -28,6 +29,41 @@
 #include "uart.h"
 #include "firmware.h"
 
+/*** Constants ***/
+// Board link rates in order of preference, must match the fob
+static const uint32_t LINK_BAUDS[LINK_BAUD_COUNT] = {
+  BAUD, 230400, 460800, 921600, 1000000, 2000000
+};
+
+// Pattern exchanged at a new rate to prove the line carries it
+static const uint8_t BAUD_CHECK[4] = { 0x55, 0xAA, 0x0F, 0xF0 };
+
+/*** Globals ***/
+// Set by the uDMA completion callback once a part of the response has arrived
+volatile bool response_received = false;
+
+// SysTick periods left before the response times out, shared by both of its parts
+uint32_t response_periods = 0;
+bool response_active = false;
+
+// Progress on the part of the response being received
+uint8_t part_start;
+bool part_features;
+bool part_started;
+uint32_t part_present;
+bool part_sized;
+bool part_failed;
+bool part_complete;
+
+// Fastest rate to offer the fob, lowered whenever a rate proves unreliable
+uint8_t link_rate = LINK_BAUD_COUNT - 1;
+
+// Exchanges completed at link_rate since it last changed
+uint8_t link_successes = 0;
+
+// Rate the board link is running at
+uint8_t link_rate_current = 0;
+
 /**
  * @brief Initialize the board link interface.
  *
@@ -50,6 +86,18 @@ void setup_board_link(void) {
   while (UARTCharsAvail(FOB_UART)) {
     UARTCharGet(FOB_UART);
   }
+
+  uart_start(FOB_UART);
+  uart_dma_init();
+}
+
+/**
+ * @brief Called from the board link interrupt once a response has been received.
+ *
+ * @param uart is the base address of the UART port.
+ */
+static void response_done(uint32_t uart) {
+  response_received = true;
 }
 
 /**
@@ -61,6 +109,91 @@ bool fob_requests_unlock(void) {
   return uart_avail(FOB_UART) && uart_readb(FOB_UART)==UNLOCK_MAGIC;
 }
 
+/**
+ * @brief Read bytes from the fob, giving up after a timeout
+ *
+ * @param buf [out] Where to store the bytes
+ * @param len [in]  The number of bytes to read
+ * @param ms  [in]  The time allowed, in milliseconds
+ *
+ * @return true if every byte arrived in time, false otherwise
+ */
+static bool link_read_timeout(uint8_t *buf, uint32_t len, uint32_t ms) {
+  uint32_t polls = ms * 10;
+  uint32_t got = 0;
+
+  while (got < len) {
+    got += uart_read_nb(FOB_UART, &buf[got], len - got);
+    if (got < len) {
+      if (polls-- == 0) return false;
+      SysCtlDelay(SPEED / 30000); // 100us
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Switch the board link to one of the negotiated rates
+ *
+ * @param rate [in] The index of the rate in LINK_BAUDS
+ */
+static void set_link_rate(uint8_t rate) {
+  if (rate != link_rate_current) {
+    uart_set_baud(FOB_UART, LINK_BAUDS[rate]);
+    link_rate_current = rate;
+  }
+}
+
+/**
+ * @brief Stop offering a rate which proved unreliable
+ *
+ * @param rate [in] The index of the rate in LINK_BAUDS, above 0
+ */
+static void lower_link_rate(uint8_t rate) {
+  link_rate = rate - 1;
+  link_successes = 0;
+}
+
+/**
+ * @brief Agree with the fob on the fastest rate both ends can carry,
+ * and switch the board link to it
+ * 
+ * The car offers its preferred rate and the fob answers with the rate
+ * it accepts. Both ends then switch and the car checks that a known
+ * pattern survives a round trip. If it does not, both ends return to
+ * BAUD and the car offers the next slower rate, until one survives or
+ * BAUD is reached.
+ * 
+ * @return true if the link is ready for the challenge, false otherwise
+ */
+bool negotiate_baud(void) {
+  uint8_t ack[2];
+  uint8_t echo[sizeof(BAUD_CHECK)];
+
+  while (true) {
+    uart_writeb(FOB_UART, BAUD_OFFER);
+    uart_writeb(FOB_UART, link_rate);
+
+    if (!link_read_timeout(ack, sizeof(ack), LINK_ACK_TIMEOUT) ||
+        ack[0] != BAUD_ACK || ack[1] > link_rate)
+      return false;
+
+    // Staying at BAUD needs no check
+    if (ack[1] == 0) return true;
+
+    set_link_rate(ack[1]);
+    uart_write(FOB_UART, BAUD_CHECK, sizeof(BAUD_CHECK));
+    if (link_read_timeout(echo, sizeof(echo), LINK_CHECK_TIMEOUT) &&
+        !memcmp(echo, BAUD_CHECK, sizeof(BAUD_CHECK)))
+      return true;
+
+    // The line is too noisy at this rate, offer the next one once the fob is back at BAUD
+    lower_link_rate(ack[1]);
+    set_link_rate(0);
+    SysCtlDelay(SPEED / 3000 * LINK_SETTLE_TIME); // 1ms each
+  }
+}
+
 /**
  * @brief Send a challenge-response challenge to the key fob device
  * 
@@ -70,54 +203,243 @@ bool fob_requests_unlock(void) {
 */
 bool send_challenge(CHALLENGE *challenge) {
   uart_writeb(FOB_UART, CHAL_START);
-  uart_write(FOB_UART, (uint8_t *)challenge, sizeof(CHALLENGE));
+
+  // The challenge lives until the unlock attempt ends, so the uDMA controller can send it
+  if (!uart_dma_write(FOB_UART, (uint8_t *)challenge, sizeof(CHALLENGE), NULL)) {
+    uart_write(FOB_UART, (uint8_t *)challenge, sizeof(CHALLENGE));
+  }
   return true;
 }
 
 /**
- * @brief Gets a response from the fob to the challenge that was sent
+ * @brief Count the feature packages flagged in a response
+ * 
+ * @param present [in] The presence bitmap of the response
+ * 
+ * @return the number of packages which follow the signature
+ */
+static uint32_t count_present(const uint8_t present[PRESENT_SIZE]) {
+  uint32_t count = 0;
+  uint32_t i;
+
+  for (i = 0; i < NUM_FEATURES; i++) {
+    count += PRESENT_GET(present, i);
+  }
+  return count;
+}
+
+/**
+ * @brief Check that a presence bitmap flags no feature past NUM_FEATURES
+ * 
+ * @param present [in] The presence bitmap of the response
+ * 
+ * @return true if the bitmap is valid, false otherwise
+ */
+static bool present_valid(const uint8_t present[PRESENT_SIZE]) {
+  uint32_t i;
+
+  for (i = NUM_FEATURES; i < 8 * PRESENT_SIZE; i++) {
+    if (PRESENT_GET(present, i)) return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Moves the packed feature packages of a received response
+ * to their slots, leaving absent slots erased to 0xFF
+ * 
+ * @param response [in,out] The response as it arrived
+ */
+static void unpack_response(RESPONSE *response) {
+  uint32_t count = count_present(response->present);
+  int32_t i;
+
+  for (i = NUM_FEATURES - 1; i >= 0; i--) {
+    if (PRESENT_GET(response->present, i)) {
+      count--;
+      if (count != (uint32_t)i) {
+        memcpy(&response->feature[i], &response->feature[count], sizeof(PACKAGE));
+      }
+    } else {
+      memset(&response->feature[i], 0xFF, sizeof(PACKAGE));
+    }
+  }
+}
+
+/**
+ * @brief Start waiting for one part of the response
+ * 
+ * @param start    [in] The start byte of the part
+ * @param features [in] true for the presence bitmap and packages, false for the signature
+ */
+static void begin_part(uint8_t start, bool features) {
+  part_start = start;
+  part_features = features;
+  part_started = false;
+  part_present = 0;
+  part_sized = false;
+  part_failed = false;
+  part_complete = false;
+  response_received = false;
+}
+
+/**
+ * @brief Make whatever progress is possible on the part of the response
+ * being received, without waiting
+ * 
+ * @param response [out] Where to store the part
+ * 
+ * @return true once the part has arrived, false otherwise
+ */
+static bool poll_part(RESPONSE *response) {
+  uint32_t len;
+
+  if (part_complete || part_failed) return part_complete;
+
+  if (part_sized) {
+    // The uDMA controller collects the body of the part
+    part_complete = response_received;
+  }
+  else if (part_started) {
+    if (!part_features) {
+      part_sized = uart_dma_read(FOB_UART, response->unlock.bytes, sizeof(sb_sw_signature_t),
+                                 response_done);
+      part_failed = !part_sized;
+    }
+    else if (part_present < PRESENT_SIZE) {
+      part_present += uart_read_nb(FOB_UART, &response->present[part_present], PRESENT_SIZE - part_present);
+    }
+    else {
+      // The presence bitmap gives the number of packages
+      len = count_present(response->present) * sizeof(PACKAGE);
+      if (!present_valid(response->present)) {
+        part_failed = true;
+      }
+      else if (len == 0) {
+        part_complete = true;
+      }
+      else {
+        part_sized = uart_dma_read(FOB_UART, (uint8_t *)response->feature, len, response_done);
+        part_failed = !part_sized;
+      }
+    }
+  }
+  else if (uart_avail(FOB_UART) && uart_readb(FOB_UART) == part_start) {
+    part_started = true;
+  }
+  return part_complete;
+}
+
+/**
+ * @brief Receive the rest of the part of the response being received,
+ * within the time left for the whole response
  * 
- * Times out after 1 second.
+ * @param response [out] Where to store the part
+ * 
+ * @return true if the part arrived in time, false otherwise
+ */
+static bool receive_part(RESPONSE *response) {
+  uint32_t last = SysTickValueGet();
+  uint32_t tick;
+
+  while (response_periods > 0 && !part_failed) {
+    if (poll_part(response)) return true;
+
+    // The count reloads once a period ends, however long the last poll took
+    tick = SysTickValueGet();
+    if (tick > last) response_periods--;
+    last = tick;
+  }
+  return false;
+}
+
+/**
+ * @brief Gets the feature packages of the response to the challenge that was sent
+ * 
+ * The fob sends the packages while it signs the challenge, so they
+ * can be checked before the signature arrives. Only the packages
+ * flagged in the presence bitmap are sent. The whole response,
+ * signature included, must arrive within 1 second.
  *
- * @param response [out] Where to store the gathered response
+ * @param response [out] Where to store the presence bitmap and packages
  * 
- * @return bool true if response is received timely, false otherwise
+ * @return bool true if the packages are received timely, false otherwise
  */
-bool get_response(RESPONSE *response) {
+bool get_response_features(RESPONSE *response) {
   SysTickPeriodSet(16000000);
   SysTickEnable();
+  HWREG(NVIC_ST_CURRENT) = 0; // Reset SysTick counter
 
-  volatile uint32_t tick = SysTickValueGet();
+  response_periods = 8;
+  response_active = true;
 
-  uint8_t * buffer = (uint8_t *) response;
-  uint32_t buffer_length = sizeof(RESPONSE);
-  uint32_t i = 0;
-  uint32_t j = 0;
+  begin_part(RESP_START, true);
+  if (!receive_part(response)) return false;
 
-  bool started = false;
+  unpack_response(response);
 
-  while(j<8) {
-    HWREG(NVIC_ST_CURRENT) = 0; // Reset SysTick counter
-    j++;
-    tick = SysTickValueGet();
-    while (tick > 1000) {
-      if (UARTCharsAvail(FOB_UART) && i < buffer_length) {
-        if(started) {
-          buffer[i] = UARTCharGetNonBlocking(FOB_UART);
-          i++;
-          if (i == buffer_length) {
-            SysTickDisable();
-            return true;
-          }
-        }
-        else if (UARTCharGetNonBlocking(FOB_UART) == RESP_START) {
-          started = true;
-        }
-      }
-      tick = SysTickValueGet();
+  // The signature can start arriving right away
+  begin_part(SIG_START, false);
+  return true;
+}
+
+/**
+ * @brief Gets the signature which completes the response
+ *
+ * @param response [out] Where to store the unlock signature
+ * 
+ * @return bool true if the signature is received timely, false otherwise
+ */
+bool get_response_signature(RESPONSE *response) {
+  return receive_part(response);
+}
+
+/**
+ * @brief Services the board link while the car is busy with other work,
+ * such as verifying the feature packages, without waiting
+ * 
+ * Picks up the signature as it arrives, so get_response_signature
+ * finds it already received.
+ *
+ * @param response [out] Where to store the unlock signature
+ */
+void service_response(RESPONSE *response) {
+  if (response_active) poll_part(response);
+}
+
+/**
+ * @brief Ends the response exchange however it went,
+ * returning the board link to BAUD
+ * 
+ * A response lost at a negotiated rate lowers the rate, and the
+ * exchange is tried again at the slower one. Otherwise the fob is
+ * told the exchange is over. Once LINK_RAISE_AFTER responses have
+ * arrived at a lowered rate, the next exchange is offered one rate
+ * faster, so the link speeds up again once the line recovers.
+ * 
+ * @return true if the exchange should be tried again, false otherwise
+ */
+bool finish_response(void) {
+  bool retry = false;
+
+  if (response_active) {
+    response_active = false;
+
+    uart_dma_abort(FOB_UART);
+    SysTickDisable();
+
+    if (link_rate_current != 0 && response_periods == 0) {
+      lower_link_rate(link_rate_current);
+      retry = true;
+    }
+    else if (!part_features && part_complete && link_rate_current == link_rate &&
+             link_rate < LINK_BAUD_COUNT - 1 && ++link_successes == LINK_RAISE_AFTER) {
+      link_rate++;
+      link_successes = 0;
     }
   }
+  set_link_rate(0);
 
-  SysTickDisable();
-  return false;
+  if (!retry) uart_writeb(FOB_UART, LINK_DONE);
+  return retry;
 }
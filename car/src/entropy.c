@@ -0,0 +1,137 @@
+/**
+ * @file entropy.c
+ * @author Spartan State Security Team
+ * @brief Append-only entropy journal in flash
+ * @date 2023
+ *
+ * This source file is part of our designed system
+ * for MITRE's 2023 Embedded System CTF (eCTF).
+ *
+ * Each DRBG start appends one small record rather than rewriting a page.
+ * Records fill the journal pages in turn, and a page is only erased
+ * when the journal wraps around to it, spreading wear across all pages.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "driverlib/flash.h"
+
+#include "entropy.h"
+
+/*** Globals ***/
+// Slot of the newest committed record, or -1 if the journal is empty
+int32_t entropy_latest = -1;
+bool entropy_scanned = false;
+
+/**
+ * @brief Find a journal slot in flash
+ *
+ * @param slot [in] The index of the slot
+ *
+ * @return the record stored in the slot
+ */
+static const ENTROPY_RECORD *entropy_slot(uint32_t slot) {
+  return (const ENTROPY_RECORD *)(ENTROPY_JOURNAL_BASE + slot * sizeof(ENTROPY_RECORD));
+}
+
+/**
+ * @brief Check whether a run of flash is still erased
+ *
+ * @param addr [in] The address of the run
+ * @param size [in] The length of the run in bytes
+ *
+ * @return true if every word reads 0xFFFFFFFF, false otherwise
+ */
+static bool entropy_erased(uint32_t addr, uint32_t size) {
+  const uint32_t *words = (const uint32_t *)addr;
+  uint32_t i;
+
+  for (i = 0; i < size / sizeof(uint32_t); i++) {
+    if (words[i] != 0xFFFFFFFF) return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Find the newest committed record, once per boot
+ */
+static void entropy_scan(void) {
+  const ENTROPY_RECORD *record;
+  uint32_t slot;
+
+  if (entropy_scanned) return;
+
+  for (slot = 0; slot < ENTROPY_RECORDS; slot++) {
+    record = entropy_slot(slot);
+    if (record->commit == ENTROPY_COMMIT &&
+        (entropy_latest < 0 || record->seq > entropy_slot(entropy_latest)->seq)) {
+      entropy_latest = slot;
+    }
+  }
+  entropy_scanned = true;
+}
+
+/**
+ * @brief Load the seed left by the previous DRBG start
+ *
+ * @param seed [out] The newest seed, or zeros if the journal is empty
+ */
+void entropy_journal_seed(uint8_t seed[ENTROPY_SEED_SIZE]) {
+  entropy_scan();
+
+  if (entropy_latest < 0) {
+    memset(seed, 0, ENTROPY_SEED_SIZE);
+  } else {
+    memcpy(seed, entropy_slot(entropy_latest)->seed, ENTROPY_SEED_SIZE);
+  }
+}
+
+/**
+ * @brief Append a seed for the next DRBG start
+ *
+ * Programs the next free slot after the newest record. Moving on to
+ * the next page erases it first if it still holds old records.
+ * A record interrupted by a reset never gets its commit word,
+ * so the previous seed stays the newest.
+ *
+ * @param seed [in] The seed to keep
+ *
+ * @return true if the record was committed, false if an error occurs
+ */
+bool entropy_journal_append(const uint8_t seed[ENTROPY_SEED_SIZE]) {
+  ENTROPY_RECORD record;
+  uint32_t slot;
+  uint32_t page;
+
+  entropy_scan();
+
+  record.seq = entropy_latest < 0 ? 0 : entropy_slot(entropy_latest)->seq + 1;
+  memcpy(record.seed, seed, ENTROPY_SEED_SIZE);
+  record.commit = ENTROPY_COMMIT;
+
+  // Skip any slot left behind by an interrupted append
+  slot = entropy_latest < 0 ? 0 : (uint32_t)entropy_latest + 1;
+  while (slot % ENTROPY_RECORDS_PER_PAGE != 0 &&
+         !entropy_erased((uint32_t)entropy_slot(slot), sizeof(ENTROPY_RECORD))) {
+    slot++;
+  }
+
+  // Start the next page
+  if (slot % ENTROPY_RECORDS_PER_PAGE == 0) {
+    slot %= ENTROPY_RECORDS;
+    page = ENTROPY_JOURNAL_BASE + (slot / ENTROPY_RECORDS_PER_PAGE) * ENTROPY_PAGE_SIZE;
+    if (!entropy_erased(page, ENTROPY_PAGE_SIZE) && FlashErase(page)) return false;
+  }
+
+  // Program the seed, then commit it
+  if (FlashProgram((uint32_t *)&record, (uint32_t)entropy_slot(slot),
+                   sizeof(ENTROPY_RECORD) - sizeof(record.commit)) ||
+      FlashProgram(&record.commit, (uint32_t)&entropy_slot(slot)->commit, sizeof(record.commit)))
+    return false;
+
+  entropy_latest = slot;
+  memset(&record, 0, sizeof(record));
+  return true;
+}
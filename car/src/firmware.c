@@ -18,7 +18,6 @@
 #include "inc/hw_memmap.h"
 
 #include "driverlib/flash.h"
-#include "driverlib/eeprom.h"
 #include "driverlib/gpio.h"
 #include "driverlib/interrupt.h"
 #include "driverlib/pin_map.h"
@@ -26,11 +25,13 @@
 #include "driverlib/systick.h"
 #include "driverlib/timer.h"
 
-#include "secrets.h"
-
 #include "sb_all.h"
 
 #include "board_link.h"
+#include "p256.h"
+#include "profile.h"
+#include "store.h"
+#include "entropy.h"
 #include "uart.h"
 #include "firmware.h"
 
@@ -41,6 +42,14 @@
 // CSPRNG State
 sb_hmac_drbg_state_t drbg;
 bool DRBG_INITIALIZED = false;
+// Verified Feature Cache
+FEATURE_CACHE_ENTRY feature_cache[FEATURE_CACHE_SIZE];
+uint32_t feature_cache_next = 0;
+uint32_t feature_cache_hits = 0;
+uint32_t feature_cache_misses = 0;
+// Challenge Pool, ready challenges are challenge_pool[0 .. challenge_pool_count - 1]
+CHALLENGE challenge_pool[CHALLENGE_POOL_SIZE];
+uint32_t challenge_pool_count = 0;
 
 /**
  * @brief Main function for the secure car device
@@ -60,19 +69,8 @@ int main(void)
   GPIOPinWrite(GPIO_PORTF_BASE, GPIO_PIN_2, 0);
   GPIOPinWrite(GPIO_PORTF_BASE, GPIO_PIN_3, 0);
 
-  // Ensure EEPROM peripheral is enabled
-  SysCtlPeripheralEnable(SYSCTL_PERIPH_EEPROM0);
-  EEPROMInit();
-
-  // Establish Entropy if Needed
-  if(((uint32_t*)ENTROPY_FLASH)[0] == ((uint32_t*)ENTROPY_FLASH)[1] &&
-     ((uint32_t*)ENTROPY_FLASH)[2] == ((uint32_t*)ENTROPY_FLASH)[3] &&
-     ((uint32_t*)ENTROPY_FLASH)[0] == ((uint32_t*)ENTROPY_FLASH)[4]) {
-
-    if( FlashErase(ENTROPY_FLASH)
-     || FlashProgram((uint32_t *)&S_ENTROPY, ENTROPY_FLASH, sizeof(ENTROPY))
-    ) return -1;
-  }
+  // Initialize EEPROM once and mirror it into RAM
+  store_init();
 
   // Initialize SysTick
   SysTickPeriodSet(16000000);
@@ -84,9 +82,18 @@ int main(void)
   // Initialize board link UART
   setup_board_link();
 
+  // Initialize the unlock profiler, if built in
+  profile_init();
+
   // Always wait to handle unlock requests
   while (true) {
     tryUnlock();
+
+    // Use idle time to prepare challenges
+    tryFillChallenges();
+
+    // Answer the host's requests for profiling counters, if built in
+    profile_poll();
   }
 }
 
@@ -101,32 +108,76 @@ int main(void)
 bool tryUnlock(void) {
   CHALLENGE challenge;
   RESPONSE response;
+  VERIFICATION verification;
+  bool unlocked;
 
-  // Clear response
-  ZERO(response);
+  // Make sure the fob is requesting an unlock
+  if (!PROFILE(PROFILE_REQUEST, fob_requests_unlock())) return false;
 
-  return // Ensure below code isn't optimized out
+  do {
+    // Clear response
+    ZERO(response);
 
-  // Make sure the fob is requesting an unlock
-  fob_requests_unlock() &&
+    unlocked = // Ensure below code isn't optimized out
 
-  // Generate a challenge
-  gen_challenge(&challenge) &&
+    // Generate a challenge
+    PROFILE(PROFILE_CHALLENGE, gen_challenge(&challenge)) &&
 
-  // Send challenge to fob
-  send_challenge(&challenge) &&
+    // Move the board link to the fastest reliable rate
+    PROFILE(PROFILE_NEGOTIATE, negotiate_baud()) &&
 
-  // Get response within 1 second
-  get_response(&response) &&
+    // Send challenge to fob
+    PROFILE(PROFILE_SEND, send_challenge(&challenge)) &&
 
-  // Check whether the response to the challenge was valid
-  verify_response(&challenge, &response) &&
-  
-  // Unlock the car
-  unlockCar() &&
+    // Get the feature packages, sent while the fob signs
+    PROFILE(PROFILE_FEATURES, get_response_features(&response)) &&
+
+    // Start checking the feature packages while the signature is on its way
+    PROFILE(PROFILE_VERIFY_FEATURES, verify_features(&verification, &response)) &&
+
+    // Get the rest of the response within 1 second
+    PROFILE(PROFILE_SIGNATURE, get_response_signature(&response)) &&
+
+    // Check the signature and the packages together, and whether the response to the challenge was valid
+    PROFILE(PROFILE_VERIFY, verify_response(&verification, &challenge, &response)) &&
+    
+    // Unlock the car
+    PROFILE(PROFILE_UNLOCK, unlockCar(&response)) &&
+
+    // Start the car
+    PROFILE(PROFILE_START, startCar(&response));
+
+  // Return the board link to BAUD however the exchange ended, and go again more slowly if it was lost
+  } while (finish_response());
 
-  // Start the car
-  startCar(&response);
+  return unlocked;
+}
+
+/**
+ * @brief Refills the challenge pool once it runs low.
+ * 
+ * The missing challenges are generated by a single DRBG request,
+ * and the first call after boot also initializes the DRBG.
+ * Does nothing if the fob is waiting, so that an unlock
+ * request is never delayed.
+ */
+void tryFillChallenges(void) {
+  uint32_t missing;
+
+  // Unlock requests come first
+  if(challenge_pool_count > CHALLENGE_POOL_LOW || uart_avail(FOB_UART)) return;
+
+  // Initialize DRBG
+  if (!DRBG_INITIALIZED) {
+    if(!init_drbg()) return;
+    DRBG_INITIALIZED = true;
+  }
+
+  missing = CHALLENGE_POOL_SIZE - challenge_pool_count;
+  if(sb_hmac_drbg_generate(&drbg, (sb_byte_t *)&challenge_pool[challenge_pool_count],
+                           missing * sizeof(CHALLENGE)) == SB_SUCCESS) {
+    challenge_pool_count = CHALLENGE_POOL_SIZE;
+  }
 }
 
 /**
@@ -136,40 +187,37 @@ bool tryUnlock(void) {
  */
 bool init_drbg(void)
 {
-  ENTROPY temp_entropy;
-  sb_sw_public_t car_pubkey;
+  ENTROPY entropy;
+  uint8_t seed[ENTROPY_SEED_SIZE];
+  const CAR_DATA *car_data;
   volatile uint32_t tick;
+  uint32_t i;
 
-  // Check for Entropy Error
-  if(((uint32_t*)ENTROPY_FLASH)[0] == ((uint32_t*)ENTROPY_FLASH)[1] &&
-     ((uint32_t*)ENTROPY_FLASH)[2] == ((uint32_t*)ENTROPY_FLASH)[3] &&
-     ((uint32_t*)ENTROPY_FLASH)[0] == ((uint32_t*)ENTROPY_FLASH)[4])
-     return false;
-
-  // Get Car Public Key from EEPROM
-  if(EEPROMInit() != EEPROM_INIT_OK) return false;
-  EEPROMRead((uint32_t *)&car_pubkey, offsetof(CAR_DATA, car_pubkey), sizeof(car_pubkey));
+  // Get Car Public Key, the store checks for EEPROM Error
+  car_data = store_car_data();
+  if(!car_data) return false;
 
-  // Check for EEPROM Error
-  if(((uint32_t*)&car_pubkey)[0] == ((uint32_t*)&car_pubkey)[1] &&
-     ((uint32_t*)&car_pubkey)[2] == ((uint32_t*)&car_pubkey)[3])
-     return false;
+  // Mix the seed left by the last start into the provisioned entropy
+  memcpy(&entropy, &DEVICE_SECRETS.entropy, sizeof(ENTROPY));
+  entropy_journal_seed(seed);
+  for(i=0; i<ENTROPY_SEED_SIZE; i++) {
+    entropy.data[i] ^= seed[i];
+  }
 
   // Initialize DRBG
   tick = SysTickValueGet();
-  if(sb_hmac_drbg_init(&drbg, (void *)ENTROPY_FLASH, sizeof(ENTROPY),
-                       (sb_byte_t *)&car_pubkey, sizeof(sb_sw_public_t), (sb_byte_t *)&tick, sizeof(tick))
+  if(sb_hmac_drbg_init(&drbg, (sb_byte_t *)&entropy, sizeof(ENTROPY),
+                       (sb_byte_t *)&car_data->car_pubkey, sizeof(sb_sw_public_t), (sb_byte_t *)&tick, sizeof(tick))
      != SB_SUCCESS)
      return false;
-
-  // Checkout Entropy
-  memcpy(&temp_entropy, (void *)ENTROPY_FLASH, sizeof(ENTROPY));
+  ZERO(entropy);
 
   // Update Entropy
-  if(sb_hmac_drbg_generate(&drbg, (sb_byte_t *)&temp_entropy, sizeof(temp_entropy)) != SB_SUCCESS) return false;
+  if(sb_hmac_drbg_generate(&drbg, seed, sizeof(seed)) != SB_SUCCESS) return false;
 
-  // Commit Entropy
-  if(FlashErase(ENTROPY_FLASH) || FlashProgram((uint32_t *)&temp_entropy, ENTROPY_FLASH, sizeof(ENTROPY))) return false;
+  // Commit Entropy as one small journal record
+  if(!entropy_journal_append(seed)) return false;
+  ZERO(seed);
   
   // Success
   return true;
@@ -178,11 +226,22 @@ bool init_drbg(void)
 /**
  * @brief Generate a challenge to send to the fob
  * 
+ * Takes a ready challenge from the pool when there is one,
+ * otherwise generates one directly.
+ * 
  * @param challenge [out] The challenge being written
  * 
  * @return true if challenge was successfully generated, false if an error occurred
  */
 bool gen_challenge(CHALLENGE *challenge) {
+  // Take a ready challenge, never handing out the same one twice
+  if (challenge_pool_count > 0) {
+    challenge_pool_count--;
+    memcpy(challenge, &challenge_pool[challenge_pool_count], sizeof(CHALLENGE));
+    ZERO(challenge_pool[challenge_pool_count]);
+    return true;
+  }
+
   // Initialize DRBG
   if (!DRBG_INITIALIZED) {
     if(!init_drbg()) return false;
@@ -192,76 +251,228 @@ bool gen_challenge(CHALLENGE *challenge) {
 }
 
 /**
- * @brief Validates the response to a challenge,
- * as well as the requested features
+ * @brief Draw the weights of a batch verification from the DRBG
  * 
- * @param challenge [in] The challenge which was sent to the secure fob device
- * @param response  [in] The response to validate
+ * The fob has sent the packages being weighted by then, so it cannot pick them to cancel out.
  * 
- * @return true if response is valid, false otherwise
+ * @param weights [out] The weights being written
+ * @param count   [in]  The number of weights
+ * 
+ * @return true if the weights were generated, false if an error occurred
  */
-bool verify_response(CHALLENGE *challenge, RESPONSE *response) {
-  sb_sw_context_t sb_ctx;
-  sb_sha256_state_t sha;
-  sb_sw_message_digest_t hash;
-  sb_sw_public_t host_pubkey;
-  sb_sw_public_t car_pubkey;
-  PACKAGE package;
+bool gen_weights(uint64_t *weights, uint32_t count) {
+  if (count == 0) return true;
+
+  // Initialize DRBG
+  if (!DRBG_INITIALIZED) {
+    if(!init_drbg()) return false;
+    DRBG_INITIALIZED = true;
+  }
+  return sb_hmac_drbg_generate(&drbg, (sb_byte_t *)weights, count * sizeof(uint64_t)) == SB_SUCCESS;
+}
+
+/**
+ * @brief Starts validating the feature packages of a response
+ * 
+ * Feature packages which verified during an earlier unlock
+ * are found in the feature cache and are not verified again.
+ * The rest start a batch, which recovers their R points
+ * while the fob signs and waits for the unlock signature.
+ * 
+ * @param verification [out] The verification being started
+ * @param response     [in]  The response holding the packages
+ * 
+ * @return true if every package is well formed so far, false otherwise
+ */
+bool verify_features(VERIFICATION *verification, RESPONSE *response) {
+  p256_verify_job_t jobs[NUM_FEATURES];
+  uint64_t weights[NUM_FEATURES];
+  const CAR_DATA *car_data;
   uint8_t i;
 
-  // Get Public Keys from EEPROM
-  if(EEPROMInit() != EEPROM_INIT_OK) return false;
-  EEPROMRead((uint32_t *)&car_pubkey, offsetof(CAR_DATA, car_pubkey), sizeof(car_pubkey));
-  EEPROMRead((uint32_t *)&host_pubkey, offsetof(CAR_DATA, host_pubkey), sizeof(host_pubkey));
+  verification->count = 0;
 
-  // Verify the challenge-response response
-  if(sb_sw_verify_signature_sha256(&sb_ctx, &hash, &response->unlock, &car_pubkey,
-                                   (sb_byte_t *)challenge, sizeof(CHALLENGE), &drbg, SB_SW_CURVE_P256, ENDIAN)
-     != SB_SUCCESS)
-     return false;
-  ZERO(sb_ctx);
-  ZERO(hash);
+  // Get Public Keys
+  car_data = store_car_data();
+  if(!car_data) return false;
+
+  // Ensure the precomputed comb belongs to the host key
+  if(!p256_comb_matches(DEVICE_SECRETS.host_pubkey_comb, car_data->host_pubkey.bytes)) return false;
 
-  // Verify each of the feature signatures
+  // Queue each of the feature signatures not already verified
   for(i=1; i<=NUM_FEATURES; i++) {
-    package = response->feature[i-1];
-    if(memcmp(&package, &NON_PACKAGE, sizeof(PACKAGE))) {
-      sb_sha256_init(&sha);
-      sb_sha256_update(&sha, (sb_byte_t *)&car_pubkey, sizeof(car_pubkey));
-      sb_sha256_update(&sha, &i, sizeof(i));
-      sb_sha256_finish(&sha, (sb_byte_t *)&hash);
-      if(sb_sw_verify_signature(&sb_ctx, &package, &host_pubkey, &hash, &drbg, SB_SW_CURVE_P256, ENDIAN) != SB_SUCCESS) {
-        return false;
+    if(PRESENT_GET(response->present, i-1)) {
+      package_digest(i, &response->feature[i-1], &verification->fresh[verification->count]);
+      if(feature_cache_lookup(&verification->fresh[verification->count])) {
+        feature_cache_hits++;
+        continue;
       }
+      feature_cache_misses++;
+
+      // Package signs SHA256(car_pubkey || i), precomputed by gen_secret.py
+      jobs[verification->count].sig = response->feature[i-1].bytes;
+      jobs[verification->count].digest = DEVICE_SECRETS.feature_digest[i-1].bytes;
+      jobs[verification->count].q_comb = DEVICE_SECRETS.host_pubkey_comb;
+      verification->count++;
     }
   }
+
+  // Recover the queued signatures' R points until the unlock signature is needed
+  if(!gen_weights(weights, verification->count) ||
+     !p256_verify_start(&verification->ctx, jobs, weights, verification->count, P256_G_COMB)) return false;
+  return verify_sliced(&verification->ctx, response);
+}
+
+/**
+ * @brief Validates the response to a challenge
+ * 
+ * The unlock signature finishes the batch verify_features started,
+ * so it is checked together with the packages not found in the cache,
+ * which are only remembered once the whole batch passes.
+ * 
+ * @param verification [in,out] The verification started by verify_features
+ * @param challenge    [in]     The challenge which was sent to the secure fob device
+ * @param response     [in]     The response to validate
+ * 
+ * @return true if response is valid, false otherwise
+ */
+bool verify_response(VERIFICATION *verification, CHALLENGE *challenge, RESPONSE *response) {
+  p256_verify_job_t job;
+  sb_sha256_state_t sha;
+  const CAR_DATA *car_data;
+  uint32_t i;
+
+  // Get Public Keys
+  car_data = store_car_data();
+  if(!car_data) return false;
+
+  // Ensure the precomputed comb belongs to the car key
+  if(!p256_comb_matches(DEVICE_SECRETS.car_pubkey_comb, car_data->car_pubkey.bytes)) return false;
+
+  // Verify the challenge-response response as the last signature of the batch
+  sb_sha256_init(&sha);
+  sb_sha256_update(&sha, (sb_byte_t *)challenge, sizeof(CHALLENGE));
+  sb_sha256_finish(&sha, (sb_byte_t *)&verification->hash);
+
+  job.sig = response->unlock.bytes;
+  job.digest = verification->hash.bytes;
+  job.q_comb = DEVICE_SECRETS.car_pubkey_comb;
+  if(!p256_verify_last(&verification->ctx, &job) ||
+     !verify_sliced(&verification->ctx, response) ||
+     !p256_verify_finish(&verification->ctx)) return false;
+
+  // Remember the newly verified packages
+  for(i=0; i<verification->count; i++) {
+    feature_cache_insert(&verification->fresh[i]);
+  }
   return true;
 }
 
+/**
+ * @brief Runs a verification in short slices, servicing the
+ * board link between them
+ * 
+ * Stops once the verification finishes, or waits for its last signature.
+ * 
+ * @param ctx      [in,out] The verification in progress
+ * @param response [out]    The response still being received
+ * 
+ * @return false if the verification failed, true otherwise
+ */
+bool verify_sliced(p256_verify_ctx_t *ctx, RESPONSE *response) {
+  while(!p256_verify_continue(ctx)) {
+    service_response(response);
+  }
+  return ctx->phase != P256_VERIFY_FAILED;
+}
+
+/**
+ * @brief Compute the digest identifying a feature package in the feature cache
+ * 
+ * @param feature_num [in]  The feature number the package was sent for, starting at 1
+ * @param package     [in]  The feature package
+ * @param digest      [out] The digest being written
+ */
+void package_digest(uint8_t feature_num, PACKAGE *package, sb_sw_message_digest_t *digest) {
+  sb_sha256_state_t sha;
+
+  sb_sha256_init(&sha);
+  sb_sha256_update(&sha, &feature_num, sizeof(feature_num));
+  sb_sha256_update(&sha, (sb_byte_t *)package, sizeof(PACKAGE));
+  sb_sha256_finish(&sha, (sb_byte_t *)digest);
+}
+
+/**
+ * @brief Check whether a feature package has already been verified
+ * 
+ * @param digest [in] The digest of the package, from package_digest
+ * 
+ * @return true if the package is in the feature cache, false otherwise
+ */
+bool feature_cache_lookup(sb_sw_message_digest_t *digest) {
+  uint32_t i;
+
+  for(i=0; i<FEATURE_CACHE_SIZE; i++) {
+    if(feature_cache[i].valid &&
+       !memcmp(&feature_cache[i].digest, digest, sizeof(sb_sw_message_digest_t))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Remember a verified feature package,
+ * replacing the oldest entry once the feature cache is full
+ * 
+ * @param digest [in] The digest of the package, from package_digest
+ */
+void feature_cache_insert(sb_sw_message_digest_t *digest) {
+  if(feature_cache_lookup(digest)) return;
+
+  memcpy(&feature_cache[feature_cache_next].digest, digest, sizeof(sb_sw_message_digest_t));
+  feature_cache[feature_cache_next].valid = true;
+  feature_cache_next = (feature_cache_next + 1) % FEATURE_CACHE_SIZE;
+}
+
 /**
  * @brief Unlock the secure car device,
- * sending the unlock message to the Host.
+ * sending the unlock report header and the unlock message to the Host.
+ * 
+ * The header announces the feature messages startCar sends next,
+ * so the Host knows when the report is complete.
+ * 
+ * @param response [in] The challenge response offered by the fob
  * 
  * @return true if operation succeeds, false if an error occurs
  */
-bool unlockCar(void) {
-  uint8_t eeprom_message[UNLOCK_EEPROM_SIZE];
+bool unlockCar(RESPONSE *response) {
+  const uint8_t *message;
+  uint8_t header[REPORT_HEADER_SIZE];
+  uint32_t features = 0;
+  uint32_t length;
+  uint32_t i;
 
-  // Clear eeprom message
-  ZERO(eeprom_message);
+  // Load Unlock Success Message
+  message = store_unlock_message();
+  if(!message) return false;
 
-  // Initialize EEPROM
-  if(EEPROMInit() != EEPROM_INIT_OK){
-    return false;
+  // Count the feature messages which will follow
+  for (i = 0; i < NUM_FEATURES; i++) {
+    if(PRESENT_GET(response->present, i)) {
+      features++;
+    }
   }
-  // Load Unlock Success Message
-  EEPROMRead((uint32_t *)eeprom_message, UNLOCK_EEPROM_LOC, sizeof(eeprom_message));
+  length = UNLOCK_EEPROM_SIZE + features * FEATURE_SIZE;
 
-  // Display Unlock Success Message
-  uart_write(HOST_UART, eeprom_message, sizeof(eeprom_message));
+  header[0] = REPORT_START;
+  header[1] = (uint8_t)features;
+  header[2] = (uint8_t)length;
+  header[3] = (uint8_t)(length >> 8);
+  uart_write(HOST_UART, header, sizeof(header));
 
-  // Clear eeprom message
-  ZERO(eeprom_message);
+  // Display Unlock Success Message
+  uart_write(HOST_UART, message, UNLOCK_EEPROM_SIZE);
 
   return true;
 }
@@ -276,22 +487,16 @@ bool unlockCar(void) {
  */
 bool startCar(RESPONSE *response) {
   uint32_t i;
-  uint8_t eeprom_message[FEATURE_SIZE];
-  PACKAGE package;
+  const uint8_t *message;
 
   // Print out feature messages for all active features
   for (i = 0; i < NUM_FEATURES; i++) {
-    package = response->feature[i];
-    if(memcmp(&package, &NON_PACKAGE, sizeof(PACKAGE))) {
-      // Initialize EEPROM
-      if(EEPROMInit() != EEPROM_INIT_OK){
-        return false;
-      }
+    if(PRESENT_GET(response->present, i)) {
       // Send feature message
-      EEPROMRead((uint32_t *)eeprom_message, FEATURE_END - (i+1) * FEATURE_SIZE, sizeof(eeprom_message));
-      uart_write(HOST_UART, eeprom_message, sizeof(eeprom_message));
+      message = store_feature_message(i);
+      if(!message) return false;
+      uart_write(HOST_UART, message, FEATURE_SIZE);
     }
   }
   return true;
 }
-
@@ -0,0 +1,984 @@
+/**
+ * @file p256.c
+ * @author Spartan State Security Team
+ * @brief Supplementary P-256 arithmetic not exposed by Sweet B
+ * @date 2023
+ *
+ * This source file is part of our designed system
+ * for MITRE's 2023 Embedded System CTF (eCTF).
+ *
+ * Sweet B only offers variable-base verification, so the car verifies
+ * signatures against its static keys with fixed-base combs instead.
+ * Verification only handles public values, so the curve functions
+ * here are not constant time.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "p256.h"
+
+/*** Constants ***/
+const p256_mod_t P256_P = {
+  .m = {{ 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0x00000000,
+          0x00000000, 0x00000000, 0x00000001, 0xFFFFFFFF }},
+  .m0inv = 0x00000001,
+  .r2 = {{ 0x00000003, 0x00000000, 0xFFFFFFFF, 0xFFFFFFFB,
+           0xFFFFFFFE, 0xFFFFFFFF, 0xFFFFFFFD, 0x00000004 }},
+};
+
+const p256_mod_t P256_N = {
+  .m = {{ 0xFC632551, 0xF3B9CAC2, 0xA7179E84, 0xBCE6FAAD,
+          0xFFFFFFFF, 0xFFFFFFFF, 0x00000000, 0xFFFFFFFF }},
+  .m0inv = 0xEE00BC4F,
+  .r2 = {{ 0xBE79EEA2, 0x83244C95, 0x49BD6FA6, 0x4699799C,
+           0x2B6BEC59, 0x2845B239, 0xF3D95620, 0x66E12D94 }},
+};
+
+// The curve's b, with y^2 = x^3 - 3x + b
+static const p256_int_t P256_B = {{ 0x27D2604B, 0x3BCE3C3E, 0xCC53B0F6, 0x651D06B0,
+                                     0x769886BC, 0xB3EBBD55, 0xAA3A93E7, 0x5AC635D8 }};
+
+// (p + 1) / 4, as p = 3 mod 4 a square root of a is a^((p + 1) / 4)
+static const p256_int_t P256_SQRT_EXP = {{ 0x00000000, 0x00000000, 0x40000000, 0x00000000,
+                                            0x00000000, 0x40000000, 0xC0000000, 0x3FFFFFFF }};
+
+/**
+ * @brief Load a big-endian 32 byte string as an integer
+ *
+ * @param dest [out] The integer being written
+ * @param src  [in]  The big-endian bytes to load
+ */
+void p256_from_bytes(p256_int_t *dest, const uint8_t src[P256_BYTES]) {
+  uint32_t i;
+
+  for (i = 0; i < P256_WORDS; i++) {
+    const uint8_t *b = &src[P256_BYTES - 4 * (i + 1)];
+    dest->w[i] = ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) |
+                 ((uint32_t)b[2] << 8) | (uint32_t)b[3];
+  }
+}
+
+/**
+ * @brief Store an integer as a big-endian 32 byte string
+ *
+ * @param dest [out] The big-endian bytes being written
+ * @param src  [in]  The integer to store
+ */
+void p256_to_bytes(uint8_t dest[P256_BYTES], const p256_int_t *src) {
+  uint32_t i;
+
+  for (i = 0; i < P256_WORDS; i++) {
+    uint8_t *b = &dest[P256_BYTES - 4 * (i + 1)];
+    b[0] = (uint8_t)(src->w[i] >> 24);
+    b[1] = (uint8_t)(src->w[i] >> 16);
+    b[2] = (uint8_t)(src->w[i] >> 8);
+    b[3] = (uint8_t)src->w[i];
+  }
+}
+
+/**
+ * @brief Check whether an integer is zero
+ *
+ * @param a [in] The integer to check
+ *
+ * @return true if a is zero, false otherwise
+ */
+bool p256_is_zero(const p256_int_t *a) {
+  uint32_t acc = 0;
+  uint32_t i;
+
+  for (i = 0; i < P256_WORDS; i++) {
+    acc |= a->w[i];
+  }
+  return acc == 0;
+}
+
+/**
+ * @brief Check whether two integers are equal
+ *
+ * @param a [in] The first integer
+ * @param b [in] The second integer
+ *
+ * @return true if a equals b, false otherwise
+ */
+bool p256_equal(const p256_int_t *a, const p256_int_t *b) {
+  uint32_t acc = 0;
+  uint32_t i;
+
+  for (i = 0; i < P256_WORDS; i++) {
+    acc |= a->w[i] ^ b->w[i];
+  }
+  return acc == 0;
+}
+
+/**
+ * @brief Check whether an integer lies in [1, m - 1]
+ *
+ * @param a [in] The integer to check
+ * @param m [in] The modulus
+ *
+ * @return true if a is a nonzero reduced value, false otherwise
+ */
+bool p256_in_range(const p256_int_t *a, const p256_mod_t *m) {
+  p256_int_t r = *a;
+
+  p256_mod_reduce(&r, m);
+  return !p256_is_zero(a) && p256_equal(&r, a);
+}
+
+/**
+ * @brief Subtract the modulus from a value if the value is too large
+ *
+ * @param a     [in,out] The value to reduce, below 2^256 + m
+ * @param carry [in]     The 257th bit of the value
+ * @param m     [in]     The modulus
+ */
+static void p256_cond_sub(p256_int_t *a, uint32_t carry, const p256_mod_t *m) {
+  p256_int_t d;
+  uint64_t t;
+  uint32_t borrow = 0;
+  uint32_t mask;
+  uint32_t i;
+
+  for (i = 0; i < P256_WORDS; i++) {
+    t = (uint64_t)a->w[i] - m->m.w[i] - borrow;
+    d.w[i] = (uint32_t)t;
+    borrow = (uint32_t)(t >> 32) & 1;
+  }
+
+  // Keep the difference unless it underflowed without a carry to absorb it
+  mask = (uint32_t)0 - (carry | (borrow ^ 1));
+  for (i = 0; i < P256_WORDS; i++) {
+    a->w[i] = (d.w[i] & mask) | (a->w[i] & ~mask);
+  }
+}
+
+/**
+ * @brief Reduce a 256-bit value modulo m
+ *
+ * Any 256-bit value is below 2m for the moduli used here,
+ * so a single conditional subtraction suffices.
+ *
+ * @param a [in,out] The value to reduce
+ * @param m [in]     The modulus
+ */
+void p256_mod_reduce(p256_int_t *a, const p256_mod_t *m) {
+  p256_cond_sub(a, 0, m);
+}
+
+/**
+ * @brief Compute (a + b) mod m
+ *
+ * @param dest [out] The sum
+ * @param a    [in]  The first addend, already reduced
+ * @param b    [in]  The second addend, already reduced
+ * @param m    [in]  The modulus
+ */
+void p256_mod_add(p256_int_t *dest, const p256_int_t *a, const p256_int_t *b, const p256_mod_t *m) {
+  uint64_t t = 0;
+  uint32_t i;
+
+  for (i = 0; i < P256_WORDS; i++) {
+    t = (uint64_t)a->w[i] + b->w[i] + (t >> 32);
+    dest->w[i] = (uint32_t)t;
+  }
+  p256_cond_sub(dest, (uint32_t)(t >> 32), m);
+}
+
+/**
+ * @brief Compute (a - b) mod m
+ *
+ * @param dest [out] The difference
+ * @param a    [in]  The minuend, already reduced
+ * @param b    [in]  The subtrahend, already reduced
+ * @param m    [in]  The modulus
+ */
+void p256_mod_sub(p256_int_t *dest, const p256_int_t *a, const p256_int_t *b, const p256_mod_t *m) {
+  uint64_t t;
+  uint32_t borrow = 0;
+  uint32_t mask;
+  uint32_t i;
+
+  for (i = 0; i < P256_WORDS; i++) {
+    t = (uint64_t)a->w[i] - b->w[i] - borrow;
+    dest->w[i] = (uint32_t)t;
+    borrow = (uint32_t)(t >> 32) & 1;
+  }
+
+  // Add the modulus back if the difference underflowed
+  mask = (uint32_t)0 - borrow;
+  t = 0;
+  for (i = 0; i < P256_WORDS; i++) {
+    t = (uint64_t)dest->w[i] + (m->m.w[i] & mask) + (t >> 32);
+    dest->w[i] = (uint32_t)t;
+  }
+}
+
+/**
+ * @brief Compute a * b * R^-1 mod m (Montgomery multiplication)
+ *
+ * @param dest [out] The product, may alias either input
+ * @param a    [in]  The first factor, already reduced
+ * @param b    [in]  The second factor, already reduced
+ * @param m    [in]  The modulus
+ */
+void p256_mont_mul(p256_int_t *dest, const p256_int_t *a, const p256_int_t *b, const p256_mod_t *m) {
+  uint32_t t[P256_WORDS + 2];
+  uint64_t c;
+  uint32_t q;
+  uint32_t i, j;
+
+  memset(t, 0, sizeof(t));
+
+  for (i = 0; i < P256_WORDS; i++) {
+    // t += a * b[i]
+    c = 0;
+    for (j = 0; j < P256_WORDS; j++) {
+      c = (uint64_t)a->w[j] * b->w[i] + t[j] + (c >> 32);
+      t[j] = (uint32_t)c;
+    }
+    c = (uint64_t)t[P256_WORDS] + (c >> 32);
+    t[P256_WORDS] = (uint32_t)c;
+    t[P256_WORDS + 1] = (uint32_t)(c >> 32);
+
+    // t = (t + q * m) / 2^32
+    q = t[0] * m->m0inv;
+    c = (uint64_t)q * m->m.w[0] + t[0];
+    for (j = 1; j < P256_WORDS; j++) {
+      c = (uint64_t)q * m->m.w[j] + t[j] + (c >> 32);
+      t[j - 1] = (uint32_t)c;
+    }
+    c = (uint64_t)t[P256_WORDS] + (c >> 32);
+    t[P256_WORDS - 1] = (uint32_t)c;
+    t[P256_WORDS] = t[P256_WORDS + 1] + (uint32_t)(c >> 32);
+  }
+
+  memcpy(dest->w, t, sizeof(dest->w));
+  p256_cond_sub(dest, t[P256_WORDS], m);
+}
+
+/**
+ * @brief Convert a reduced value into Montgomery form, computing a * R mod m
+ *
+ * @param dest [out] The value in Montgomery form
+ * @param a    [in]  The value to convert
+ * @param m    [in]  The modulus
+ */
+void p256_to_mont(p256_int_t *dest, const p256_int_t *a, const p256_mod_t *m) {
+  p256_mont_mul(dest, a, &m->r2, m);
+}
+
+/**
+ * @brief Begin a power which is computed a few exponent bits at a time
+ *
+ * @param x [out] The running power, set to R mod m, the Montgomery form of 1
+ * @param m [in]  The prime modulus
+ */
+static void p256_mont_pow_start(p256_int_t *x, const p256_mod_t *m) {
+  p256_int_t one = {{ 1 }};
+
+  p256_to_mont(x, &one, m);
+}
+
+/**
+ * @brief Continue a power over exponent bits hi down to lo
+ *
+ * Once bit 0 has been processed x holds a^e in Montgomery form.
+ *
+ * @param x  [in,out] The running power
+ * @param a  [in]     The base in Montgomery form
+ * @param e  [in]     The exponent
+ * @param m  [in]     The prime modulus
+ * @param hi [in]     The first exponent bit to process
+ * @param lo [in]     The last exponent bit to process
+ */
+static void p256_mont_pow_bits(p256_int_t *x, const p256_int_t *a, const p256_int_t *e,
+                               const p256_mod_t *m, int32_t hi, int32_t lo) {
+  int32_t bit;
+
+  for (bit = hi; bit >= lo; bit--) {
+    p256_mont_mul(x, x, x, m);
+    if ((e->w[bit / 32] >> (bit % 32)) & 1) {
+      p256_mont_mul(x, x, a, m);
+    }
+  }
+}
+
+/**
+ * @brief Get the exponent m - 2 which inverts modulo m
+ *
+ * @param e [out] The exponent
+ * @param m [in]  The prime modulus
+ */
+static void p256_inv_exp(p256_int_t *e, const p256_mod_t *m) {
+  *e = m->m;
+
+  // All moduli used here are odd with a low word above 2
+  e->w[0] -= 2;
+}
+
+/**
+ * @brief Invert a value in Montgomery form, computing a^-1 * R mod m
+ *
+ * Uses Fermat's little theorem. The exponent m - 2 is public,
+ * so the sequence of operations does not depend on the input.
+ *
+ * @param dest [out] The inverse in Montgomery form
+ * @param a    [in]  The nonzero value in Montgomery form
+ * @param m    [in]  The prime modulus
+ */
+void p256_mont_inv(p256_int_t *dest, const p256_int_t *a, const p256_mod_t *m) {
+  p256_int_t x, e;
+
+  p256_inv_exp(&e, m);
+  p256_mont_pow_start(&x, m);
+  p256_mont_pow_bits(&x, a, &e, m, 8 * P256_BYTES - 1, 0);
+  memcpy(dest, &x, sizeof(x));
+}
+
+/**
+ * @brief Double a Jacobian point, for a curve with a = -3
+ *
+ * @param dest [out] The doubled point, may alias the input
+ * @param a    [in]  The point to double
+ */
+static void p256_double(p256_jacobian_t *dest, const p256_jacobian_t *a) {
+  p256_int_t delta, gamma, beta, alpha, t;
+  const p256_mod_t *p = &P256_P;
+
+  if (p256_is_zero(&a->z) || p256_is_zero(&a->y)) {
+    memset(dest, 0, sizeof(*dest));
+    return;
+  }
+
+  p256_mont_mul(&delta, &a->z, &a->z, p);
+  p256_mont_mul(&gamma, &a->y, &a->y, p);
+  p256_mont_mul(&beta, &a->x, &gamma, p);
+
+  // alpha = 3 * (x - delta) * (x + delta)
+  p256_mod_sub(&t, &a->x, &delta, p);
+  p256_mod_add(&alpha, &a->x, &delta, p);
+  p256_mont_mul(&alpha, &alpha, &t, p);
+  p256_mod_add(&t, &alpha, &alpha, p);
+  p256_mod_add(&alpha, &alpha, &t, p);
+
+  // z3 = (y + z)^2 - gamma - delta
+  p256_mod_add(&t, &a->y, &a->z, p);
+  p256_mont_mul(&t, &t, &t, p);
+  p256_mod_sub(&t, &t, &gamma, p);
+  p256_mod_sub(&dest->z, &t, &delta, p);
+
+  // x3 = alpha^2 - 8 * beta
+  p256_mod_add(&beta, &beta, &beta, p);
+  p256_mod_add(&beta, &beta, &beta, p);
+  p256_mont_mul(&t, &alpha, &alpha, p);
+  p256_mod_sub(&t, &t, &beta, p);
+  p256_mod_sub(&dest->x, &t, &beta, p);
+
+  // y3 = alpha * (4 * beta - x3) - 8 * gamma^2
+  p256_mod_sub(&t, &beta, &dest->x, p);
+  p256_mont_mul(&t, &alpha, &t, p);
+  p256_mont_mul(&gamma, &gamma, &gamma, p);
+  p256_mod_add(&gamma, &gamma, &gamma, p);
+  p256_mod_add(&gamma, &gamma, &gamma, p);
+  p256_mod_add(&gamma, &gamma, &gamma, p);
+  p256_mod_sub(&dest->y, &t, &gamma, p);
+}
+
+/**
+ * @brief Add an affine point to a Jacobian point
+ *
+ * @param dest [in,out] The Jacobian point to add into
+ * @param b    [in]     The affine point to add
+ */
+static void p256_add_affine(p256_jacobian_t *dest, const p256_affine_t *b) {
+  p256_int_t z1z1, u2, s2, h, hh, i, j, r, v, t;
+  const p256_mod_t *p = &P256_P;
+  p256_int_t one = {{ 1 }};
+
+  // Infinity plus b is b
+  if (p256_is_zero(&dest->z)) {
+    dest->x = b->x;
+    dest->y = b->y;
+    p256_to_mont(&dest->z, &one, p);
+    return;
+  }
+
+  p256_mont_mul(&z1z1, &dest->z, &dest->z, p);
+  p256_mont_mul(&u2, &b->x, &z1z1, p);
+  p256_mont_mul(&s2, &b->y, &dest->z, p);
+  p256_mont_mul(&s2, &s2, &z1z1, p);
+
+  // h = u2 - x1, r = 2 * (s2 - y1)
+  p256_mod_sub(&h, &u2, &dest->x, p);
+  p256_mod_sub(&r, &s2, &dest->y, p);
+  if (p256_is_zero(&h)) {
+    if (p256_is_zero(&r)) {
+      p256_double(dest, dest);
+    } else {
+      memset(dest, 0, sizeof(*dest));
+    }
+    return;
+  }
+  p256_mod_add(&r, &r, &r, p);
+
+  // i = 4 * h^2, j = h * i, v = x1 * i
+  p256_mont_mul(&hh, &h, &h, p);
+  p256_mod_add(&i, &hh, &hh, p);
+  p256_mod_add(&i, &i, &i, p);
+  p256_mont_mul(&j, &h, &i, p);
+  p256_mont_mul(&v, &dest->x, &i, p);
+
+  // z3 = (z1 + h)^2 - z1z1 - hh
+  p256_mod_add(&t, &dest->z, &h, p);
+  p256_mont_mul(&t, &t, &t, p);
+  p256_mod_sub(&t, &t, &z1z1, p);
+  p256_mod_sub(&dest->z, &t, &hh, p);
+
+  // x3 = r^2 - j - 2 * v
+  p256_mont_mul(&t, &r, &r, p);
+  p256_mod_sub(&t, &t, &j, p);
+  p256_mod_sub(&t, &t, &v, p);
+  p256_mod_sub(&dest->x, &t, &v, p);
+
+  // y3 = r * (v - x3) - 2 * y1 * j
+  p256_mod_sub(&t, &v, &dest->x, p);
+  p256_mont_mul(&t, &r, &t, p);
+  p256_mont_mul(&j, &dest->y, &j, p);
+  p256_mod_add(&j, &j, &j, p);
+  p256_mod_sub(&dest->y, &t, &j, p);
+}
+
+/**
+ * @brief Gather the comb index for one column of a scalar
+ *
+ * @param k   [in] The scalar
+ * @param col [in] The column, below P256_COMB_SPACING
+ *
+ * @return the comb index, zero if no teeth are set
+ */
+static uint32_t p256_comb_index(const p256_int_t *k, uint32_t col) {
+  uint32_t v = 0;
+  uint32_t tooth;
+  uint32_t bit;
+
+  for (tooth = 0; tooth < P256_COMB_TEETH; tooth++) {
+    bit = tooth * P256_COMB_SPACING + col;
+    v |= ((k->w[bit / 32] >> (bit % 32)) & 1) << tooth;
+  }
+  return v;
+}
+
+/**
+ * @brief Check that a comb was built for the given public key
+ *
+ * @param comb [in] The comb to check
+ * @param pub  [in] The public key, as big-endian x || y
+ *
+ * @return true if the first comb entry is the public key, false otherwise
+ */
+bool p256_comb_matches(const p256_comb_t comb, const uint8_t pub[2 * P256_BYTES]) {
+  p256_int_t x, y;
+
+  p256_from_bytes(&x, pub);
+  p256_from_bytes(&y, &pub[P256_BYTES]);
+  p256_to_mont(&x, &x, &P256_P);
+  p256_to_mont(&y, &y, &P256_P);
+  return p256_equal(&x, &comb[0].x) && p256_equal(&y, &comb[0].y);
+}
+
+/**
+ * @brief Compute r + n, the other value below p congruent to r mod n
+ *
+ * @param c [out] The sum, meaningful only if it is below p
+ * @param r [in]  The value, already in [1, n - 1]
+ *
+ * @return true if r + n is below p, false otherwise
+ */
+static bool p256_add_n(p256_int_t *c, const p256_int_t *r) {
+  p256_int_t t;
+
+  // A sum which wrapped past p is left below n
+  p256_mod_add(c, r, &P256_N.m, &P256_P);
+  t = *c;
+  p256_mod_reduce(&t, &P256_N);
+  return !p256_equal(&t, c);
+}
+
+/**
+ * @brief Check whether a Jacobian point has x mod n equal to r
+ *
+ * Compares without leaving Jacobian coordinates, trying r and r + n,
+ * the two values below p congruent to r mod n.
+ *
+ * @param a [in] The point to check, not infinity
+ * @param r [in] The expected value, already in [1, n - 1]
+ *
+ * @return true if x(a) mod n is r, false otherwise
+ */
+static bool p256_x_matches(const p256_jacobian_t *a, const p256_int_t *r) {
+  p256_int_t zz, c, t;
+
+  p256_mont_mul(&zz, &a->z, &a->z, &P256_P);
+  p256_to_mont(&t, r, &P256_P);
+  p256_mont_mul(&t, &t, &zz, &P256_P);
+  if (p256_equal(&t, &a->x)) {
+    return true;
+  }
+
+  // r + n is only a candidate while the sum stays below p
+  if (!p256_add_n(&c, r)) {
+    return false;
+  }
+  p256_to_mont(&t, &c, &P256_P);
+  p256_mont_mul(&t, &t, &zz, &P256_P);
+  return p256_equal(&t, &a->x);
+}
+
+/**
+ * @brief Verify an ECDSA signature using fixed-base combs
+ *
+ * @param sig    [in] The signature, as big-endian r || s
+ * @param digest [in] The big-endian message digest
+ * @param g_comb [in] The comb for the base point G
+ * @param q_comb [in] The comb for the signer's public key Q
+ *
+ * @return true if the signature is valid, false otherwise
+ */
+bool p256_verify_comb(const uint8_t sig[2 * P256_BYTES], const uint8_t digest[P256_BYTES],
+                      const p256_comb_t g_comb, const p256_comb_t q_comb) {
+  p256_verify_job_t job = { sig, digest, q_comb };
+
+  return p256_verify_batch(&job, NULL, 1, g_comb);
+}
+
+/**
+ * @brief Verify several ECDSA signatures together using fixed-base combs
+ *
+ * Runs every slice of the verification back to back. Every signature
+ * but the last is checked through R, and carries a recovery byte.
+ *
+ * @param jobs    [in] The signatures to verify
+ * @param weights [in] A random weight for each signature but the last
+ * @param count   [in] The number of signatures, at most P256_MAX_BATCH
+ * @param g_comb  [in] The comb for the base point G
+ *
+ * @return true if every signature is valid, false otherwise
+ */
+bool p256_verify_batch(const p256_verify_job_t *jobs, const uint64_t *weights, uint32_t count,
+                       const p256_comb_t g_comb) {
+  p256_verify_ctx_t ctx;
+
+  if (count == 0 || !p256_verify_start(&ctx, jobs, weights, count - 1, g_comb) ||
+      !p256_verify_last(&ctx, &jobs[count - 1])) {
+    return false;
+  }
+  while (!p256_verify_continue(&ctx)) {
+  }
+  return p256_verify_finish(&ctx);
+}
+
+/**
+ * @brief Load the r and s of a signature, checking 1 <= r, s < n
+ *
+ * @param ctx [in,out] The verification in progress
+ * @param i   [in]     The index of the signature
+ * @param sig [in]     The signature, as big-endian r || s
+ *
+ * @return true if the signature is well formed, false otherwise
+ */
+static bool p256_verify_load(p256_verify_ctx_t *ctx, uint32_t i, const uint8_t *sig) {
+  p256_int_t t;
+
+  p256_from_bytes(&ctx->r[i], sig);
+  p256_from_bytes(&t, &sig[P256_BYTES]);
+  if (!p256_in_range(&ctx->r[i], &P256_N) || !p256_in_range(&t, &P256_N)) {
+    return false;
+  }
+
+  // Keep s in Montgomery form for the inversion
+  p256_to_mont(&ctx->s[i], &t, &P256_N);
+  return true;
+}
+
+/**
+ * @brief Begin inverting the product of every s, once the last signature is in
+ *
+ * @param ctx [in,out] The verification in progress
+ */
+static void p256_verify_invert(p256_verify_ctx_t *ctx) {
+  uint32_t i;
+
+  ctx->prod[0] = ctx->s[0];
+  for (i = 1; i <= ctx->count; i++) {
+    p256_mont_mul(&ctx->prod[i], &ctx->prod[i - 1], &ctx->s[i], &P256_N);
+  }
+
+  p256_mont_pow_start(&ctx->pow, &P256_N);
+  ctx->phase = P256_VERIFY_INVERT;
+  ctx->step = 8 * P256_BYTES - 1;
+}
+
+/**
+ * @brief Begin verifying several ECDSA signatures together
+ *
+ * Each signature i given here is checked through its point R_i,
+ * recovered from r_i and the recovery byte which follows s_i,
+ * and weighted by a random w_i unknown to the signer. The last
+ * signature, given by p256_verify_last, is compared on x instead.
+ * With u1 = z / s and u2 = r / s for each signature, the batch is
+ * valid if
+ *
+ *   sum w_i * (u1_i * G + u2_i * Q_i - R_i) + u1 * G + u2 * Q
+ *
+ * has x mod n equal to the last r. A bad signature in the batch
+ * misses this with probability about 2^-63 and fails the whole batch.
+ *
+ * All s values are inverted with a single modular inversion
+ * (Montgomery's trick), and the weighted scalars of G and of each
+ * distinct key are summed. The sum is then computed by a single
+ * accumulator, which walks the weight bits and, over the last
+ * P256_COMB_SPACING of them, the comb columns. Every signature shares
+ * its doublings, and each key and G cost one comb walk for the whole
+ * batch. Without signatures checked through R, only the comb columns
+ * are walked.
+ *
+ * The work is split into slices run by p256_verify_continue, none
+ * longer than P256_INV_SLICE_BITS steps of an inversion or square root
+ * or one point operation of the walk, so the caller can service other
+ * work in between. Signatures given here are recovered, and the weight
+ * bits above the comb columns walked, while the last one is still on
+ * its way.
+ *
+ * @param ctx     [out] The verification in progress
+ * @param jobs    [in]  The signatures checked through R, kept until the verification finishes
+ * @param weights [in]  A random weight for each signature, its top bit is set here
+ * @param count   [in]  The number of signatures, below P256_MAX_BATCH
+ * @param g_comb  [in]  The comb for the base point G
+ *
+ * @return true if the signatures are well formed, false otherwise
+ */
+bool p256_verify_start(p256_verify_ctx_t *ctx, const p256_verify_job_t *jobs, const uint64_t *weights,
+                       uint32_t count, const p256_comb_t g_comb) {
+  uint32_t i;
+
+  ctx->phase = P256_VERIFY_FAILED;
+  if (count >= P256_MAX_BATCH) {
+    return false;
+  }
+
+  for (i = 0; i < count; i++) {
+    if (!p256_verify_load(ctx, i, jobs[i].sig) ||
+        (jobs[i].sig[2 * P256_BYTES] & ~(P256_RECOVERY_ODD_Y | P256_RECOVERY_HIGH_X))) {
+      return false;
+    }
+    ctx->jobs[i] = jobs[i];
+
+    // A weight never vanishes, so no signature drops out of the sum
+    ctx->weight[i] = weights[i] | (uint64_t)1 << (P256_WEIGHT_BITS - 1);
+  }
+
+  ctx->count = count;
+  ctx->closed = false;
+  ctx->g_comb = g_comb;
+  ctx->phase = count ? P256_VERIFY_RECOVER : P256_VERIFY_WAIT;
+  ctx->step = 8 * P256_BYTES - 1;
+  ctx->job = 0;
+  memset(&ctx->acc, 0, sizeof(ctx->acc));
+  return true;
+}
+
+/**
+ * @brief Give the last signature of a batch, which is compared on x
+ *
+ * @param ctx [in,out] The verification in progress
+ * @param job [in]     The last signature, kept until the verification finishes
+ *
+ * @return true if the signature is well formed, false otherwise
+ */
+bool p256_verify_last(p256_verify_ctx_t *ctx, const p256_verify_job_t *job) {
+  if ((ctx->phase != P256_VERIFY_RECOVER && ctx->phase != P256_VERIFY_WEIGHTS &&
+       ctx->phase != P256_VERIFY_WAIT) || ctx->closed) {
+    ctx->phase = P256_VERIFY_FAILED;
+    return false;
+  }
+  if (!p256_verify_load(ctx, ctx->count, job->sig)) {
+    ctx->phase = P256_VERIFY_FAILED;
+    return false;
+  }
+  ctx->jobs[ctx->count] = *job;
+  ctx->closed = true;
+
+  if (ctx->phase == P256_VERIFY_WAIT) {
+    p256_verify_invert(ctx);
+  }
+  return true;
+}
+
+/**
+ * @brief Begin recovering the point R of a signature from its r
+ *
+ * @param ctx [in,out] The verification in progress
+ *
+ * @return true if r and the recovery byte give an x on the curve's field, false otherwise
+ */
+static bool p256_recover_start(p256_verify_ctx_t *ctx) {
+  p256_affine_t *neg_r = &ctx->neg_r[ctx->job];
+  p256_int_t x, t;
+
+  // x is r, or r + n if that is still below p
+  x = ctx->r[ctx->job];
+  if ((ctx->jobs[ctx->job].sig[2 * P256_BYTES] & P256_RECOVERY_HIGH_X) && !p256_add_n(&x, &x)) {
+    return false;
+  }
+  p256_to_mont(&neg_r->x, &x, &P256_P);
+
+  // rhs = x^3 - 3x + b
+  p256_mont_mul(&ctx->rhs, &neg_r->x, &neg_r->x, &P256_P);
+  p256_mont_mul(&ctx->rhs, &ctx->rhs, &neg_r->x, &P256_P);
+  p256_mod_add(&t, &neg_r->x, &neg_r->x, &P256_P);
+  p256_mod_add(&t, &t, &neg_r->x, &P256_P);
+  p256_mod_sub(&ctx->rhs, &ctx->rhs, &t, &P256_P);
+  p256_to_mont(&t, &P256_B, &P256_P);
+  p256_mod_add(&ctx->rhs, &ctx->rhs, &t, &P256_P);
+
+  p256_mont_pow_start(&ctx->pow, &P256_P);
+  return true;
+}
+
+/**
+ * @brief Finish recovering the point R of a signature, storing -R
+ *
+ * @param ctx [in,out] The verification in progress, holding the square root of rhs if there is one
+ *
+ * @return true if R is on the curve, false otherwise
+ */
+static bool p256_recover_finish(p256_verify_ctx_t *ctx) {
+  p256_affine_t *neg_r = &ctx->neg_r[ctx->job];
+  p256_int_t one = {{ 1 }};
+  p256_int_t zero = {{ 0 }};
+  p256_int_t t;
+  bool odd;
+
+  // Unless pow squares to rhs, rhs has no square root and x is no point's
+  p256_mont_mul(&t, &ctx->pow, &ctx->pow, &P256_P);
+  if (!p256_equal(&t, &ctx->rhs)) {
+    return false;
+  }
+
+  // Pick the y of the recovery byte's parity, then negate it, y is never zero
+  p256_mont_mul(&t, &ctx->pow, &one, &P256_P);
+  odd = (ctx->jobs[ctx->job].sig[2 * P256_BYTES] & P256_RECOVERY_ODD_Y) != 0;
+  if ((t.w[0] & 1) == odd) {
+    p256_mod_sub(&neg_r->y, &zero, &ctx->pow, &P256_P);
+  } else {
+    neg_r->y = ctx->pow;
+  }
+  return true;
+}
+
+/**
+ * @brief Combine the weighted scalars of G and of each distinct key
+ *
+ * @param ctx [in,out] The verification in progress, holding the inverse of every s
+ */
+static void p256_verify_scalars(p256_verify_ctx_t *ctx) {
+  p256_int_t t, w;
+  uint32_t i, k;
+
+  // Peel off each s_i^-1
+  for (i = ctx->count; i > 0; i--) {
+    p256_mont_mul(&t, &ctx->pow, &ctx->prod[i - 1], &P256_N);
+    p256_mont_mul(&ctx->pow, &ctx->pow, &ctx->s[i], &P256_N);
+    ctx->s[i] = t;
+  }
+  ctx->s[0] = ctx->pow;
+
+  memset(&ctx->a, 0, sizeof(ctx->a));
+  memset(ctx->b, 0, sizeof(ctx->b));
+  ctx->keys = 0;
+  for (i = 0; i <= ctx->count; i++) {
+    // s_i = w_i / s_i, the last signature's weight is 1
+    if (i < ctx->count) {
+      memset(&w, 0, sizeof(w));
+      w.w[0] = (uint32_t)ctx->weight[i];
+      w.w[1] = (uint32_t)(ctx->weight[i] >> 32);
+      p256_to_mont(&w, &w, &P256_N);
+      p256_mont_mul(&ctx->s[i], &ctx->s[i], &w, &P256_N);
+    }
+
+    // a += w_i * z_i / s_i
+    p256_from_bytes(&t, ctx->jobs[i].digest);
+    p256_mod_reduce(&t, &P256_N);
+    p256_mont_mul(&t, &t, &ctx->s[i], &P256_N);
+    p256_mod_add(&ctx->a, &ctx->a, &t, &P256_N);
+
+    // b_k += w_i * r_i / s_i, for the key k which signed
+    for (k = 0; k < ctx->keys && ctx->q_comb[k] != ctx->jobs[i].q_comb; k++) {
+    }
+    if (k == ctx->keys) {
+      ctx->q_comb[ctx->keys++] = ctx->jobs[i].q_comb;
+    }
+    p256_mont_mul(&t, &ctx->r[i], &ctx->s[i], &P256_N);
+    p256_mod_add(&ctx->b[k], &ctx->b[k], &t, &P256_N);
+  }
+}
+
+/**
+ * @brief Run the next point operation of the walk
+ *
+ * Each step of the walk doubles the accumulator, adds -R_i for every
+ * weight with the step's bit set, then, over the last
+ * P256_COMB_SPACING steps, adds the comb column of G and of each key.
+ *
+ * @param ctx [in,out] The verification in progress
+ *
+ * @return true once an operation ran or the walk reached the comb columns or its end,
+ *         false if the next one was skipped
+ */
+static bool p256_walk_next(p256_verify_ctx_t *ctx) {
+  uint32_t op = ctx->job++;
+  const p256_int_t *k;
+  const p256_affine_t *comb;
+  uint32_t v;
+
+  if (op == 0) {
+    p256_double(&ctx->acc, &ctx->acc);
+    return true;
+  }
+
+  // -R_i if bit step of w_i is set
+  op--;
+  if (op < ctx->count) {
+    if ((ctx->weight[op] >> ctx->step) & 1) {
+      p256_add_affine(&ctx->acc, &ctx->neg_r[op]);
+      return true;
+    }
+    return false;
+  }
+
+  // The comb column of G, then of each key
+  op -= ctx->count;
+  if (op <= ctx->keys) {
+    if (ctx->step >= P256_COMB_SPACING) {
+      return false;
+    }
+    k = op ? &ctx->b[op - 1] : &ctx->a;
+    comb = op ? ctx->q_comb[op - 1] : ctx->g_comb;
+    v = p256_comb_index(k, ctx->step);
+    if (v) {
+      p256_add_affine(&ctx->acc, &comb[v - 1]);
+      return true;
+    }
+    return false;
+  }
+
+  // Step done
+  ctx->job = 0;
+  return --ctx->step < 0 || ctx->step == P256_COMB_SPACING - 1;
+}
+
+/**
+ * @brief Run the next slice of a verification
+ *
+ * @param ctx [in,out] The verification in progress
+ *
+ * @return true once the verification is done or waits for its last signature,
+ *         false while slices remain
+ */
+bool p256_verify_continue(p256_verify_ctx_t *ctx) {
+  p256_int_t e;
+
+  switch (ctx->phase) {
+  case P256_VERIFY_RECOVER:
+    // y = rhs^((p + 1) / 4) a few exponent bits at a time
+    if (ctx->step == 8 * P256_BYTES - 1 && !p256_recover_start(ctx)) {
+      ctx->phase = P256_VERIFY_FAILED;
+      return true;
+    }
+    p256_mont_pow_bits(&ctx->pow, &ctx->rhs, &P256_SQRT_EXP, &P256_P,
+                       ctx->step, ctx->step - (P256_INV_SLICE_BITS - 1));
+    ctx->step -= P256_INV_SLICE_BITS;
+    if (ctx->step >= 0) {
+      return false;
+    }
+    if (!p256_recover_finish(ctx)) {
+      ctx->phase = P256_VERIFY_FAILED;
+      return true;
+    }
+    ctx->step = 8 * P256_BYTES - 1;
+    if (++ctx->job < ctx->count) {
+      return false;
+    }
+    ctx->phase = P256_VERIFY_WEIGHTS;
+    ctx->step = P256_WEIGHT_BITS - 1;
+    ctx->job = 0;
+    return false;
+
+  case P256_VERIFY_WEIGHTS:
+    // One point operation per slice, up to the first step with comb columns, which need the scalars
+    while (!p256_walk_next(ctx)) {
+    }
+    if (ctx->step >= P256_COMB_SPACING) {
+      return false;
+    }
+    if (!ctx->closed) {
+      ctx->phase = P256_VERIFY_WAIT;
+      return true;
+    }
+    p256_verify_invert(ctx);
+    return false;
+
+  case P256_VERIFY_INVERT:
+    // Invert the product a few exponent bits at a time
+    p256_inv_exp(&e, &P256_N);
+    p256_mont_pow_bits(&ctx->pow, &ctx->prod[ctx->count], &e, &P256_N,
+                       ctx->step, ctx->step - (P256_INV_SLICE_BITS - 1));
+    ctx->step -= P256_INV_SLICE_BITS;
+    if (ctx->step < 0) {
+      ctx->phase = P256_VERIFY_SCALARS;
+    }
+    return false;
+
+  case P256_VERIFY_SCALARS:
+    // The walk goes on from the first step with comb columns
+    p256_verify_scalars(ctx);
+    ctx->phase = P256_VERIFY_COMB;
+    ctx->step = P256_COMB_SPACING - 1;
+    ctx->job = 0;
+    return false;
+
+  case P256_VERIFY_COMB:
+    // One point operation per slice
+    while (!p256_walk_next(ctx)) {
+    }
+    if (ctx->step < 0) {
+      ctx->phase = P256_VERIFY_CHECK;
+    }
+    return false;
+
+  case P256_VERIFY_CHECK:
+    if (p256_is_zero(&ctx->acc.z) || !p256_x_matches(&ctx->acc, &ctx->r[ctx->count])) {
+      ctx->phase = P256_VERIFY_FAILED;
+    } else {
+      ctx->phase = P256_VERIFY_PASSED;
+    }
+    return true;
+
+  default:
+    return true;
+  }
+}
+
+/**
+ * @brief Get the outcome of a verification
+ *
+ * @param ctx [in] The verification, done according to p256_verify_continue
+ *
+ * @return true if every signature is valid, false otherwise
+ */
+bool p256_verify_finish(const p256_verify_ctx_t *ctx) {
+  return ctx->phase == P256_VERIFY_PASSED;
+}
@@ -0,0 +1,148 @@
+/**
+ * @file profile.c
+ * @author Spartan State Security Team
+ * @brief Cycle counting unlock profiler
+ * @date 2023
+ *
+ * This source file is part of our designed system
+ * for MITRE's 2023 Embedded System CTF (eCTF).
+ *
+ * Each stage of an unlock is timed with the DWT cycle counter,
+ * which wraps after about 53 seconds at 80 MHz, well above the
+ * longest stage. Stages which fail are not recorded, so the
+ * constant polling for unlock requests does not drown the counters.
+ */
+
+#ifdef UNLOCK_PROFILE
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "inc/hw_types.h"
+
+#include "firmware.h"
+#include "profile.h"
+#include "uart.h"
+
+/*** Macro Definitions ***/
+// Debug and data watchpoint registers, not covered by TivaWare
+#define DEMCR 0xE000EDFC
+#define DEMCR_TRCENA 0x01000000
+#define DWT_CTRL 0xE0001000
+#define DWT_CTRL_CYCCNTENA 0x00000001
+#define DWT_CYCCNT 0xE0001004
+
+/*** Globals ***/
+// Counters for each stage
+PROFILE_STAT profile_stats[PROFILE_STAGES];
+
+// Cycle count when the current stage began
+uint32_t profile_start;
+
+// Duration of each stage the last time it completed
+uint32_t profile_last[PROFILE_STAGES];
+
+/**
+ * @brief Enables the cycle counter and clears the counters
+ */
+void profile_init(void) {
+  uint32_t i;
+
+  HWREG(DEMCR) |= DEMCR_TRCENA;
+  HWREG(DWT_CYCCNT) = 0;
+  HWREG(DWT_CTRL) |= DWT_CTRL_CYCCNTENA;
+
+  memset(profile_stats, 0, sizeof(profile_stats));
+  for (i = 0; i < PROFILE_STAGES; i++) {
+    profile_stats[i].min = UINT32_MAX;
+  }
+}
+
+/**
+ * @brief Marks the start of a stage
+ */
+void profile_begin(void) {
+  profile_start = HWREG(DWT_CYCCNT);
+}
+
+/**
+ * @brief Marks the end of a stage, recording its duration if it succeeded
+ *
+ * @param stage [in] The stage which ended
+ * @param ok    [in] Whether the stage succeeded
+ *
+ * @return ok, so that a stage can be timed in place
+ */
+bool profile_end(profile_stage_t stage, bool ok) {
+  uint32_t cycles = HWREG(DWT_CYCCNT) - profile_start;
+  PROFILE_STAT *stat = &profile_stats[stage];
+  uint32_t bucket;
+
+  if (!ok) return false;
+
+  profile_last[stage] = cycles;
+  stat->count++;
+  stat->total += cycles;
+  if (cycles < stat->min) stat->min = cycles;
+  if (cycles > stat->max) stat->max = cycles;
+
+  bucket = cycles ? (31 - __builtin_clz(cycles)) / 2 : 0;
+  stat->hist[bucket]++;
+  return true;
+}
+
+/**
+ * @brief Writes a 32 bit value to the host, least significant byte first
+ *
+ * @param value [in] The value to write
+ */
+static void profile_write32(uint32_t value) {
+  uint8_t bytes[4];
+
+  bytes[0] = (uint8_t)value;
+  bytes[1] = (uint8_t)(value >> 8);
+  bytes[2] = (uint8_t)(value >> 16);
+  bytes[3] = (uint8_t)(value >> 24);
+  uart_write(HOST_UART, bytes, sizeof(bytes));
+}
+
+/**
+ * @brief Dumps the counters to the host if it asked for them
+ *
+ * For PROFILE_CMD the dump is PROFILE_MAGIC, SPEED and PROFILE_STAGES,
+ * then for each stage its count, min, max, total (as two words, low
+ * first) and histogram. For PROFILE_LAST_CMD it is PROFILE_MAGIC, SPEED
+ * and PROFILE_STAGES, then the duration of each stage the last time
+ * it completed. Everything is sent as little-endian 32 bit words.
+ */
+void profile_poll(void) {
+  PROFILE_STAT *stat;
+  uint32_t i, b;
+  int32_t cmd;
+
+  if (!uart_avail(HOST_UART)) return;
+  cmd = uart_readb(HOST_UART);
+  if (cmd != PROFILE_CMD && cmd != PROFILE_LAST_CMD) return;
+
+  profile_write32(PROFILE_MAGIC);
+  profile_write32(SPEED);
+  profile_write32(PROFILE_STAGES);
+  for (i = 0; i < PROFILE_STAGES; i++) {
+    if (cmd == PROFILE_LAST_CMD) {
+      profile_write32(profile_last[i]);
+      continue;
+    }
+    stat = &profile_stats[i];
+    profile_write32(stat->count);
+    profile_write32(stat->count ? stat->min : 0);
+    profile_write32(stat->max);
+    profile_write32((uint32_t)stat->total);
+    profile_write32((uint32_t)(stat->total >> 32));
+    for (b = 0; b < PROFILE_BUCKETS; b++) {
+      profile_write32(stat->hist[b]);
+    }
+  }
+}
+
+#endif // UNLOCK_PROFILE
@@ -0,0 +1,83 @@
+/**
+ * @file store.c
+ * @author Spartan State Security Team
+ * @brief RAM mirror of the car's persistent storage
+ * @date 2023
+ *
+ * This source file is part of our designed system
+ * for MITRE's 2023 Embedded System CTF (eCTF).
+ *
+ * The EEPROM is initialized and read once at boot,
+ * so the unlock path is served entirely from RAM.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "driverlib/eeprom.h"
+#include "driverlib/sysctl.h"
+
+#include "store.h"
+#include "firmware.h"
+
+/*** Globals ***/
+CAR_STORE car_store;
+bool STORE_VALID = false;
+
+/**
+ * @brief Initialize the EEPROM and mirror its contents into RAM.
+ *
+ * @return true if the EEPROM contents are valid, false if an error occurs
+ */
+bool store_init(void) {
+  const uint32_t *pubkey = (const uint32_t *)&car_store.car_data.car_pubkey;
+
+  STORE_VALID = false;
+
+  // Ensure EEPROM peripheral is enabled
+  SysCtlPeripheralEnable(SYSCTL_PERIPH_EEPROM0);
+  if(EEPROMInit() != EEPROM_INIT_OK) return false;
+
+  // Mirror Car Data and Messages
+  EEPROMRead((uint32_t *)&car_store.car_data, 0, sizeof(CAR_DATA));
+  EEPROMRead((uint32_t *)car_store.feature_message, MESSAGE_EEPROM_LOC,
+             sizeof(car_store.feature_message) + sizeof(car_store.unlock_message));
+
+  // Check for EEPROM Error
+  if(pubkey[0] == pubkey[1] && pubkey[2] == pubkey[3]) return false;
+
+  STORE_VALID = true;
+  return true;
+}
+
+/**
+ * @brief Get the mirrored car data
+ *
+ * @return the car data, or NULL if the EEPROM contents are invalid
+ */
+const CAR_DATA *store_car_data(void) {
+  return STORE_VALID ? &car_store.car_data : NULL;
+}
+
+/**
+ * @brief Get the mirrored unlock message
+ *
+ * @return the UNLOCK_EEPROM_SIZE byte message, or NULL if the EEPROM contents are invalid
+ */
+const uint8_t *store_unlock_message(void) {
+  return STORE_VALID ? car_store.unlock_message : NULL;
+}
+
+/**
+ * @brief Get the mirrored message for a feature
+ *
+ * @param feature_idx [in] The feature index, starting at 0
+ *
+ * @return the FEATURE_SIZE byte message, or NULL if the index or EEPROM contents are invalid
+ */
+const uint8_t *store_feature_message(uint32_t feature_idx) {
+  if(!STORE_VALID || feature_idx >= NUM_FEATURES) return NULL;
+  return car_store.feature_message[NUM_FEATURES - 1 - feature_idx];
+}
@@ -6,6 +6,14 @@
  *
  * This source file is part of our designed system
  * for MITRE's 2023 Embedded System CTF (eCTF).
+ *
+ * Each UART is serviced by an interrupt which moves bytes between the
+ * hardware FIFOs and a pair of RAM ring buffers, so the CPU never
+ * stalls on the line while sending or receiving.
+ *
+ * Whole structures can instead be handed to the uDMA controller, which
+ * moves them without the CPU and signals completion on the UART's
+ * interrupt. The ring is bypassed for the duration of such a transfer.
  */
 
 #include <stdbool.h>
@@ -14,9 +22,11 @@
 
 #include "driverlib/fpu.h"
 #include "driverlib/gpio.h"
+#include "driverlib/interrupt.h"
 #include "driverlib/pin_map.h"
 #include "driverlib/sysctl.h"
 #include "driverlib/uart.h"
+#include "driverlib/udma.h"
 #include "inc/hw_memmap.h"
 #include "inc/hw_types.h"
 #include "inc/hw_uart.h"
@@ -24,6 +34,178 @@
 #include "uart.h"
 #include "firmware.h"
 
+/*** Structure definitions ***/
+// Defines the receive and transmit ring buffers of one UART
+// The interrupt only advances rx_head and tx_tail, the main loop only rx_tail and tx_head
+typedef struct {
+  uint8_t rx[UART_RX_RING_SIZE];
+  uint8_t tx[UART_TX_RING_SIZE];
+  volatile uint32_t rx_head;
+  volatile uint32_t rx_tail;
+  volatile uint32_t tx_head;
+  volatile uint32_t tx_tail;
+  volatile uint32_t overruns;
+} UART_RING;
+
+// Defines the state of a uDMA transfer in one direction
+typedef struct {
+  volatile bool active;
+  uart_dma_done_t done;
+} UART_DMA;
+
+/*** Globals ***/
+// Ring buffers for UART 0 (host) and UART 1 (board link)
+UART_RING uart_rings[2];
+
+// uDMA transfers of UART 0 and UART 1, receive then transmit
+UART_DMA uart_dma_rx[2];
+UART_DMA uart_dma_tx[2];
+
+// uDMA channels of UART 0 and UART 1
+static const uint32_t UART_DMA_RX_CHANNEL[2] = { UDMA_CHANNEL_UART0RX, UDMA_CHANNEL_UART1RX };
+static const uint32_t UART_DMA_TX_CHANNEL[2] = { UDMA_CHANNEL_UART0TX, UDMA_CHANNEL_UART1TX };
+
+// uDMA channel control table, which the controller requires on a 1 KB boundary
+static tDMAControlTable uart_dma_table[64] __attribute__((aligned(1024)));
+static bool uart_dma_ready = false;
+
+/**
+ * @brief Find the ring buffers of a UART interface.
+ *
+ * @param uart is the base address of the UART port.
+ * @return the ring buffers of the port.
+ */
+static UART_RING *uart_ring(uint32_t uart) {
+  return &uart_rings[uart == UART0_BASE ? 0 : 1];
+}
+
+/**
+ * @brief Find the index of a UART interface in the per-port tables.
+ *
+ * @param uart is the base address of the UART port.
+ * @return 0 for UART 0, 1 for UART 1.
+ */
+static uint32_t uart_index(uint32_t uart) {
+  return uart == UART0_BASE ? 0 : 1;
+}
+
+/**
+ * @brief Finish a uDMA transfer, handing the UART back to its ring buffers.
+ *
+ * @param uart is the base address of the UART port.
+ * @param dma is the transfer being finished.
+ * @param rx is true for the receive direction.
+ */
+static void uart_dma_finish(uint32_t uart, UART_DMA *dma, bool rx) {
+  uint32_t idx = uart_index(uart);
+
+  if (rx) {
+    uDMAChannelDisable(UART_DMA_RX_CHANNEL[idx]);
+    UARTDMADisable(uart, UART_DMA_RX);
+    UARTIntEnable(uart, UART_INT_RX | UART_INT_RT);
+  } else {
+    uDMAChannelDisable(UART_DMA_TX_CHANNEL[idx]);
+    UARTDMADisable(uart, UART_DMA_TX);
+  }
+  dma->active = false;
+}
+
+/**
+ * @brief Finish any uDMA transfer on a UART interface whose channel has stopped,
+ * calling its completion callback.
+ *
+ * @param uart is the base address of the UART port.
+ */
+static void uart_dma_poll(uint32_t uart) {
+  uint32_t idx = uart_index(uart);
+  UART_DMA *dma;
+
+  dma = &uart_dma_rx[idx];
+  if (dma->active &&
+      uDMAChannelModeGet(UART_DMA_RX_CHANNEL[idx] | UDMA_PRI_SELECT) == UDMA_MODE_STOP) {
+    uart_dma_finish(uart, dma, true);
+    if (dma->done) dma->done(uart);
+  }
+
+  dma = &uart_dma_tx[idx];
+  if (dma->active &&
+      uDMAChannelModeGet(UART_DMA_TX_CHANNEL[idx] | UDMA_PRI_SELECT) == UDMA_MODE_STOP) {
+    uart_dma_finish(uart, dma, false);
+    if (dma->done) dma->done(uart);
+  }
+}
+
+/**
+ * @brief Move bytes from the transmit ring into the hardware FIFO.
+ *
+ * Must run with the transmit interrupt disabled or from the interrupt itself.
+ * Leaves the transmit interrupt enabled while bytes remain in the ring.
+ *
+ * @param uart is the base address of the UART port.
+ * @param ring is the ring buffers of the port.
+ */
+static void uart_tx_pump(uint32_t uart, UART_RING *ring) {
+  while (ring->tx_tail != ring->tx_head && UARTSpaceAvail(uart)) {
+    UARTCharPutNonBlocking(uart, ring->tx[ring->tx_tail]);
+    ring->tx_tail = (ring->tx_tail + 1) & (UART_TX_RING_SIZE - 1);
+  }
+
+  if (ring->tx_tail != ring->tx_head) {
+    UARTIntEnable(uart, UART_INT_TX);
+  } else {
+    UARTIntDisable(uart, UART_INT_TX);
+  }
+}
+
+/**
+ * @brief Service a UART interrupt, filling the receive ring
+ * and draining the transmit ring.
+ *
+ * @param uart is the base address of the UART port.
+ */
+static void uart_isr(uint32_t uart) {
+  UART_RING *ring = uart_ring(uart);
+  uint32_t status = UARTIntStatus(uart, true);
+  uint32_t next;
+  int32_t c;
+
+  UARTIntClear(uart, status);
+
+  // uDMA completion raises this interrupt without a status bit of its own
+  uart_dma_poll(uart);
+
+  // Receive everything waiting in the FIFO, unless the uDMA controller owns it
+  while (!uart_dma_rx[uart_index(uart)].active && UARTCharsAvail(uart)) {
+    c = UARTCharGetNonBlocking(uart);
+    next = (ring->rx_head + 1) & (UART_RX_RING_SIZE - 1);
+    if (next == ring->rx_tail) {
+      ring->overruns++;
+    } else {
+      ring->rx[ring->rx_head] = (uint8_t)c;
+      ring->rx_head = next;
+    }
+  }
+  if (status & UART_INT_OE) {
+    ring->overruns++;
+  }
+
+  // Refill the transmit FIFO
+  if (status & UART_INT_TX) {
+    uart_tx_pump(uart, ring);
+  }
+
+}
+
+/**
+ * @brief Interrupt handler for UART 0.
+ */
+static void uart0_isr(void) { uart_isr(UART0_BASE); }
+
+/**
+ * @brief Interrupt handler for UART 1.
+ */
+static void uart1_isr(void) { uart_isr(UART1_BASE); }
+
 /**
  * @brief Initialize the UART interfaces.
  *
@@ -42,6 +224,33 @@ void uart_init(void) {
   UARTConfigSetExpClk(
       UART0_BASE, SPEED, BAUD,
       (UART_CONFIG_WLEN_8 | UART_CONFIG_STOP_ONE | UART_CONFIG_PAR_NONE));
+
+  uart_start(UART0_BASE);
+}
+
+/**
+ * @brief Attach the ring buffers to a configured UART interface
+ * and enable its interrupt.
+ *
+ * The receive interrupt fires at half full, leaving 8 bytes of
+ * headroom, and the receive timeout catches the tail of a message.
+ * The transmit interrupt fires once the FIFO drains to a quarter full.
+ *
+ * @param uart is the base address of the UART port.
+ */
+void uart_start(uint32_t uart) {
+  UART_RING *ring = uart_ring(uart);
+
+  UARTIntDisable(uart, 0xFFFFFFFF);
+  memset(ring, 0, sizeof(UART_RING));
+
+  UARTFIFOEnable(uart);
+  UARTFIFOLevelSet(uart, UART_FIFO_TX2_8, UART_FIFO_RX4_8);
+  UARTTxIntModeSet(uart, UART_TXINT_MODE_FIFO);
+
+  UARTIntRegister(uart, uart == UART0_BASE ? uart0_isr : uart1_isr);
+  UARTIntEnable(uart, UART_INT_RX | UART_INT_RT | UART_INT_OE);
+  IntMasterEnable();
 }
 
 /**
@@ -51,15 +260,34 @@ void uart_init(void) {
  * @return true if there is data available.
  * @return false if there is no data available.
  */
-bool uart_avail(uint32_t uart) { return UARTCharsAvail(uart); }
+bool uart_avail(uint32_t uart) {
+  UART_RING *ring = uart_ring(uart);
+  return ring->rx_head != ring->rx_tail;
+}
+
+/**
+ * @brief Count the bytes lost because a UART interface received faster than it was read.
+ *
+ * @param uart is the base address of the UART port.
+ * @return the number of bytes dropped since the port was started.
+ */
+uint32_t uart_overruns(uint32_t uart) { return uart_ring(uart)->overruns; }
 
 /**
- * @brief Read a byte from a UART interface.
+ * @brief Read a byte from a UART interface, waiting until one arrives.
  *
  * @param uart is the base address of the UART port to read from.
  * @return the character read from the interface.
  */
-int32_t uart_readb(uint32_t uart) { return UARTCharGet(uart); }
+int32_t uart_readb(uint32_t uart) {
+  UART_RING *ring = uart_ring(uart);
+  uint8_t c;
+
+  while (ring->rx_head == ring->rx_tail);
+  c = ring->rx[ring->rx_tail];
+  ring->rx_tail = (ring->rx_tail + 1) & (UART_RX_RING_SIZE - 1);
+  return c;
+}
 
 /**
  * @brief Read a sequence of bytes from a UART interface.
@@ -79,29 +307,283 @@ uint32_t uart_read(uint32_t uart, uint8_t *buf, uint32_t n) {
 }
 
 /**
- * @brief Write a byte to a UART interface.
+ * @brief Look at the next received byte without consuming it.
+ *
+ * @param uart is the base address of the UART port to read from.
+ * @param data is where to write the next byte.
+ * @return true if a byte was available, false otherwise.
+ */
+bool uart_peek(uint32_t uart, uint8_t *data) {
+  UART_RING *ring = uart_ring(uart);
+
+  if (ring->rx_head == ring->rx_tail) {
+    return false;
+  }
+  *data = ring->rx[ring->rx_tail];
+  return true;
+}
+
+/**
+ * @brief Read whatever bytes have already arrived, without waiting.
+ *
+ * @param uart is the base address of the UART port to read from.
+ * @param buf is a pointer to the destination for the received data.
+ * @param n is the most bytes to read.
+ * @return the number of bytes read from the UART interface.
+ */
+uint32_t uart_read_nb(uint32_t uart, uint8_t *buf, uint32_t n) {
+  UART_RING *ring = uart_ring(uart);
+  uint32_t read;
+
+  for (read = 0; read < n && ring->rx_head != ring->rx_tail; read++) {
+    buf[read] = ring->rx[ring->rx_tail];
+    ring->rx_tail = (ring->rx_tail + 1) & (UART_RX_RING_SIZE - 1);
+  }
+  return read;
+}
+
+/**
+ * @brief Write a byte to a UART interface, waiting for ring space if needed.
  *
  * @param uart is the base address of the UART port to write to.
  * @param data is the byte value to write.
  */
-void uart_writeb(uint32_t uart, uint8_t data) { UARTCharPut(uart, data); }
+void uart_writeb(uint32_t uart, uint8_t data) {
+  while (uart_write_nb(uart, &data, 1) == 0);
+}
 
 /**
- * @brief Write a sequence of bytes to a UART interface.
- * Delays a short time so as not to fill any UART FIFO.
+ * @brief Write a sequence of bytes to a UART interface,
+ * waiting for ring space if needed.
  *
  * @param uart is the base address of the UART port to write to.
  * @param buf is a pointer to the data to send.
  * @param len is the number of bytes to send.
  * @return the number of bytes written.
  */
-uint32_t uart_write(uint32_t uart, uint8_t *buf, uint32_t len) {
+uint32_t uart_write(uint32_t uart, const uint8_t *buf, uint32_t len) {
+  uint32_t i = 0;
+
+  while (i < len) {
+    i += uart_write_nb(uart, &buf[i], len - i);
+  }
+  return i;
+}
+
+/**
+ * @brief Queue as many bytes as fit in the transmit ring, without waiting.
+ *
+ * @param uart is the base address of the UART port to write to.
+ * @param buf is a pointer to the data to send.
+ * @param len is the most bytes to send.
+ * @return the number of bytes queued.
+ */
+uint32_t uart_write_nb(uint32_t uart, const uint8_t *buf, uint32_t len) {
+  UART_RING *ring = uart_ring(uart);
+  uint32_t next;
   uint32_t i;
 
-  for (i = 0; i < len; i++) {
-    SysCtlDelay(SPEED/BAUD);
-    uart_writeb(uart, buf[i]);
+  // The line belongs to the uDMA controller until its transfer finishes
+  if (uart_dma_tx[uart_index(uart)].active) {
+    return 0;
   }
 
+  // Hold off the interrupt while the ring and FIFO are topped up
+  UARTIntDisable(uart, UART_INT_TX);
+  for (i = 0; i < len; i++) {
+    next = (ring->tx_head + 1) & (UART_TX_RING_SIZE - 1);
+    if (next == ring->tx_tail) {
+      break;
+    }
+    ring->tx[ring->tx_head] = buf[i];
+    ring->tx_head = next;
+  }
+  uart_tx_pump(uart, ring);
   return i;
 }
+
+/**
+ * @brief Wait until every queued byte has left the UART interface.
+ *
+ * @param uart is the base address of the UART port.
+ */
+void uart_flush(uint32_t uart) {
+  UART_RING *ring = uart_ring(uart);
+
+  while (uart_dma_tx[uart_index(uart)].active ||
+         ring->tx_head != ring->tx_tail || UARTBusy(uart));
+}
+
+/**
+ * @brief Change the baud rate of a UART interface, keeping 8-N-1 framing.
+ *
+ * Waits for queued bytes to go out at the old rate first. Anything
+ * received but not yet read is discarded, since it may have been
+ * framed at the wrong rate.
+ *
+ * @param uart is the base address of the UART port.
+ * @param baud is the new baud rate.
+ */
+void uart_set_baud(uint32_t uart, uint32_t baud) {
+  UART_RING *ring = uart_ring(uart);
+
+  uart_flush(uart);
+
+  UARTIntDisable(uart, UART_INT_RX | UART_INT_RT);
+  UARTConfigSetExpClk(
+      uart, SPEED, baud,
+      (UART_CONFIG_WLEN_8 | UART_CONFIG_STOP_ONE | UART_CONFIG_PAR_NONE));
+  while (UARTCharsAvail(uart)) {
+    UARTCharGetNonBlocking(uart);
+  }
+  ring->rx_tail = ring->rx_head;
+  UARTIntEnable(uart, UART_INT_RX | UART_INT_RT);
+}
+
+/**
+ * @brief Enable the uDMA controller for UART transfers.
+ *
+ * Must be called before any uDMA transfer is started.
+ */
+void uart_dma_init(void) {
+  if (uart_dma_ready) {
+    return;
+  }
+
+  SysCtlPeripheralEnable(SYSCTL_PERIPH_UDMA);
+  while (!SysCtlPeripheralReady(SYSCTL_PERIPH_UDMA));
+
+  uDMAEnable();
+  uDMAControlBaseSet(uart_dma_table);
+
+  uDMAChannelAssign(UDMA_CH8_UART0RX);
+  uDMAChannelAssign(UDMA_CH9_UART0TX);
+  uDMAChannelAssign(UDMA_CH22_UART1RX);
+  uDMAChannelAssign(UDMA_CH23_UART1TX);
+
+  uart_dma_ready = true;
+}
+
+/**
+ * @brief Start receiving a block of bytes on a UART interface by uDMA.
+ *
+ * Bytes already waiting in the receive ring are copied first,
+ * and the controller collects the rest. The buffer must stay valid
+ * until the transfer completes or is aborted.
+ *
+ * @param uart is the base address of the UART port to read from.
+ * @param buf is a pointer to the destination for the received data.
+ * @param len is the number of bytes to read, at most 1024.
+ * @param done is called from the interrupt once every byte has arrived, or NULL.
+ * @return true if the transfer was started, false if the port is busy.
+ */
+bool uart_dma_read(uint32_t uart, uint8_t *buf, uint32_t len, uart_dma_done_t done) {
+  uint32_t idx = uart_index(uart);
+  uint32_t channel = UART_DMA_RX_CHANNEL[idx];
+  UART_DMA *dma = &uart_dma_rx[idx];
+  uint32_t got;
+
+  if (!uart_dma_ready || dma->active || len == 0 || len > 1024) {
+    return false;
+  }
+
+  // Hold off the interrupt until the channel is running, so it neither
+  // moves bytes into the ring meanwhile nor finds the transfer active
+  // with the channel still stopped
+  IntMasterDisable();
+
+  // Stop the ring filling, then take what it already holds
+  UARTIntDisable(uart, UART_INT_RX | UART_INT_RT);
+  got = uart_read_nb(uart, buf, len);
+  if (got == len) {
+    UARTIntEnable(uart, UART_INT_RX | UART_INT_RT);
+    IntMasterEnable();
+    if (done) done(uart);
+    return true;
+  }
+
+  uDMAChannelAttributeDisable(channel, UDMA_ATTR_ALTSELECT | UDMA_ATTR_USEBURST |
+                                       UDMA_ATTR_HIGH_PRIORITY | UDMA_ATTR_REQMASK);
+  uDMAChannelControlSet(channel | UDMA_PRI_SELECT,
+                        UDMA_SIZE_8 | UDMA_SRC_INC_NONE | UDMA_DST_INC_8 | UDMA_ARB_4);
+  uDMAChannelTransferSet(channel | UDMA_PRI_SELECT, UDMA_MODE_BASIC,
+                         (void *)(uart + UART_O_DR), &buf[got], len - got);
+  uDMAChannelEnable(channel);
+  UARTDMAEnable(uart, UART_DMA_RX);
+  dma->done = done;
+  dma->active = true;
+  IntMasterEnable();
+  return true;
+}
+
+/**
+ * @brief Start sending a block of bytes on a UART interface by uDMA.
+ *
+ * Bytes already queued in the transmit ring go out first. The buffer
+ * must stay valid until the transfer completes or is aborted.
+ *
+ * @param uart is the base address of the UART port to write to.
+ * @param buf is a pointer to the data to send.
+ * @param len is the number of bytes to send, at most 1024.
+ * @param done is called from the interrupt once every byte is in the FIFO, or NULL.
+ * @return true if the transfer was started, false if the port is busy.
+ */
+bool uart_dma_write(uint32_t uart, const uint8_t *buf, uint32_t len, uart_dma_done_t done) {
+  uint32_t idx = uart_index(uart);
+  uint32_t channel = UART_DMA_TX_CHANNEL[idx];
+  UART_DMA *dma = &uart_dma_tx[idx];
+  UART_RING *ring = uart_ring(uart);
+
+  if (!uart_dma_ready || dma->active || len == 0 || len > 1024) {
+    return false;
+  }
+
+  // Keep byte order with anything already queued
+  while (ring->tx_head != ring->tx_tail);
+
+  // Hold off the interrupt until the channel is running, as for reception
+  IntMasterDisable();
+  uDMAChannelAttributeDisable(channel, UDMA_ATTR_ALTSELECT | UDMA_ATTR_USEBURST |
+                                       UDMA_ATTR_HIGH_PRIORITY | UDMA_ATTR_REQMASK);
+  uDMAChannelControlSet(channel | UDMA_PRI_SELECT,
+                        UDMA_SIZE_8 | UDMA_SRC_INC_8 | UDMA_DST_INC_NONE | UDMA_ARB_4);
+  uDMAChannelTransferSet(channel | UDMA_PRI_SELECT, UDMA_MODE_BASIC,
+                         (void *)buf, (void *)(uart + UART_O_DR), len);
+  uDMAChannelEnable(channel);
+  UARTDMAEnable(uart, UART_DMA_TX);
+  dma->done = done;
+  dma->active = true;
+  IntMasterEnable();
+  return true;
+}
+
+/**
+ * @brief Check whether a uDMA transfer is still running on a UART interface.
+ *
+ * @param uart is the base address of the UART port.
+ * @return true if a receive or transmit transfer is active.
+ */
+bool uart_dma_busy(uint32_t uart) {
+  uint32_t idx = uart_index(uart);
+  return uart_dma_rx[idx].active || uart_dma_tx[idx].active;
+}
+
+/**
+ * @brief Stop any uDMA transfer on a UART interface without calling its callback.
+ *
+ * Received bytes the controller had not yet collected are left for the ring.
+ *
+ * @param uart is the base address of the UART port.
+ */
+void uart_dma_abort(uint32_t uart) {
+  uint32_t idx = uart_index(uart);
+
+  IntMasterDisable();
+  if (uart_dma_rx[idx].active) {
+    uart_dma_finish(uart, &uart_dma_rx[idx], true);
+  }
+  if (uart_dma_tx[idx].active) {
+    uart_dma_finish(uart, &uart_dma_tx[idx], false);
+  }
+  IntMasterEnable();
+}
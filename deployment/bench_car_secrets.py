@@ -0,0 +1,104 @@
+# @file bench_car_secrets.py
+# @author Spartan State Security Team
+# @brief Compares the car secrets store against the former car_secrets.json
+# @date 2023
+#
+#  This source file is part of our designed system
+#  for MITRE's 2023 Embedded System CTF (eCTF).
+#
+#  For each deployment size, times one car being added and one car being
+#  looked up, the way the build scripts and package_tool do it: the JSON
+#  file is loaded and rewritten whole, the store touches a single row.
+
+import argparse
+import json
+import sqlite3
+import tempfile
+import time
+from pathlib import Path
+
+from gen_host_secrets import SECRETS_STORE, SECRETS_SCHEMA
+
+# Sizes of real PEM encoded P-256 keys
+PRIVKEY_PEM_SIZE = 241
+PUBKEY_PEM_SIZE = 178
+
+# @brief Make stand-in keys for a car, sized like the real ones
+def fake_keys(car_id):
+    return f"{car_id:x}".rjust(PRIVKEY_PEM_SIZE, "p"), f"{car_id:x}".rjust(PUBKEY_PEM_SIZE, "q")
+
+# @brief Time a function, returning the mean seconds per call
+def mean_time(fn, reps):
+    start = time.perf_counter()
+    for i in range(reps):
+      fn(i)
+    return (time.perf_counter() - start) / reps
+
+# @brief Time adding and looking up a car in a car_secrets.json of n cars
+def bench_json(directory, n, reps):
+    path = directory / "car_secrets.json"
+    secrets = {}
+    for car_id in range(n):
+      privkey_pem, pubkey_pem = fake_keys(car_id)
+      secrets[str(car_id)] = { "privkey_pem": privkey_pem, "pubkey_pem": pubkey_pem }
+    with open(path, "w") as fp:
+      json.dump(secrets, fp, indent=4)
+
+    def insert(i):
+      with open(path, "r") as fp:
+        secrets = json.load(fp)
+      privkey_pem, pubkey_pem = fake_keys(n + i)
+      secrets[str(n + i)] = { "privkey_pem": privkey_pem, "pubkey_pem": pubkey_pem }
+      with open(path, "w") as fp:
+        json.dump(secrets, fp, indent=4)
+
+    def lookup(i):
+      with open(path, "r") as fp:
+        secrets = json.load(fp)
+      return secrets[str(i * 7919 % n)]["pubkey_pem"]
+
+    return mean_time(insert, reps), mean_time(lookup, reps)
+
+# @brief Time adding and looking up a car in a store of n cars
+def bench_store(directory, n, reps):
+    path = directory / SECRETS_STORE
+    db = sqlite3.connect(path)
+    db.execute("PRAGMA journal_mode=WAL")
+    db.execute(SECRETS_SCHEMA)
+    with db:
+      db.executemany("INSERT INTO cars VALUES (?, ?, ?)", ((car_id, *fake_keys(car_id)) for car_id in range(n)))
+    db.close()
+
+    # Each call opens its own connection, as every build script does
+    def insert(i):
+      db = sqlite3.connect(path, timeout=60)
+      db.execute(SECRETS_SCHEMA)
+      with db:
+        db.execute("INSERT OR REPLACE INTO cars VALUES (?, ?, ?)", (n + i, *fake_keys(n + i)))
+      db.close()
+
+    def lookup(i):
+      db = sqlite3.connect(path, timeout=60)
+      row = db.execute("SELECT pubkey_pem FROM cars WHERE car_id = ?", (i * 7919 % n,)).fetchone()
+      db.close()
+      return row[0]
+
+    return mean_time(insert, reps), mean_time(lookup, reps)
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--sizes", type=int, nargs="+", default=[10000, 100000])
+    parser.add_argument("--reps", type=int, default=20, help="Operations timed at each size")
+    args = parser.parse_args()
+
+    print(f"{'cars':>8} {'store':>6} {'insert ms':>10} {'lookup ms':>10} {'fleet build s':>14}")
+    for n in args.sizes:
+      for name, bench in (("json", bench_json), ("sqlite", bench_store)):
+        with tempfile.TemporaryDirectory() as directory:
+          insert, lookup = bench(Path(directory), n, args.reps)
+        # Building the whole fleet adds n cars, at half the final cost each on average for json
+        fleet = insert * n / 2 if name == "json" else insert * n
+        print(f"{n:>8} {name:>6} {insert * 1000:>10.3f} {lookup * 1000:>10.3f} {fleet:>14.1f}")
+
+if __name__ == "__main__":
+    main()
@@ -7,9 +7,14 @@
 #  for MITRE's 2023 Embedded System CTF (eCTF).
 
 import argparse
+import sqlite3
 from pathlib import Path
 import Crypto.PublicKey.ECC as ecc
 
+# Car secrets store, filled in by car/gen_secret.py as each car is built
+SECRETS_STORE = "car_secrets.db"
+SECRETS_SCHEMA = "CREATE TABLE IF NOT EXISTS cars (car_id INTEGER PRIMARY KEY, privkey_pem TEXT NOT NULL, pubkey_pem TEXT NOT NULL)"
+
 def main():
     parser = argparse.ArgumentParser()
     parser.add_argument("--secrets-dir", type=Path, required=True)
@@ -31,5 +36,11 @@ def main():
     with open(pubkey_path, "w") as fp:
       fp.write(pubkey_pem)
 
+    # Create the car secrets store
+    db = sqlite3.connect(args.secrets_dir / SECRETS_STORE)
+    db.execute("PRAGMA journal_mode=WAL")
+    db.execute(SECRETS_SCHEMA)
+    db.close()
+
 if __name__ == "__main__":
     main()
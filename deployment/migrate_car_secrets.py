@@ -0,0 +1,39 @@
+# @file migrate_car_secrets.py
+# @author Spartan State Security Team
+# @brief Moves the cars of a car_secrets.json deployment into the car secrets store
+# @date 2023
+#
+#  This source file is part of our designed system
+#  for MITRE's 2023 Embedded System CTF (eCTF).
+
+import argparse
+import json
+import sqlite3
+from pathlib import Path
+
+from gen_host_secrets import SECRETS_STORE, SECRETS_SCHEMA
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--secrets-dir", type=Path, required=True)
+    args = parser.parse_args()
+
+    json_path = args.secrets_dir / "car_secrets.json"
+    with open(json_path, "r") as fp:
+      secrets = json.load(fp)
+
+    # One transaction, so the store either gains every car or none
+    db = sqlite3.connect(args.secrets_dir / SECRETS_STORE, timeout=60)
+    db.execute("PRAGMA journal_mode=WAL")
+    db.execute(SECRETS_SCHEMA)
+    with db:
+      db.executemany(
+        "INSERT OR REPLACE INTO cars VALUES (?, ?, ?)",
+        ((int(car_id), car["privkey_pem"], car["pubkey_pem"]) for car_id, car in secrets.items()),
+      )
+    db.close()
+
+    print(f"Migrated {len(secrets)} cars from {json_path}, which can now be removed")
+
+if __name__ == "__main__":
+    main()
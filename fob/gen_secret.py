@@ -8,7 +8,7 @@
 #  This source file is part of our designed system
 #  for MITRE's 2023 Embedded System CTF (eCTF).
 
-import json
+import sqlite3
 import argparse
 from pathlib import Path
 import struct
@@ -18,77 +18,101 @@ from Crypto.Random import get_random_bytes
 
 ECC_PRIVSIZE = 32
 ECC_SIGNATURE_SIZE = 64
+
+# A package is a signature and its recovery byte, must match firmware.h
+PACKAGE_SIZE = ECC_SIGNATURE_SIZE + 1
+
+# Features Information, must match firmware.h
+NUM_FEATURES = 3
+
 YES_PAIRED = 0x20202020
 NO_UPAIRED = 0xFFFFFFFF
 
-def main():
-    parser = argparse.ArgumentParser()
-    parser.add_argument("--car-id", type=int)
-    parser.add_argument("--pair-pin", type=str)
-    parser.add_argument("--secrets-dir", type=Path)
-    parser.add_argument("--header-file", type=Path)
-    parser.add_argument("--paired", action="store_true")
-    args = parser.parse_args()
+# Car secrets store, must match deployment/gen_host_secrets.py
+SECRETS_STORE = "car_secrets.db"
 
+# @brief Generate a fob's EEPROM and the values of its .secrets section
+def gen_fob(car_id, pair_pin, secrets_dir, paired):
     # Set Known Values of Fob Data for EEPROM
-    paired = YES_PAIRED if args.paired else NO_UPAIRED
-    pin = int(args.pair_pin,16) if args.paired else NO_UPAIRED
-    package_data = b"\xFF" * ECC_SIGNATURE_SIZE * 3
-
-    # Open the secret file if it exists
-    secret_file = args.secrets_dir / "car_secrets.json"
-    if secret_file.exists():
-        with open(secret_file, "r") as fp:
-            secrets = json.load(fp)
-    elif args.paired:
-            raise Exception("Secrets file not found in directory, should already exist before building paired fob")
-    
-    # Load car private key
-    if args.paired:
-        car_privkey_pem = secrets[str(args.car_id)]["privkey_pem"]
-        car_privkey = ecc.import_key(car_privkey_pem)
+    paired_word = YES_PAIRED if paired else NO_UPAIRED
+    pin = int(pair_pin,16) if paired else NO_UPAIRED
+    package_data = b"\xFF" * PACKAGE_SIZE * NUM_FEATURES
+
+    # Load car private key, which the car build saved in the secrets store
+    if paired:
+        secret_file = secrets_dir / SECRETS_STORE
+        if not secret_file.exists():
+            raise Exception("Secrets store not found in directory, should already exist before building paired fob")
+        db = sqlite3.connect(secret_file, timeout=60)
+        row = db.execute("SELECT privkey_pem FROM cars WHERE car_id = ?", (car_id,)).fetchone()
+        db.close()
+        if row is None:
+            raise Exception("Car not found in secrets store, should be built before its paired fob")
+        car_privkey = ecc.import_key(row[0])
         car_privkey_bytes = long_to_bytes(car_privkey.d, ECC_PRIVSIZE)
     else:
         car_privkey_bytes = b"\xFF" * ECC_PRIVSIZE
     
     # Pack EEPROM Fob Data
     eeprom_data = struct.pack(
-        f"<II{ECC_PRIVSIZE}s{ECC_SIGNATURE_SIZE*3}s",
-        paired,
+        f"<II{ECC_PRIVSIZE}s{PACKAGE_SIZE*NUM_FEATURES}s",
+        paired_word,
         pin,
         car_privkey_bytes,
         package_data
     )
 
+    # FOB_DATA is padded to a whole word
+    eeprom_data += b"\xFF" * (-len(eeprom_data) % 4)
+
     # Write EEPROM File
-    eeprom_path = args.secrets_dir / "temp_eeprom"
+    eeprom_path = secrets_dir / "temp_eeprom"
     with open(eeprom_path, "wb") as fp:
         fp.write(eeprom_data)
 
     # Generate Entropy
-    entropy = get_random_bytes(0x400)
+    return get_random_bytes(0x400)
 
-    # Write Header File
-    if args.paired:
-        # OG_PFOB
-        with open(args.header_file, "w") as fp:
-            fp.write("#ifndef __FOB_SECRETS__\n")
-            fp.write("#define __FOB_SECRETS__\n\n")
-            fp.write('#include "firmware.h"\n')
-            fp.write("#define OG_PFOB 1\n")
-            fp.write("#define OG_UFOB 0\n")
-            fp.write(f"const uint8_t S_ENTROPY[sizeof(ENTROPY)] = {{ {','.join(hex(b) for b in entropy)} }};\n")
-            fp.write("#endif\n")
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--car-id", type=int)
+    parser.add_argument("--pair-pin", type=str)
+    parser.add_argument("--secrets-dir", type=Path)
+    parser.add_argument("--header-file", type=Path, required=True)
+    parser.add_argument("--blob-file", type=Path, help="Also write the raw .secrets section, for patch_secrets.py")
+    parser.add_argument("--paired", action="store_true")
+    parser.add_argument("--template", action="store_true", help="Write placeholder secrets for a fleet template build")
+    args = parser.parse_args()
+
+    if args.template:
+        # Placeholder secrets with the same layout, patched over for each fob
+        entropy = bytes(0x400)
     else:
-        # OG_UFOB
-        with open(args.header_file, "w") as fp:
-            fp.write("#ifndef __FOB_SECRETS__\n")
-            fp.write("#define __FOB_SECRETS__\n\n")
-            fp.write('#include "firmware.h"\n')
-            fp.write("#define OG_PFOB 0\n")
-            fp.write("#define OG_UFOB 1\n")
-            fp.write(f"const uint8_t S_ENTROPY[sizeof(ENTROPY)] = {{ {','.join(hex(b) for b in entropy)} }};\n")
-            fp.write("#endif\n")
+        if args.secrets_dir is None:
+            parser.error("--secrets-dir is required unless --template is given")
+        entropy = gen_fob(args.car_id, args.pair_pin, args.secrets_dir, args.paired)
+
+    # OG_PFOB or OG_UFOB
+    og_pfob = 1 if args.paired and not args.template else 0
+
+    # Pack the section exactly as the SECRETS struct in firmware.h lays it out
+    if args.blob_file:
+        with open(args.blob_file, "wb") as fp:
+            fp.write(struct.pack("<I", og_pfob) + entropy)
+
+    # Write Header File
+    with open(args.header_file, "w") as fp:
+        fp.write("#ifndef __FOB_SECRETS__\n")
+        fp.write("#define __FOB_SECRETS__\n\n")
+        fp.write('#include "firmware.h"\n')
+        fp.write(f"#if NUM_FEATURES != {NUM_FEATURES}\n")
+        fp.write('#error "gen_secret.py NUM_FEATURES does not match firmware.h"\n')
+        fp.write("#endif\n")
+        fp.write('const SECRETS DEVICE_SECRETS __attribute__((section(".secrets"))) = {\n')
+        fp.write(f".og_pfob = {og_pfob},\n")
+        fp.write(f".entropy = {{{{ {','.join(hex(b) for b in entropy)} }}}} }};\n")
+        fp.write("#endif\n")
 
 
 if __name__ == "__main__":
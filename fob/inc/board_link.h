@@ -11,6 +11,7 @@
 #ifndef BOARD_LINK_H
 #define BOARD_LINK_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "inc/hw_memmap.h"
@@ -23,12 +24,27 @@
 #define PFOB_UART BOARD_UART
 #define UFOB_UART BOARD_UART
 
+// Number of rates in LINK_BAUDS, the first of which is BAUD
+#define LINK_BAUD_COUNT 6
+
+// Board link timeouts, in milliseconds
+#define LINK_OFFER_TIMEOUT 500
+#define LINK_CHECK_TIMEOUT 20
+#define LINK_CHALLENGE_TIMEOUT 1000
+#define LINK_RETRY_TIMEOUT 2000 // longer than the car waits for a response
+
 // Setup Functions
 void setup_board_link(void);
 
 // Communications Functions
 void request_unlock(void);
-void get_challenge(CHALLENGE *challenge);
+bool accept_baud(void);
+bool accept_retry(void);
+bool get_challenge(CHALLENGE *challenge);
+void send_features(RESPONSE *response);
 void finalize_unlock(RESPONSE *response);
+void restore_baud(void);
+void send_pair_packet(PAIR_PACKET *pair_packet);
+void get_pair_packet(PAIR_PACKET *pair_packet);
 
 #endif
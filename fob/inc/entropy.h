@@ -0,0 +1,44 @@
+/**
+ * @file entropy.h
+ * @author Spartan State Security Team
+ * @brief File that defines the append-only entropy journal in flash
+ * @date 2023
+ *
+ * This source file is part of our designed system
+ * for MITRE's 2023 Embedded System CTF (eCTF).
+ */
+
+#ifndef ENTROPY_H
+#define ENTROPY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*** Macro Definitions ***/
+// Flash pages the journal rotates through
+#define ENTROPY_JOURNAL_BASE 0x3E800
+#define ENTROPY_JOURNAL_PAGES 4
+#define ENTROPY_PAGE_SIZE 0x400
+
+// Bytes of fresh seed carried from one boot to the next
+#define ENTROPY_SEED_SIZE 56
+
+// Marks a record whose seed was completely written
+#define ENTROPY_COMMIT 0x454E5452
+
+/*** Structure definitions ***/
+// Defines a struct for one journal record, filling a 64 byte flash slot
+typedef struct {
+  uint32_t seq;                        // counts up with every record
+  uint8_t seed[ENTROPY_SEED_SIZE];
+  uint32_t commit;                     // ENTROPY_COMMIT, programmed last
+} ENTROPY_RECORD;
+
+#define ENTROPY_RECORDS_PER_PAGE (ENTROPY_PAGE_SIZE / sizeof(ENTROPY_RECORD))
+#define ENTROPY_RECORDS (ENTROPY_JOURNAL_PAGES * ENTROPY_RECORDS_PER_PAGE)
+
+/*** Function declarations ***/
+void entropy_journal_seed(uint8_t seed[ENTROPY_SEED_SIZE]);
+bool entropy_journal_append(const uint8_t seed[ENTROPY_SEED_SIZE]);
+
+#endif // ENTROPY_H
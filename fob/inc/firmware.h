@@ -13,23 +13,33 @@
 
 #include "sb_all.h"
 
+#include "p256.h"
+
 /*** Macro Definitions ***/
 // Features Information
 #define NUM_FEATURES 3
 #define FEATURE_END 0x7C0
 #define FEATURE_SIZE 64
+// Feature presence bitmap of a response, bit i - 1 is set when feature i is included
+#define PRESENT_SIZE ((NUM_FEATURES + 7) / 8)
+#define PRESENT_GET(present, i) (((present)[(i) / 8] >> ((i) % 8)) & 1)
+#define PRESENT_SET(present, i) ((present)[(i) / 8] |= (uint8_t)(1 << ((i) % 8)))
 
 // Paired or Unpaired
 #define PFOB pfob()
 #define UFOB !pfob()
 
+// Whether this device was built as a paired or an unpaired fob
+#define OG_PFOB (DEVICE_SECRETS.og_pfob != 0)
+#define OG_UFOB (DEVICE_SECRETS.og_pfob == 0)
+
 // System Information
 #define SPEED 80000000
 #define BAUD 115200
 #define ENDIAN 1
 
-// Entropy
-#define ENTROPY_FLASH 0x3F800
+// Presigning
+#define PRESIGN_POOL_SIZE 4
 
 /*** Special Constants for Communication ***/
 #define ENABLE_CMD 0x10
@@ -39,20 +49,32 @@
 #define CHAL_START 0x57
 #define RESP_START 0x58
 #define PAIR_START 0x21
+#define BAUD_OFFER 0x59
+#define BAUD_ACK 0x5A
+#define SIG_START 0x5B
+#define LINK_DONE 0x5C
+
+// Status frame sent to the host once a host command finishes:
+// STATUS_START, the command byte, then one of the status codes below
+#define STATUS_START 0x5E
+#define STATUS_OK 0x00
+#define STATUS_REJECTED 0x01 // not allowed in the fob's current state
+#define STATUS_BAD_PIN 0x02
+#define STATUS_FAILED 0x03   // the change could not be stored
 
 /*** FLASH Storage Information ***/
-#define FOB_STATE_PTR 0x3FC00
 #define FLASH_DATA_SIZE         \
   (sizeof(FLASH_DATA) % 4 == 0) \
       ? sizeof(FLASH_DATA)      \
       : sizeof(FLASH_DATA) + (4 - (sizeof(FLASH_DATA) % 4))
 #define NO_UPAIRED 0xFFFFFFFF
 #define YES_PAIRED 0x20202020
-#define FOB_FLASH ((FOB_DATA *)FOB_STATE_PTR)
 
 /*** Structure definitions ***/
-// Defines a struct for a packaged feature
-typedef sb_sw_signature_t PACKAGE;
+// Defines a struct for a packaged feature, the host's signature r || s and its recovery byte
+typedef struct {
+  uint8_t bytes[sizeof(sb_sw_signature_t) + 1];
+} PACKAGE;
 
 // Defines a struct for the challenge in the challenge-response mechanism
 typedef struct {
@@ -60,11 +82,17 @@ typedef struct {
 } CHALLENGE;
 
 // Defines a struct for the response in the challenge-response mechanism
+// On the board link the bitmap and the packages it flags come first, in feature order,
+// and the signature follows once the fob has computed it
 typedef struct {
+  uint8_t present[PRESENT_SIZE];
   sb_sw_signature_t unlock;
-  PACKAGE feature[3];
+  PACKAGE feature[NUM_FEATURES];
 } RESPONSE;
 
+// Size of the feature part of a response on the board link, excluding its start byte
+#define RESPONSE_FEATURES_SIZE(num_present) (PRESENT_SIZE + (num_present) * sizeof(PACKAGE))
+
 // Defines a struct for the format of a pairing message
 typedef struct
 {
@@ -78,32 +106,54 @@ typedef struct
   uint32_t paired;
   uint32_t pin;
   sb_sw_private_t car_privkey;
-  PACKAGE feature[3];
+  PACKAGE feature[NUM_FEATURES];
 } FOB_DATA;
 
+// Defines a struct for a presigned nonce, ready to finish a signature
+typedef struct {
+  p256_int_t k_inv;            // k^-1 mod n, in Montgomery form
+  p256_int_t r;                // x(kG) mod n, in Montgomery form
+  uint8_t r_bytes[P256_BYTES]; // r as it appears in the signature
+  bool ready;
+} PRESIGN;
+
 // Defines a struct for storing entropy in flash
 typedef struct {
   uint8_t data[0x400];
 } ENTROPY;
 
+// Defines the secrets provisioned into each fob, kept in the .secrets section
+// Layout must match gen_secret.py, which patch_secrets.py relies on
+typedef struct {
+  uint32_t og_pfob; // nonzero when built as a paired fob
+  ENTROPY entropy;
+} SECRETS;
+
+/*** Constants ***/
+// Generated by gen_secret.py into secrets.h, compiled by secrets.c
+extern const SECRETS DEVICE_SECRETS;
+
 /*** Function declarations ***/
 // Core functions
-void pPairFob(void);
-void uPairFob(void);
-void enableFeature(void);
+uint8_t pPairFob(void);
+uint8_t uPairFob(void);
+uint8_t enableFeature(void);
 void unlockCar(void);
 
 // Security Functions
 void gen_response(CHALLENGE *challenge, RESPONSE *response);
+bool presign(PRESIGN *entry);
+bool sign_presigned(CHALLENGE *challenge, sb_sw_signature_t *signature);
 
 // Helper functions
 void tryHostCmd(void);
+void send_status(uint8_t cmd, uint8_t status);
 void tryButton(void);
+void tryPresign(void);
 bool init_drbg(void);
 void SLEEP(void);
 bool pfob(void);
+bool feature_enabled(const PACKAGE *package);
 bool get_secret(sb_sw_private_t *priv, uint32_t *pin);
-void loadFobState(FOB_DATA *fob_data);
-bool saveFobState(FOB_DATA *fob_data);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,43 @@
+/**
+ * @file flash_queue.h
+ * @author Spartan State Security Team
+ * @brief File that defines the background flash write queue
+ * @date 2023
+ *
+ * This source file is part of our designed system
+ * for MITRE's 2023 Embedded System CTF (eCTF).
+ */
+
+#ifndef FLASH_QUEUE_H
+#define FLASH_QUEUE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*** Macro Definitions ***/
+// Most pending word writes and page erases, a power of two
+#define FLASH_QUEUE_SIZE 128
+
+// Set in the address of an operation which erases the page
+#define FLASH_QUEUE_ERASE 0x1
+
+/*** Structure definitions ***/
+// Defines a struct for one pending flash operation
+typedef struct {
+  uint32_t addr;  // word address, or page address | FLASH_QUEUE_ERASE
+  uint32_t data;  // word to program
+} FLASH_OP;
+
+/*** Function declarations ***/
+// Setup Functions
+void flash_queue_init(void);
+
+// Queue Functions
+void flash_queue_erase(uint32_t page);
+void flash_queue_program(const uint32_t *data, uint32_t addr, uint32_t len);
+bool flash_queue_idle(void);
+void flash_queue_wait(void);
+uint32_t flash_queue_errors(void);
+bool flash_queue_flush(void);
+
+#endif // FLASH_QUEUE_H
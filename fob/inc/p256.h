@@ -0,0 +1,51 @@
+/**
+ * @file p256.h
+ * @author Spartan State Security Team
+ * @brief Supplementary P-256 scalar arithmetic not exposed by Sweet B
+ * @date 2023
+ *
+ * This source file is part of our designed system
+ * for MITRE's 2023 Embedded System CTF (eCTF).
+ */
+
+#ifndef P256_H
+#define P256_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*** Macro Definitions ***/
+#define P256_WORDS 8
+#define P256_BYTES 32
+
+/*** Structure definitions ***/
+// Defines a 256-bit integer as little-endian 32-bit words
+typedef struct {
+  uint32_t w[P256_WORDS];
+} p256_int_t;
+
+// Defines a prime modulus with its Montgomery constants
+typedef struct {
+  p256_int_t m;    // the modulus itself
+  uint32_t m0inv;  // -m^-1 mod 2^32
+  p256_int_t r2;   // R^2 mod m, where R = 2^256
+} p256_mod_t;
+
+/*** Constants ***/
+// Order of the P-256 base point
+extern const p256_mod_t P256_N;
+
+/*** Function declarations ***/
+// Conversion Functions
+void p256_from_bytes(p256_int_t *dest, const uint8_t src[P256_BYTES]);
+void p256_to_bytes(uint8_t dest[P256_BYTES], const p256_int_t *src);
+bool p256_is_zero(const p256_int_t *a);
+
+// Modular Arithmetic Functions
+void p256_mod_reduce(p256_int_t *a, const p256_mod_t *m);
+void p256_mod_add(p256_int_t *dest, const p256_int_t *a, const p256_int_t *b, const p256_mod_t *m);
+void p256_mont_mul(p256_int_t *dest, const p256_int_t *a, const p256_int_t *b, const p256_mod_t *m);
+void p256_to_mont(p256_int_t *dest, const p256_int_t *a, const p256_mod_t *m);
+void p256_mont_inv(p256_int_t *dest, const p256_int_t *a, const p256_mod_t *m);
+
+#endif // P256_H
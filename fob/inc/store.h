@@ -0,0 +1,72 @@
+/**
+ * @file store.h
+ * @author Spartan State Security Team
+ * @brief File that defines the RAM mirror of the fob's persistent storage
+ * @date 2023
+ *
+ * This source file is part of our designed system
+ * for MITRE's 2023 Embedded System CTF (eCTF).
+ */
+
+#ifndef STORE_H
+#define STORE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "firmware.h"
+
+/*** Macro Definitions ***/
+// Flash pages holding the fob state log, one active at a time
+#define FOB_STORE_PAGE_A 0x3F800
+#define FOB_STORE_PAGE_B 0x3FC00
+#define FOB_STORE_PAGE_SIZE 0x400
+
+// Marks a page whose compaction finished
+#define FOB_STORE_MAGIC 0x464F4253
+
+// An erased generation, never written by a compaction
+#define FOB_STORE_ERASED 0xFFFFFFFF
+
+// Record tags, the feature tag carries the feature index in its low byte
+#define FOB_RECORD_PAIRING 0x50414952
+#define FOB_RECORD_FEATURE 0x46454100
+#define FOB_RECORD_COMMIT 0x434F4D54
+
+/*** Structure definitions ***/
+// Defines a struct for the header of a log page, programmed after its records, magic last
+typedef struct {
+  uint32_t magic;       // FOB_STORE_MAGIC
+  uint32_t generation;  // the newer page holds the higher generation
+} FOB_STORE_HEADER;
+
+// Defines a struct for one log record, overriding any earlier record with its tag
+typedef struct {
+  uint32_t tag;
+  uint8_t data[sizeof(PACKAGE)];
+  uint32_t commit;  // FOB_RECORD_COMMIT, programmed last
+} FOB_RECORD;
+
+// Defines a struct for the body of a pairing record
+typedef struct {
+  uint32_t pin;
+  sb_sw_private_t car_privkey;
+} FOB_PAIRING;
+
+#define FOB_RECORDS_PER_PAGE \
+  ((FOB_STORE_PAGE_SIZE - sizeof(FOB_STORE_HEADER)) / sizeof(FOB_RECORD))
+
+/*** Function declarations ***/
+// Setup Functions
+bool store_init(void);
+
+// Access Functions
+const FOB_DATA *store_eeprom_data(void);
+const FOB_DATA *store_fob_data(void);
+
+// Update Functions
+bool store_save_pairing(const sb_sw_private_t *car_privkey, uint32_t pin);
+bool store_save_feature(uint32_t feature_idx, const PACKAGE *package);
+bool store_flush(void);
+
+#endif // STORE_H
@@ -18,16 +18,37 @@
 
 #define HOST_UART ((uint32_t)UART0_BASE)
 
+// Ring buffer sizes, must be powers of two
+#define UART_RX_RING_SIZE 512
+#define UART_TX_RING_SIZE 512
+
+// Called from the UART interrupt when a uDMA transfer completes
+typedef void (*uart_dma_done_t)(uint32_t uart);
+
 // Configuration and Status
 void uart_init(void);
+void uart_start(uint32_t uart);
+void uart_set_baud(uint32_t uart, uint32_t baud);
 bool uart_avail(uint32_t uart);
+uint32_t uart_overruns(uint32_t uart);
 
 // Read Functions Rx
 int32_t uart_readb(uint32_t uart);
 uint32_t uart_read(uint32_t uart, uint8_t *buf, uint32_t n);
+bool uart_peek(uint32_t uart, uint8_t *data);
+uint32_t uart_read_nb(uint32_t uart, uint8_t *buf, uint32_t n);
 
 // Write Functions Tx
 void uart_writeb(uint32_t uart, uint8_t data);
-uint32_t uart_write(uint32_t uart, uint8_t *buf, uint32_t len);
+uint32_t uart_write(uint32_t uart, const uint8_t *buf, uint32_t len);
+uint32_t uart_write_nb(uint32_t uart, const uint8_t *buf, uint32_t len);
+void uart_flush(uint32_t uart);
+
+// uDMA Transfer Functions
+void uart_dma_init(void);
+bool uart_dma_read(uint32_t uart, uint8_t *buf, uint32_t len, uart_dma_done_t done);
+bool uart_dma_write(uint32_t uart, const uint8_t *buf, uint32_t len, uart_dma_done_t done);
+bool uart_dma_busy(uint32_t uart);
+void uart_dma_abort(uint32_t uart);
 
 #endif // UART_H
@@ -10,6 +10,7 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "inc/hw_memmap.h"
 #include "inc/hw_types.h"
@@ -26,6 +27,33 @@
 #include "uart.h"
 #include "firmware.h"
 
+/*** Structure definitions ***/
+// Defines the buffer the uDMA controller sends board link messages from
+typedef union {
+  RESPONSE response;
+  PAIR_PACKET pair_packet;
+} LINK_MESSAGE;
+
+/*** Constants ***/
+// Board link rates in order of preference, must match the car
+static const uint32_t LINK_BAUDS[LINK_BAUD_COUNT] = {
+  BAUD, 230400, 460800, 921600, 1000000, 2000000
+};
+
+// Pattern exchanged at a new rate to prove the line carries it
+static const uint8_t BAUD_CHECK[4] = { 0x55, 0xAA, 0x0F, 0xF0 };
+
+/*** Globals ***/
+// Rate the board link is running at
+uint8_t link_rate_current = 0;
+
+// Outgoing message, owned by the uDMA controller while link_sending is set
+LINK_MESSAGE link_message;
+volatile bool link_sending = false;
+
+// Set by the uDMA completion callback once a whole message has arrived
+volatile bool link_received = false;
+
 /**
  * @brief Initialize the board link interface.
  *
@@ -49,6 +77,144 @@ void setup_board_link(void) {
   while (UARTCharsAvail(BOARD_UART)) {
     UARTCharGet(BOARD_UART);
   }
+
+  uart_start(BOARD_UART);
+  uart_dma_init();
+}
+
+/**
+ * @brief Called from the board link interrupt once a message has been sent.
+ *
+ * Clears the outgoing buffer, which may hold a private key.
+ *
+ * @param uart is the base address of the UART port.
+ */
+static void send_done(uint32_t uart) {
+  memset(&link_message, 0, sizeof(link_message));
+  link_sending = false;
+}
+
+/**
+ * @brief Called from the board link interrupt once a message has been received.
+ *
+ * @param uart is the base address of the UART port.
+ */
+static void receive_done(uint32_t uart) {
+  link_received = true;
+}
+
+/**
+ * @brief Send a board link message, leaving the uDMA controller to finish it
+ *
+ * Waits only for the previous message to go out.
+ *
+ * @param start [in] The start byte of the message
+ * @param data  [in] The message body
+ * @param len   [in] The length of the message body
+ */
+static void link_send(uint8_t start, const void *data, uint32_t len) {
+  while (link_sending);
+
+  memcpy(&link_message, data, len);
+  link_sending = true;
+
+  uart_writeb(BOARD_UART, start);
+  if (!uart_dma_write(BOARD_UART, (uint8_t *)&link_message, len, send_done)) {
+    uart_write(BOARD_UART, (uint8_t *)&link_message, len);
+    send_done(BOARD_UART);
+  }
+}
+
+/**
+ * @brief Wait a short while for the board link to receive a byte
+ *
+ * @return true once a byte is waiting, false if it is time to check a timeout
+ */
+static bool link_poll(void) {
+  if (uart_avail(BOARD_UART)) return true;
+  SysCtlDelay(SPEED / 30000); // 100us
+  return false;
+}
+
+/**
+ * @brief Read bytes from the board link, giving up after a timeout
+ *
+ * @param buf [out] Where to store the bytes
+ * @param len [in]  The number of bytes to read
+ * @param ms  [in]  The time allowed, in milliseconds
+ *
+ * @return true if every byte arrived in time, false otherwise
+ */
+static bool link_read_timeout(uint8_t *buf, uint32_t len, uint32_t ms) {
+  uint32_t polls = ms * 10;
+  uint32_t got = 0;
+
+  while (got < len) {
+    got += uart_read_nb(BOARD_UART, &buf[got], len - got);
+    if (got < len && !link_poll() && polls-- == 0) return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Wait for the start byte of a board link message, discarding anything else
+ *
+ * @param start [in] The start byte of the message
+ * @param ms    [in] The time allowed, in milliseconds, or 0 to wait forever
+ *
+ * @return true once the start byte has been read, false if it did not arrive in time
+ */
+static bool link_find(uint8_t start, uint32_t ms) {
+  uint32_t polls = ms * 10;
+
+  do {
+    while (!link_poll()) {
+      if (ms && polls-- == 0) return false;
+    }
+  } while ((uint8_t)uart_readb(BOARD_UART) != start);
+  return true;
+}
+
+/**
+ * @brief Receive a board link message, waiting for its start byte
+ *
+ * @param start [in]  The start byte of the message
+ * @param data  [out] Where to store the message body
+ * @param len   [in]  The length of the message body
+ * @param ms    [in]  The time allowed, in milliseconds, or 0 to wait forever
+ *
+ * @return true if the whole message arrived in time, false otherwise
+ */
+static bool link_receive(uint8_t start, void *data, uint32_t len, uint32_t ms) {
+  uint32_t polls = ms * 10;
+
+  if (!link_find(start, ms)) return false;
+
+  // Let the uDMA controller collect the body
+  link_received = false;
+  if (!uart_dma_read(BOARD_UART, (uint8_t *)data, len, receive_done)) {
+    return link_read_timeout((uint8_t *)data, len, ms ? ms : UINT32_MAX / 10);
+  }
+  while (!link_received) {
+    SysCtlDelay(SPEED / 30000); // 100us
+    if (ms && polls-- == 0) {
+      uart_dma_abort(BOARD_UART);
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Switch the board link to one of the negotiated rates
+ *
+ * @param rate [in] The index of the rate in LINK_BAUDS
+ */
+static void set_link_rate(uint8_t rate) {
+  if (rate != link_rate_current) {
+    uart_set_baud(BOARD_UART, LINK_BAUDS[rate]);
+    link_rate_current = rate;
+  }
 }
 
 /**
@@ -58,23 +224,145 @@ void request_unlock(void) {
   uart_writeb(CAR_UART, (uint8_t)UNLOCK_REQ);
 }
 
+/**
+ * @brief Answer a rate offer whose start byte has been read, and switch the board link to it
+ * 
+ * Answers with the fastest rate both ends support, then echoes the
+ * car's check pattern at that rate. If the pattern does not survive,
+ * the board link returns to BAUD and the car offers a slower rate.
+ * 
+ * @return true if the link is ready for the challenge, false otherwise
+ */
+static bool answer_offer(void) {
+  uint8_t offer;
+  uint8_t ack[2];
+  uint8_t check[sizeof(BAUD_CHECK)];
+
+  do {
+    if (!link_read_timeout(&offer, sizeof(offer), LINK_OFFER_TIMEOUT)) return false;
+
+    ack[0] = BAUD_ACK;
+    ack[1] = offer < LINK_BAUD_COUNT ? offer : LINK_BAUD_COUNT - 1;
+    uart_write(CAR_UART, ack, sizeof(ack));
+
+    // Staying at BAUD needs no check
+    if (ack[1] == 0) return true;
+
+    set_link_rate(ack[1]);
+    if (link_read_timeout(check, sizeof(check), LINK_CHECK_TIMEOUT) &&
+        !memcmp(check, BAUD_CHECK, sizeof(BAUD_CHECK))) {
+      uart_write(CAR_UART, check, sizeof(check));
+      return true;
+    }
+
+    set_link_rate(0);
+  } while (link_find(BAUD_OFFER, LINK_OFFER_TIMEOUT));
+  return false;
+}
+
+/**
+ * @brief Accept the car's rate offer and switch the board link to it
+ * 
+ * @return true if the link is ready for the challenge, false otherwise
+ */
+bool accept_baud(void) {
+  return link_find(BAUD_OFFER, LINK_OFFER_TIMEOUT) && answer_offer();
+}
+
+/**
+ * @brief Wait for the car to end the unlock exchange, or to retry it
+ * 
+ * A car which lost the response at a negotiated rate offers a slower
+ * rate for another challenge. Otherwise it sends LINK_DONE.
+ * 
+ * @return true if the car offered a rate and the link is ready for
+ *         the challenge, false if the exchange is over
+ */
+bool accept_retry(void) {
+  uint32_t polls = LINK_RETRY_TIMEOUT * 10;
+  uint8_t c;
+
+  while (true) {
+    while (!link_poll()) {
+      if (polls-- == 0) return false;
+    }
+    c = (uint8_t)uart_readb(BOARD_UART);
+    if (c == LINK_DONE) return false;
+    if (c == BAUD_OFFER) return answer_offer();
+  }
+}
+
+/**
+ * @brief Return the board link to BAUD once the last message has been sent
+ */
+void restore_baud(void) {
+  set_link_rate(0);
+}
+
 /**
  * @brief Receives the challenge from the car device
  * 
  * @param challenge [out] The challenge being written
+ * 
+ * @return true if the challenge arrived in time, false otherwise
  */
-void get_challenge(CHALLENGE *challenge) {
-  while(uart_readb(CAR_UART) != CHAL_START);
-  uart_read(CAR_UART, (uint8_t *)challenge, sizeof(CHALLENGE));
+bool get_challenge(CHALLENGE *challenge) {
+  return link_receive(CHAL_START, challenge, sizeof(CHALLENGE), LINK_CHALLENGE_TIMEOUT);
+}
+
+/**
+ * @brief Sends the feature part of the response to the car device
+ * 
+ * Only the packages flagged as present are sent.
+ * Returns while they are still being sent, so the response
+ * can be signed meanwhile.
+ * 
+ * @param response [in] The response holding the packages
+ */
+void send_features(RESPONSE *response) {
+  uint8_t packed[RESPONSE_FEATURES_SIZE(NUM_FEATURES)];
+  uint32_t count = 0;
+  uint32_t i;
+
+  // Leave out the packages of features which are not enabled
+  memcpy(packed, response->present, PRESENT_SIZE);
+  for (i = 0; i < NUM_FEATURES; i++) {
+    if (PRESENT_GET(response->present, i)) {
+      memcpy(&packed[RESPONSE_FEATURES_SIZE(count++)], &response->feature[i], sizeof(PACKAGE));
+    }
+  }
+
+  link_send(RESP_START, packed, RESPONSE_FEATURES_SIZE(count));
 }
 
 /**
  * @brief Finalizes the unlock attempt by sending the
- * generated response to the car device
+ * unlock signature to the car device
  * 
- * @param response [in] The response to send
+ * Returns while the signature is still being sent.
+ * 
+ * @param response [in] The response holding the signature
  */
 void finalize_unlock(RESPONSE *response) {
-  uart_writeb(CAR_UART, RESP_START);
-  uart_write(CAR_UART, (uint8_t *)response, sizeof(RESPONSE));
+  link_send(SIG_START, &response->unlock, sizeof(response->unlock));
+}
+
+/**
+ * @brief Sends the pairing packet to the unpaired fob device
+ * 
+ * Returns while the packet is still being sent.
+ * 
+ * @param pair_packet [in] The packet to send
+ */
+void send_pair_packet(PAIR_PACKET *pair_packet) {
+  link_send(PAIR_START, pair_packet, sizeof(PAIR_PACKET));
+}
+
+/**
+ * @brief Receives the pairing packet from the paired fob device
+ * 
+ * @param pair_packet [out] The packet being written
+ */
+void get_pair_packet(PAIR_PACKET *pair_packet) {
+  link_receive(PAIR_START, pair_packet, sizeof(PAIR_PACKET), 0);
 }
\ No newline at end of file
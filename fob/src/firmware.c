@@ -17,7 +17,6 @@
 #include "inc/hw_ints.h"
 #include "inc/hw_memmap.h"
 
-#include "driverlib/eeprom.h"
 #include "driverlib/flash.h"
 #include "driverlib/gpio.h"
 #include "driverlib/interrupt.h"
@@ -28,9 +27,10 @@
 
 #include "sb_all.h"
 
-#include "secrets.h"
-
 #include "board_link.h"
+#include "p256.h"
+#include "store.h"
+#include "entropy.h"
 #include "uart.h"
 #include "firmware.h"
 
@@ -45,6 +45,8 @@ uint8_t current_sw_state = GPIO_PIN_4;
 // CSPRNG State
 sb_hmac_drbg_state_t drbg;
 bool DRBG_INITIALIZED = false;
+// Presigned Nonces
+PRESIGN presign_pool[PRESIGN_POOL_SIZE];
 
 /**
  * @brief Main function for the Secure Fob design
@@ -68,20 +70,8 @@ int main(void)
   GPIOPinWrite(GPIO_PORTF_BASE, GPIO_PIN_2, 0);
   GPIOPinWrite(GPIO_PORTF_BASE, GPIO_PIN_3, 0);
 
-  // Ensure EEPROM peripheral is enabled
-  SysCtlPeripheralEnable(SYSCTL_PERIPH_EEPROM0);
-  EEPROMInit();
-
-  // Establish Entropy if Needed
-  if(((uint32_t*)ENTROPY_FLASH)[0] == ((uint32_t*)ENTROPY_FLASH)[1] &&
-     ((uint32_t*)ENTROPY_FLASH)[2] == ((uint32_t*)ENTROPY_FLASH)[3] &&
-     ((uint32_t*)ENTROPY_FLASH)[0] == ((uint32_t*)ENTROPY_FLASH)[4]) {
-
-    if( FlashErase(ENTROPY_FLASH)
-     || FlashProgram((uint32_t *)&S_ENTROPY, ENTROPY_FLASH, sizeof(ENTROPY))
-    ) return -1;
-    
-  }
+  // Initialize EEPROM once and mirror it into RAM
+  store_init();
 
   // Initialize SysTick
   SysTickPeriodSet(16000000);
@@ -108,6 +98,9 @@ int main(void)
     // Check for button press
     tryButton();
 
+    // Use idle time to presign
+    tryPresign();
+
   }
 }
 
@@ -122,28 +115,35 @@ void tryHostCmd(void) {
   {
     uint8_t cmd = (uint8_t)uart_readb(HOST_UART);
 
+    // Each command checks the fob's state itself, and the host is told how it finished
     if(cmd == ENABLE_CMD) {
       // if fob is paired, enable feature
-      if(PFOB) {
-        enableFeature();
-      }
+      send_status(cmd, enableFeature());
     }
     if(cmd == P_PAIR_CMD) {
       // if fob is paired, pair another fob
-      if(PFOB) {
-        pPairFob();
-      }
+      send_status(cmd, pPairFob());
     }
     if(cmd == U_PAIR_CMD) {
       // if fob is unpaired, pair fob
-      if(UFOB && OG_UFOB) {
-        uPairFob();
-      }
+      send_status(cmd, uPairFob());
     }
 
   }
 }
 
+/**
+ * @brief Tells the host that a command has finished
+ *
+ * @param cmd    [in] The command byte received from the host
+ * @param status [in] How the command finished, one of the STATUS codes
+ */
+void send_status(uint8_t cmd, uint8_t status) {
+  uint8_t frame[3] = { STATUS_START, cmd, status };
+
+  uart_write(HOST_UART, frame, sizeof(frame));
+}
+
 /**
  * @brief Checks whether a button press occurs on SW1.
  * If so, attempts to unlock the attached car device.
@@ -165,6 +165,31 @@ void tryButton(void) {
   previous_sw_state = current_sw_state;
 }
 
+/**
+ * @brief Refills one empty slot of the presigned nonce pool.
+ * 
+ * Does nothing if a host command is waiting, so that
+ * the scalar multiplication never delays a command.
+ */
+void tryPresign(void) {
+  uint32_t i;
+
+  // Only paired fobs sign, and host commands come first
+  if(!PFOB || uart_avail(HOST_UART)) return;
+
+  for (i = 0; i < PRESIGN_POOL_SIZE; i++) {
+    if (!presign_pool[i].ready) {
+      // Initialize DRBG
+      if (!DRBG_INITIALIZED) {
+        if(!init_drbg()) return;
+        DRBG_INITIALIZED = true;
+      }
+      presign(&presign_pool[i]);
+      return;
+    }
+  }
+}
+
 /**
  * @brief Initialize the CSPRNG.
  * 
@@ -172,35 +197,37 @@ void tryButton(void) {
  */
 bool init_drbg(void)
 {
-  ENTROPY temp_entropy;
+  ENTROPY entropy;
+  uint8_t seed[ENTROPY_SEED_SIZE];
   sb_sw_private_t car_privkey;
   volatile uint32_t tick;
+  uint32_t i;
 
-  // Check for Entropy Error
-  if(((uint32_t*)ENTROPY_FLASH)[0] == ((uint32_t*)ENTROPY_FLASH)[1] &&
-     ((uint32_t*)ENTROPY_FLASH)[2] == ((uint32_t*)ENTROPY_FLASH)[3] &&
-     ((uint32_t*)ENTROPY_FLASH)[0] == ((uint32_t*)ENTROPY_FLASH)[4])
-     return false;
+  // Mix the seed left by the last start into the provisioned entropy
+  memcpy(&entropy, &DEVICE_SECRETS.entropy, sizeof(ENTROPY));
+  entropy_journal_seed(seed);
+  for(i=0; i<ENTROPY_SEED_SIZE; i++) {
+    entropy.data[i] ^= seed[i];
+  }
 
   // Initialize DRBG
   tick = SysTickValueGet();
   if(!(
     get_secret(&car_privkey, NULL) &&
-    sb_hmac_drbg_init(&drbg, (void *)ENTROPY_FLASH, sizeof(ENTROPY), (sb_byte_t *)&car_privkey, sizeof(sb_sw_private_t), (sb_byte_t *)&tick, sizeof(tick)) == SB_SUCCESS
+    sb_hmac_drbg_init(&drbg, (sb_byte_t *)&entropy, sizeof(ENTROPY), (sb_byte_t *)&car_privkey, sizeof(sb_sw_private_t), (sb_byte_t *)&tick, sizeof(tick)) == SB_SUCCESS
   )) return false;
 
-  // Clear private key
+  // Clear private key and entropy
   ZERO(car_privkey);
-
-  //Checkout Entropy
-  memcpy(&temp_entropy, (void *)ENTROPY_FLASH, sizeof(temp_entropy));
+  ZERO(entropy);
 
   // Update Entropy
-  if(sb_hmac_drbg_generate(&drbg, (sb_byte_t *)&temp_entropy, sizeof(temp_entropy))
+  if(sb_hmac_drbg_generate(&drbg, seed, sizeof(seed))
     != SB_SUCCESS) return false;
 
-  // Commit Entropy
-  if(FlashErase(ENTROPY_FLASH) || FlashProgram((uint32_t *)&temp_entropy, ENTROPY_FLASH, sizeof(ENTROPY))) return false;
+  // Commit Entropy as one small journal record
+  if(!entropy_journal_append(seed)) return false;
+  ZERO(seed);
   
   // Success
   return true;
@@ -220,16 +247,16 @@ void SLEEP(void) {
 */
 bool pfob(void)
 {
-  return OG_PFOB || FOB_FLASH->paired==YES_PAIRED;
+  return OG_PFOB || store_fob_data()->paired==YES_PAIRED;
 }
 
 /**
  * @brief Loads a secret value from storage.
  * 
  * If the device was originally a paired fob,
- * load the value from EEPROM.
+ * load the value from the RAM mirror of EEPROM.
  * If the device was origynally an unpaired fob,
- * load the value from FLASH.
+ * load the value from the fob state replayed from FLASH.
  * 
  * @param priv [out] Where to write the car private key, or NULL if key is not wanted
  * @param pin  [out] Where to write the pairing pin, or NULL if pin is not wanted
@@ -237,27 +264,24 @@ bool pfob(void)
  * @return true if operation succeeds, false if an eeprom error occurs
  */
 bool get_secret(sb_sw_private_t *priv, uint32_t *pin) {
-  #if OG_PFOB == 1
-    if(EEPROMInit() != EEPROM_INIT_OK){
+  const FOB_DATA *fob_data;
+
+  if(OG_PFOB) {
+    fob_data = store_eeprom_data();
+    if(!fob_data){
       return false;
     }
-    if(priv) {
-      EEPROMRead((uint32_t *)priv, offsetof(FOB_DATA, car_privkey), sizeof(sb_sw_private_t));
-    }
-    if(pin) {
-      EEPROMRead(pin, offsetof(FOB_DATA, pin), sizeof(uint32_t));
-    }
-    return true;
-  #endif
-  #if OG_UFOB == 1
-    if(priv) {
-      memcpy(priv, &FOB_FLASH->car_privkey, sizeof(sb_sw_private_t));
-    }
-    if(pin) {
-      *pin = FOB_FLASH->pin;
-    }
-    return true;
-  #endif
+  } else {
+    fob_data = store_fob_data();
+  }
+
+  if(priv) {
+    memcpy(priv, &fob_data->car_privkey, sizeof(sb_sw_private_t));
+  }
+  if(pin) {
+    *pin = fob_data->pin;
+  }
+  return true;
 }
 
 /**
@@ -265,120 +289,159 @@ bool get_secret(sb_sw_private_t *priv, uint32_t *pin) {
  * if the Host supplies the correct pin.
  * 
  * If the supplied pin is incorrect, SLEEPs for a while.
+ *
+ * @return STATUS_OK once the pairing packet is sent, another status code otherwise
  */
-void pPairFob(void)
+uint8_t pPairFob(void)
 {
   PAIR_PACKET pair_packet;
   uint32_t true_pin;
   uint32_t host_pin;
   
-  // Paired fob only
-  if(!PFOB) return;
-
   // Receive PIN attempt from host
   uart_read(HOST_UART, (uint8_t *)&host_pin, sizeof(host_pin));
 
+  // Paired fob only
+  if(!PFOB) return STATUS_REJECTED;
+
   // Verify PIN attempt
-  if(!get_secret(NULL, &true_pin)) return;
+  if(!get_secret(NULL, &true_pin)) return STATUS_FAILED;
   if(host_pin != true_pin) {
     // If pin is invalid, sleep and return
     SLEEP();
-    return;
+    return STATUS_BAD_PIN;
   }
   
   // PIN Successful, Do Pairing
-  if(!get_secret(&pair_packet.car_privkey, &pair_packet.pin)) return;
-  uart_writeb(UFOB_UART, PAIR_START);
-  uart_write(UFOB_UART, (uint8_t *)&pair_packet, sizeof(pair_packet));
+  if(!get_secret(&pair_packet.car_privkey, &pair_packet.pin)) return STATUS_FAILED;
+  send_pair_packet(&pair_packet);
+  ZERO(pair_packet);
+  return STATUS_OK;
 }
 
 /**
  * @brief Function that pairs this fob,
  * becoming a paired fob device
  * rather than an unpaired fob device.
+ *
+ * @return STATUS_OK once the pairing is in flash, another status code otherwise
  */
-void uPairFob(void)
+uint8_t uPairFob(void)
 {
-  FOB_DATA temp_flash;
   PAIR_PACKET pair_packet;
+  bool ok;
 
   // Original unpaired fob only
   if(!(UFOB && OG_UFOB)) {
-    return;
+    return STATUS_REJECTED;
   }
 
   // Get pairing packet from paired fob
-  while(uart_readb(PFOB_UART) != PAIR_START);
-  uart_read(PFOB_UART, (uint8_t *)&pair_packet, sizeof(pair_packet));
+  get_pair_packet(&pair_packet);
 
   // Save the newly received values
-  loadFobState(&temp_flash);
-  temp_flash.pin = pair_packet.pin;
-  memcpy(&temp_flash.car_privkey, &pair_packet.car_privkey, sizeof(temp_flash.car_privkey));
-  temp_flash.paired = YES_PAIRED;
-  saveFobState(&temp_flash);
+  // Flush even after a failed save, so its error is not left for the next one
+  ok = store_save_pairing(&pair_packet.car_privkey, pair_packet.pin);
+  ok = store_flush() && ok;
+  ZERO(pair_packet);
+  return ok ? STATUS_OK : STATUS_FAILED;
 }
 
 /**
  * @brief Function that handles enabling a new feature on the fob
  * by storing the package according to its feature number.
+ *
+ * @return STATUS_OK once the package is in flash, another status code otherwise
  */
-void enableFeature(void)
+uint8_t enableFeature(void)
 {
   PACKAGE package;
-  FOB_DATA temp_flash;
+  bool ok;
   
-  // Paired fob only
-  if(!PFOB) return;
-
   // Get the feature number from the host
   uint8_t feature_num = (uint8_t)uart_readb(HOST_UART) - 1;
 
   // Get the package for the feature from the host
   uart_read(HOST_UART, (uint8_t *)&package, sizeof(PACKAGE));
 
-  // Store the feature package
-  if(feature_num < NUM_FEATURES) {
-    loadFobState(&temp_flash);
-    memcpy(&temp_flash.feature[feature_num], &package, sizeof(PACKAGE));
-    saveFobState(&temp_flash);
-  }
+  // Paired fob only
+  if(!PFOB || feature_num >= NUM_FEATURES) return STATUS_REJECTED;
+
+  // Store the feature package, flushing even after a failed save
+  ok = store_save_feature(feature_num, &package);
+  ok = store_flush() && ok;
+  return ok ? STATUS_OK : STATUS_FAILED;
 }
 
 /**
  * @brief Request the Secure Car device to unlock and start
  * 
  * Responds to the car's challenge, and sends the packaged features.
+ * A car which loses the response at a negotiated rate offers a slower
+ * one and sends a new challenge, which is answered the same way.
  */
 void unlockCar(void)
 {
   CHALLENGE challenge;
   RESPONSE response;
+  bool offered;
+  uint32_t i;
 
   // Paired fob only
   if(!PFOB) return;
 
-  ZERO(response);
-
   // Request the Car to Unlock
   request_unlock();
 
-  // Receive Unlock Challenge from Car
-  get_challenge(&challenge);
-  
-  // Generate Response
-  gen_response(&challenge, &response);
-  
-  // Prepare Feature Requests
-  memcpy(&response.feature, FOB_FLASH->feature, sizeof(response.feature));
+  // Agree on a board link rate, then Receive Unlock Challenge from Car
+  for(offered = accept_baud(); offered && get_challenge(&challenge); offered = accept_retry()) {
+    ZERO(response);
+
+    // Prepare Feature Requests
+    memcpy(&response.feature, store_fob_data()->feature, sizeof(response.feature));
+    for(i=0; i<NUM_FEATURES; i++) {
+      if(feature_enabled(&response.feature[i])) {
+        PRESENT_SET(response.present, i);
+      }
+    }
+
+    // Send Features while the Response is generated
+    send_features(&response);
+    gen_response(&challenge, &response);
+
+    // Send Response
+    finalize_unlock(&response);
+    restore_baud();
+  }
+  restore_baud();
+}
 
-  // Send Response with Features
-  finalize_unlock(&response);
+/**
+ * @brief Check whether a stored feature slot holds a package
+ * 
+ * Slots of features which were never enabled are left erased, all 0xFF.
+ * 
+ * @param package [in] The stored feature slot
+ * 
+ * @return true if the slot holds a package, false otherwise
+ */
+bool feature_enabled(const PACKAGE *package)
+{
+  const uint8_t *bytes = (const uint8_t *)package;
+  uint32_t i;
+
+  for(i=0; i<sizeof(PACKAGE); i++) {
+    if(bytes[i] != 0xFF) return true;
+  }
+  return false;
 }
 
 /**
  * @brief Generate a response to the car's challenge
  * 
+ * Finishes a presigned nonce when one is ready,
+ * otherwise falls back to signing from scratch.
+ * 
  * @param challenge [in]  The car's challenge to which we must respond
  * @param response  [out] The response being written
  */
@@ -397,6 +460,9 @@ void gen_response(CHALLENGE *challenge, RESPONSE *response)
   // Only paired fobs respond to challenges
   if(!PFOB) return;
 
+  // Fast path, only modular arithmetic remains
+  if(sign_presigned(challenge, &response->unlock)) return;
+
   // Clear empy data
   ZERO(sb_ctx);
 
@@ -411,26 +477,115 @@ void gen_response(CHALLENGE *challenge, RESPONSE *response)
 }
 
 /**
- * @brief Load fob data from FLASH into RAM
+ * @brief Precompute the message-independent half of an ECDSA signature
+ * 
+ * Draws a nonce k from the DRBG and stores k^-1 and r = x(kG) mod n,
+ * so that signing later costs only a few modular multiplications.
+ * 
+ * @param entry [out] The pool entry being written
  * 
- * @param fob_data [out] The fob data structure to write
+ * @return true if operation succeeds, false if an error occurs
  */
-void loadFobState(FOB_DATA *fob_data)
+bool presign(PRESIGN *entry)
 {
-  memcpy(fob_data, FOB_FLASH, sizeof(FOB_DATA));
+  sb_sw_context_t sb_ctx;
+  sb_sw_private_t k;
+  sb_sw_public_t kg;
+  p256_int_t t;
+  bool ok = false;
+
+  ZERO(*entry);
+  ZERO(sb_ctx);
+
+  // Draw a nonce and compute R = kG
+  // Sweet B rejects a nonce of zero or at least n as an invalid key
+  ok = sb_hmac_drbg_generate(&drbg, k.bytes, sizeof(k)) == SB_SUCCESS &&
+       sb_sw_compute_public_key(&sb_ctx, &kg, &k, &drbg, SB_SW_CURVE_P256, ENDIAN) == SB_SUCCESS;
+
+  // r = x(R) mod n, which must be nonzero
+  if(ok) {
+    p256_from_bytes(&t, kg.bytes);
+    p256_mod_reduce(&t, &P256_N);
+    ok = !p256_is_zero(&t);
+  }
+
+  if(ok) {
+    p256_to_bytes(entry->r_bytes, &t);
+    p256_to_mont(&entry->r, &t, &P256_N);
+
+    // k^-1 mod n
+    p256_from_bytes(&t, k.bytes);
+    p256_to_mont(&t, &t, &P256_N);
+    p256_mont_inv(&entry->k_inv, &t, &P256_N);
+    entry->ready = true;
+  }
+
+  // Clear nonce
+  ZERO(k);
+  ZERO(t);
+  ZERO(sb_ctx);
+  return ok;
 }
 
 /**
- * @brief Saves fob data structure into FLASH
+ * @brief Sign the challenge using a presigned nonce from the pool
  * 
- * @param fob_data [in] The fob data structure to save
+ * Computes s = k^-1 * (z + r * d) mod n. The nonce is retired
+ * whether or not signing succeeds, so it is never used twice.
  * 
- * @return true if operation succeeds, false if an eeprom error occurs
+ * @param challenge [in]  The car's challenge to sign
+ * @param signature [out] The signature being written
+ * 
+ * @return true if a signature was written, false if no nonce was ready or an error occurs
  */
-bool saveFobState(FOB_DATA *fob_data)
+bool sign_presigned(CHALLENGE *challenge, sb_sw_signature_t *signature)
 {
-  return
-  !FlashErase(FOB_STATE_PTR)
-  &&
-  !FlashProgram((uint32_t *)fob_data, FOB_STATE_PTR, sizeof(FOB_DATA));
+  sb_sha256_state_t sha;
+  sb_sw_message_digest_t hash;
+  sb_sw_private_t priv;
+  PRESIGN entry;
+  p256_int_t z;
+  p256_int_t d;
+  p256_int_t s;
+  bool ok = false;
+  uint32_t i;
+
+  // Take a ready nonce, retiring it from the pool
+  for (i = 0; i < PRESIGN_POOL_SIZE; i++) {
+    if (presign_pool[i].ready) break;
+  }
+  if(i == PRESIGN_POOL_SIZE) return false;
+  memcpy(&entry, &presign_pool[i], sizeof(entry));
+  ZERO(presign_pool[i]);
+
+  // Get signing key
+  if(get_secret(&priv, NULL)) {
+    p256_from_bytes(&d, priv.bytes);
+
+    // z = SHA256(challenge) mod n
+    sb_sha256_init(&sha);
+    sb_sha256_update(&sha, (sb_byte_t *)&challenge->data, sizeof(challenge->data));
+    sb_sha256_finish(&sha, (sb_byte_t *)&hash);
+    p256_from_bytes(&z, hash.bytes);
+    p256_mod_reduce(&z, &P256_N);
+
+    // s = k^-1 * (z + r * d), which must be nonzero
+    p256_mont_mul(&s, &entry.r, &d, &P256_N);
+    p256_mod_add(&s, &s, &z, &P256_N);
+    p256_mont_mul(&s, &entry.k_inv, &s, &P256_N);
+    ok = !p256_is_zero(&s);
+  }
+
+  // Signature is (r, s)
+  if(ok) {
+    memcpy(signature->bytes, entry.r_bytes, P256_BYTES);
+    p256_to_bytes(&signature->bytes[P256_BYTES], &s);
+  }
+
+  // Clear key and nonce
+  ZERO(priv);
+  ZERO(d);
+  ZERO(s);
+  ZERO(entry);
+  return ok;
 }
\ No newline at end of file
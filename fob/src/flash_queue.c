@@ -0,0 +1,178 @@
+/**
+ * @file flash_queue.c
+ * @author Spartan State Security Team
+ * @brief Background flash write queue
+ * @date 2023
+ *
+ * This source file is part of our designed system
+ * for MITRE's 2023 Embedded System CTF (eCTF).
+ *
+ * Erases and word writes are queued and issued one at a time from
+ * the flash controller's completion interrupt, so the main loop keeps
+ * running between them. Operations complete in the order they were
+ * queued, which keeps the commit-last ordering of the stores intact.
+ * The CPU still stalls on instruction fetch while a single operation
+ * is in progress, since code runs from the same flash.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "inc/hw_flash.h"
+#include "inc/hw_types.h"
+#include "driverlib/flash.h"
+#include "driverlib/interrupt.h"
+
+#include "flash_queue.h"
+
+/*** Globals ***/
+FLASH_OP flash_queue[FLASH_QUEUE_SIZE];
+volatile uint32_t flash_queue_head = 0;  // next free entry
+volatile uint32_t flash_queue_tail = 0;  // entry in progress
+volatile bool flash_queue_running = false;
+volatile uint32_t flash_queue_failed = 0;
+uint32_t flash_queue_reported = 0;  // failures a flush has already reported
+
+/**
+ * @brief Issue the operation at the tail of the queue, if there is one
+ *
+ * Must run from the flash interrupt or with interrupts disabled.
+ */
+static void flash_queue_start(void) {
+  FLASH_OP *op = &flash_queue[flash_queue_tail];
+
+  if (flash_queue_tail == flash_queue_head) {
+    flash_queue_running = false;
+    return;
+  }
+
+  flash_queue_running = true;
+  HWREG(FLASH_FMA) = op->addr & ~FLASH_QUEUE_ERASE;
+  if (op->addr & FLASH_QUEUE_ERASE) {
+    HWREG(FLASH_FMC) = FLASH_FMC_WRKEY | FLASH_FMC_ERASE;
+  } else {
+    HWREG(FLASH_FMD) = op->data;
+    HWREG(FLASH_FMC) = FLASH_FMC_WRKEY | FLASH_FMC_WRITE;
+  }
+}
+
+/**
+ * @brief Flash controller interrupt, retiring the finished operation
+ * and issuing the next one
+ */
+static void flash_queue_isr(void) {
+  uint32_t status = FlashIntStatus(true);
+
+  FlashIntClear(status);
+  if (!flash_queue_running) return;
+
+  if (status & FLASH_INT_ACCESS) {
+    flash_queue_failed++;
+  }
+
+  // Queued words may be secrets
+  memset(&flash_queue[flash_queue_tail], 0, sizeof(FLASH_OP));
+  flash_queue_tail = (flash_queue_tail + 1) & (FLASH_QUEUE_SIZE - 1);
+  flash_queue_start();
+}
+
+/**
+ * @brief Queue one operation, waiting for room if the queue is full
+ *
+ * @param addr [in] The address field of the operation
+ * @param data [in] The word to program
+ */
+static void flash_queue_push(uint32_t addr, uint32_t data) {
+  uint32_t next = (flash_queue_head + 1) & (FLASH_QUEUE_SIZE - 1);
+
+  while (next == flash_queue_tail);
+
+  flash_queue[flash_queue_head].addr = addr;
+  flash_queue[flash_queue_head].data = data;
+
+  IntMasterDisable();
+  flash_queue_head = next;
+  if (!flash_queue_running) {
+    flash_queue_start();
+  }
+  IntMasterEnable();
+}
+
+/**
+ * @brief Enable the flash controller interrupt which drives the queue
+ */
+void flash_queue_init(void) {
+  FlashIntClear(FLASH_INT_PROGRAM | FLASH_INT_ACCESS);
+  FlashIntRegister(flash_queue_isr);
+  FlashIntEnable(FLASH_INT_PROGRAM | FLASH_INT_ACCESS);
+  IntMasterEnable();
+}
+
+/**
+ * @brief Queue the erase of a flash page
+ *
+ * @param page [in] The address of the page
+ */
+void flash_queue_erase(uint32_t page) {
+  flash_queue_push(page | FLASH_QUEUE_ERASE, 0xFFFFFFFF);
+}
+
+/**
+ * @brief Queue words to program into erased flash
+ *
+ * The data is copied, so it may be cleared as soon as this returns.
+ *
+ * @param data [in] The words to program
+ * @param addr [in] The word-aligned flash address to program
+ * @param len  [in] The length of the data in bytes, a multiple of 4
+ */
+void flash_queue_program(const uint32_t *data, uint32_t addr, uint32_t len) {
+  uint32_t i;
+
+  for (i = 0; i < len / sizeof(uint32_t); i++) {
+    flash_queue_push(addr + i * sizeof(uint32_t), data[i]);
+  }
+}
+
+/**
+ * @brief Check whether every queued operation has finished
+ *
+ * @return true if the queue is empty, false otherwise
+ */
+bool flash_queue_idle(void) {
+  return !flash_queue_running;
+}
+
+/**
+ * @brief Wait for every queued operation to finish
+ */
+void flash_queue_wait(void) {
+  while (flash_queue_running);
+}
+
+/**
+ * @brief Count the operations the flash controller refused
+ *
+ * @return the number of failed operations since boot
+ */
+uint32_t flash_queue_errors(void) {
+  return flash_queue_failed;
+}
+
+/**
+ * @brief Wait for every queued operation to finish, at a point where the writes must be durable
+ *
+ * @return true if no operation failed since the last flush, false otherwise
+ */
+bool flash_queue_flush(void) {
+  uint32_t failed;
+
+  flash_queue_wait();
+  failed = flash_queue_failed;
+  if (failed != flash_queue_reported) {
+    flash_queue_reported = failed;
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,225 @@
+/**
+ * @file p256.c
+ * @author Spartan State Security Team
+ * @brief Supplementary P-256 scalar arithmetic not exposed by Sweet B
+ * @date 2023
+ *
+ * This source file is part of our designed system
+ * for MITRE's 2023 Embedded System CTF (eCTF).
+ *
+ * Sweet B keeps its field arithmetic private, so the few operations
+ * needed to finish a presigned ECDSA signature live here.
+ * Every function runs in constant time with respect to its operands,
+ * since they are used on nonces and private keys.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "p256.h"
+
+/*** Constants ***/
+const p256_mod_t P256_N = {
+  .m = {{ 0xFC632551, 0xF3B9CAC2, 0xA7179E84, 0xBCE6FAAD,
+          0xFFFFFFFF, 0xFFFFFFFF, 0x00000000, 0xFFFFFFFF }},
+  .m0inv = 0xEE00BC4F,
+  .r2 = {{ 0xBE79EEA2, 0x83244C95, 0x49BD6FA6, 0x4699799C,
+           0x2B6BEC59, 0x2845B239, 0xF3D95620, 0x66E12D94 }},
+};
+
+/**
+ * @brief Load a big-endian 32 byte string as an integer
+ *
+ * @param dest [out] The integer being written
+ * @param src  [in]  The big-endian bytes to load
+ */
+void p256_from_bytes(p256_int_t *dest, const uint8_t src[P256_BYTES]) {
+  uint32_t i;
+
+  for (i = 0; i < P256_WORDS; i++) {
+    const uint8_t *b = &src[P256_BYTES - 4 * (i + 1)];
+    dest->w[i] = ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) |
+                 ((uint32_t)b[2] << 8) | (uint32_t)b[3];
+  }
+}
+
+/**
+ * @brief Store an integer as a big-endian 32 byte string
+ *
+ * @param dest [out] The big-endian bytes being written
+ * @param src  [in]  The integer to store
+ */
+void p256_to_bytes(uint8_t dest[P256_BYTES], const p256_int_t *src) {
+  uint32_t i;
+
+  for (i = 0; i < P256_WORDS; i++) {
+    uint8_t *b = &dest[P256_BYTES - 4 * (i + 1)];
+    b[0] = (uint8_t)(src->w[i] >> 24);
+    b[1] = (uint8_t)(src->w[i] >> 16);
+    b[2] = (uint8_t)(src->w[i] >> 8);
+    b[3] = (uint8_t)src->w[i];
+  }
+}
+
+/**
+ * @brief Check whether an integer is zero
+ *
+ * @param a [in] The integer to check
+ *
+ * @return true if a is zero, false otherwise
+ */
+bool p256_is_zero(const p256_int_t *a) {
+  uint32_t acc = 0;
+  uint32_t i;
+
+  for (i = 0; i < P256_WORDS; i++) {
+    acc |= a->w[i];
+  }
+  return acc == 0;
+}
+
+/**
+ * @brief Subtract the modulus from a value if the value is too large
+ *
+ * @param a     [in,out] The value to reduce, below 2^256 + m
+ * @param carry [in]     The 257th bit of the value
+ * @param m     [in]     The modulus
+ */
+static void p256_cond_sub(p256_int_t *a, uint32_t carry, const p256_mod_t *m) {
+  p256_int_t d;
+  uint64_t t;
+  uint32_t borrow = 0;
+  uint32_t mask;
+  uint32_t i;
+
+  for (i = 0; i < P256_WORDS; i++) {
+    t = (uint64_t)a->w[i] - m->m.w[i] - borrow;
+    d.w[i] = (uint32_t)t;
+    borrow = (uint32_t)(t >> 32) & 1;
+  }
+
+  // Keep the difference unless it underflowed without a carry to absorb it
+  mask = (uint32_t)0 - (carry | (borrow ^ 1));
+  for (i = 0; i < P256_WORDS; i++) {
+    a->w[i] = (d.w[i] & mask) | (a->w[i] & ~mask);
+  }
+}
+
+/**
+ * @brief Reduce a 256-bit value modulo m
+ *
+ * Any 256-bit value is below 2m for the moduli used here,
+ * so a single conditional subtraction suffices.
+ *
+ * @param a [in,out] The value to reduce
+ * @param m [in]     The modulus
+ */
+void p256_mod_reduce(p256_int_t *a, const p256_mod_t *m) {
+  p256_cond_sub(a, 0, m);
+}
+
+/**
+ * @brief Compute (a + b) mod m
+ *
+ * @param dest [out] The sum
+ * @param a    [in]  The first addend, already reduced
+ * @param b    [in]  The second addend, already reduced
+ * @param m    [in]  The modulus
+ */
+void p256_mod_add(p256_int_t *dest, const p256_int_t *a, const p256_int_t *b, const p256_mod_t *m) {
+  uint64_t t = 0;
+  uint32_t i;
+
+  for (i = 0; i < P256_WORDS; i++) {
+    t = (uint64_t)a->w[i] + b->w[i] + (t >> 32);
+    dest->w[i] = (uint32_t)t;
+  }
+  p256_cond_sub(dest, (uint32_t)(t >> 32), m);
+}
+
+/**
+ * @brief Compute a * b * R^-1 mod m (Montgomery multiplication)
+ *
+ * @param dest [out] The product, may alias either input
+ * @param a    [in]  The first factor, already reduced
+ * @param b    [in]  The second factor, already reduced
+ * @param m    [in]  The modulus
+ */
+void p256_mont_mul(p256_int_t *dest, const p256_int_t *a, const p256_int_t *b, const p256_mod_t *m) {
+  uint32_t t[P256_WORDS + 2];
+  uint64_t c;
+  uint32_t q;
+  uint32_t i, j;
+
+  memset(t, 0, sizeof(t));
+
+  for (i = 0; i < P256_WORDS; i++) {
+    // t += a * b[i]
+    c = 0;
+    for (j = 0; j < P256_WORDS; j++) {
+      c = (uint64_t)a->w[j] * b->w[i] + t[j] + (c >> 32);
+      t[j] = (uint32_t)c;
+    }
+    c = (uint64_t)t[P256_WORDS] + (c >> 32);
+    t[P256_WORDS] = (uint32_t)c;
+    t[P256_WORDS + 1] = (uint32_t)(c >> 32);
+
+    // t = (t + q * m) / 2^32
+    q = t[0] * m->m0inv;
+    c = (uint64_t)q * m->m.w[0] + t[0];
+    for (j = 1; j < P256_WORDS; j++) {
+      c = (uint64_t)q * m->m.w[j] + t[j] + (c >> 32);
+      t[j - 1] = (uint32_t)c;
+    }
+    c = (uint64_t)t[P256_WORDS] + (c >> 32);
+    t[P256_WORDS - 1] = (uint32_t)c;
+    t[P256_WORDS] = t[P256_WORDS + 1] + (uint32_t)(c >> 32);
+  }
+
+  memcpy(dest->w, t, sizeof(dest->w));
+  p256_cond_sub(dest, t[P256_WORDS], m);
+}
+
+/**
+ * @brief Convert a reduced value into Montgomery form, computing a * R mod m
+ *
+ * @param dest [out] The value in Montgomery form
+ * @param a    [in]  The value to convert
+ * @param m    [in]  The modulus
+ */
+void p256_to_mont(p256_int_t *dest, const p256_int_t *a, const p256_mod_t *m) {
+  p256_mont_mul(dest, a, &m->r2, m);
+}
+
+/**
+ * @brief Invert a value in Montgomery form, computing a^-1 * R mod m
+ *
+ * Uses Fermat's little theorem. The exponent m - 2 is public,
+ * so the sequence of operations does not depend on the input.
+ *
+ * @param dest [out] The inverse in Montgomery form
+ * @param a    [in]  The nonzero value in Montgomery form
+ * @param m    [in]  The prime modulus
+ */
+void p256_mont_inv(p256_int_t *dest, const p256_int_t *a, const p256_mod_t *m) {
+  p256_int_t one = {{ 1 }};
+  p256_int_t x;
+  p256_int_t e = m->m;
+  int32_t bit;
+
+  // x = R mod m, the Montgomery form of 1
+  p256_to_mont(&x, &one, m);
+
+  // All moduli used here are odd with a low word above 2
+  e.w[0] -= 2;
+
+  for (bit = 8 * P256_BYTES - 1; bit >= 0; bit--) {
+    p256_mont_mul(&x, &x, &x, m);
+    if ((e.w[bit / 32] >> (bit % 32)) & 1) {
+      p256_mont_mul(&x, &x, a, m);
+    }
+  }
+
+  memcpy(dest, &x, sizeof(x));
+}
@@ -0,0 +1,21 @@
+/**
+ * @file secrets.c
+ * @author Spartan State Security Team
+ * @brief Compiles the secrets generated into secrets.h
+ * @date 2023
+ *
+ * This source file is part of our designed system
+ * for MITRE's 2023 Embedded System CTF (eCTF).
+ *
+ * The secrets live in their own translation unit and linker section,
+ * so no other code is specialized on their values. A fob built once
+ * with placeholder secrets can then have each fob's secrets patched
+ * into its image by patch_secrets.py, with the same result as a build
+ * from source.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "firmware.h"
+#include "secrets.h"
@@ -0,0 +1,313 @@
+/**
+ * @file store.c
+ * @author Spartan State Security Team
+ * @brief RAM mirror of the fob's persistent storage
+ * @date 2023
+ *
+ * This source file is part of our designed system
+ * for MITRE's 2023 Embedded System CTF (eCTF).
+ *
+ * The EEPROM is initialized and read once at boot,
+ * so secrets are served from RAM when signing.
+ *
+ * Fob state in flash is an append-only log of small records,
+ * replayed into RAM at boot. Changing one field programs one record.
+ * Only a full page is compacted into the other page, whose header
+ * is programmed last, its magic after its generation, so that a reset
+ * mid-way leaves the old page active.
+ * Writes go through the background flash queue, and the RAM copy is
+ * updated as soon as they are queued, so readers never wait on flash.
+ * store_flush() waits for them when the host must know they are durable.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "driverlib/eeprom.h"
+#include "driverlib/sysctl.h"
+
+#include "flash_queue.h"
+#include "store.h"
+#include "firmware.h"
+
+/*** Globals ***/
+FOB_DATA eeprom_data;
+bool STORE_VALID = false;
+
+// Fob state replayed from the flash log
+FOB_DATA fob_data;
+uint32_t fob_page = 0;        // active page, or 0 before the first record
+uint32_t fob_generation = 0;
+uint32_t fob_next_record = 0; // first free slot in the active page
+
+/**
+ * @brief Find a record slot of a log page
+ *
+ * @param page [in] The address of the page
+ * @param slot [in] The index of the slot
+ *
+ * @return the record stored in the slot
+ */
+static const FOB_RECORD *fob_record(uint32_t page, uint32_t slot) {
+  return (const FOB_RECORD *)(page + sizeof(FOB_STORE_HEADER) + slot * sizeof(FOB_RECORD));
+}
+
+/**
+ * @brief Check whether a run of flash is still erased
+ *
+ * @param addr [in] The address of the run
+ * @param size [in] The length of the run in bytes
+ *
+ * @return true if every word reads 0xFFFFFFFF, false otherwise
+ */
+static bool fob_erased(uint32_t addr, uint32_t size) {
+  const uint32_t *words = (const uint32_t *)addr;
+  uint32_t i;
+
+  for (i = 0; i < size / sizeof(uint32_t); i++) {
+    if (words[i] != 0xFFFFFFFF) return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Apply one record to the fob state in RAM
+ *
+ * @param tag  [in] The tag of the record
+ * @param data [in] The body of the record
+ */
+static void fob_apply(uint32_t tag, const uint8_t *data) {
+  const FOB_PAIRING *pairing = (const FOB_PAIRING *)data;
+  uint32_t idx = tag & 0xFF;
+
+  if (tag == FOB_RECORD_PAIRING) {
+    fob_data.paired = YES_PAIRED;
+    fob_data.pin = pairing->pin;
+    memcpy(&fob_data.car_privkey, &pairing->car_privkey, sizeof(sb_sw_private_t));
+  } else if ((tag & ~0xFF) == FOB_RECORD_FEATURE && idx < NUM_FEATURES) {
+    memcpy(&fob_data.feature[idx], data, sizeof(PACKAGE));
+  }
+}
+
+/**
+ * @brief Rebuild the fob state in RAM from the active log page
+ *
+ * Erased flash stands for the default state, an unpaired fob with no features.
+ */
+static void fob_replay(void) {
+  const FOB_STORE_HEADER *a = (const FOB_STORE_HEADER *)FOB_STORE_PAGE_A;
+  const FOB_STORE_HEADER *b = (const FOB_STORE_HEADER *)FOB_STORE_PAGE_B;
+  const FOB_RECORD *record;
+  uint32_t slot;
+
+  memset(&fob_data, 0xFF, sizeof(fob_data));
+  fob_page = 0;
+  fob_generation = 0;
+  fob_next_record = 0;
+
+  // The active page is the completed page of the newest generation,
+  // an erased generation never being one a compaction wrote
+  if (a->magic == FOB_STORE_MAGIC && a->generation != FOB_STORE_ERASED) {
+    fob_page = FOB_STORE_PAGE_A;
+    fob_generation = a->generation;
+  }
+  if (b->magic == FOB_STORE_MAGIC && b->generation != FOB_STORE_ERASED &&
+      (!fob_page || b->generation > fob_generation)) {
+    fob_page = FOB_STORE_PAGE_B;
+    fob_generation = b->generation;
+  }
+  if (!fob_page) return;
+
+  for (slot = 0; slot < FOB_RECORDS_PER_PAGE; slot++) {
+    record = fob_record(fob_page, slot);
+    if (!fob_erased((uint32_t)record, sizeof(FOB_RECORD))) {
+      // Records cut short by a reset are skipped, but their slot stays used
+      if (record->commit == FOB_RECORD_COMMIT) {
+        fob_apply(record->tag, record->data);
+      }
+      fob_next_record = slot + 1;
+    }
+  }
+}
+
+/**
+ * @brief Queue a record, then its commit word
+ *
+ * @param page [in] The address of the page
+ * @param slot [in] The index of a free slot
+ * @param tag  [in] The tag of the record
+ * @param data [in] The body of the record
+ * @param len  [in] The length of the body, a multiple of 4
+ *
+ * @return true once the record is queued, false if a flash operation failed meanwhile
+ */
+static bool fob_program(uint32_t page, uint32_t slot, uint32_t tag, const void *data, uint32_t len) {
+  FOB_RECORD record;
+  uint32_t addr = (uint32_t)fob_record(page, slot);
+  uint32_t errors = flash_queue_errors();
+
+  memset(&record, 0xFF, sizeof(record));
+  record.tag = tag;
+  memcpy(record.data, data, len);
+  record.commit = FOB_RECORD_COMMIT;
+
+  flash_queue_program((uint32_t *)&record, addr, sizeof(record) - sizeof(record.commit));
+  flash_queue_program(&record.commit, addr + offsetof(FOB_RECORD, commit), sizeof(record.commit));
+
+  memset(&record, 0, sizeof(record));
+
+  // Queueing waits for room while earlier operations finish, and those may have failed
+  return flash_queue_errors() == errors;
+}
+
+/**
+ * @brief Start a new log page holding only the current fob state
+ *
+ * The header is programmed last, so until its magic is the old page stays active.
+ *
+ * @return true once the new page is queued, false if an error occurs
+ */
+static bool fob_compact(void) {
+  FOB_STORE_HEADER header;
+  FOB_PAIRING pairing;
+  uint32_t page = fob_page == FOB_STORE_PAGE_A ? FOB_STORE_PAGE_B : FOB_STORE_PAGE_A;
+  uint32_t slot = 0;
+  uint32_t i;
+  bool ok = true;
+
+  if (!fob_erased(page, FOB_STORE_PAGE_SIZE)) {
+    flash_queue_erase(page);
+  }
+
+  if (fob_data.paired == YES_PAIRED) {
+    pairing.pin = fob_data.pin;
+    memcpy(&pairing.car_privkey, &fob_data.car_privkey, sizeof(sb_sw_private_t));
+    ok = fob_program(page, slot++, FOB_RECORD_PAIRING, &pairing, sizeof(pairing));
+    memset(&pairing, 0, sizeof(pairing));
+  }
+  for (i = 0; ok && i < NUM_FEATURES; i++) {
+    if (feature_enabled(&fob_data.feature[i])) {
+      ok = fob_program(page, slot++, FOB_RECORD_FEATURE | i, &fob_data.feature[i], sizeof(PACKAGE));
+    }
+  }
+
+  header.magic = FOB_STORE_MAGIC;
+  header.generation = fob_generation + 1;
+  if (!ok) return false;
+
+  // The magic completes the page, so it goes last: a reset before it leaves the page unused
+  flash_queue_program(&header.generation, page + offsetof(FOB_STORE_HEADER, generation), sizeof(header.generation));
+  flash_queue_program(&header.magic, page + offsetof(FOB_STORE_HEADER, magic), sizeof(header.magic));
+
+  fob_page = page;
+  fob_generation = header.generation;
+  fob_next_record = slot;
+  return true;
+}
+
+/**
+ * @brief Append a record to the log and apply it to the fob state in RAM
+ *
+ * @param tag  [in] The tag of the record
+ * @param data [in] The body of the record
+ * @param len  [in] The length of the body, a multiple of 4
+ *
+ * @return true once the record is queued, false if an error occurs
+ */
+static bool fob_append(uint32_t tag, const void *data, uint32_t len) {
+  // Compact first when there is no room, or no page yet
+  if (!fob_page || fob_next_record >= FOB_RECORDS_PER_PAGE) {
+    if (!fob_compact()) return false;
+  }
+
+  if (!fob_program(fob_page, fob_next_record, tag, data, len)) return false;
+  fob_next_record++;
+
+  fob_apply(tag, (const uint8_t *)data);
+  return true;
+}
+
+/**
+ * @brief Initialize the EEPROM and mirror its contents into RAM,
+ * then rebuild the fob state from the flash log.
+ *
+ * @return true if operation succeeds, false if an eeprom error occurs
+ */
+bool store_init(void) {
+  STORE_VALID = false;
+
+  // Rebuild Fob State from the flash log, and start the write queue
+  fob_replay();
+  flash_queue_init();
+
+  // Ensure EEPROM peripheral is enabled
+  SysCtlPeripheralEnable(SYSCTL_PERIPH_EEPROM0);
+  if(EEPROMInit() != EEPROM_INIT_OK) return false;
+
+  // Mirror Fob Data
+  EEPROMRead((uint32_t *)&eeprom_data, 0, sizeof(FOB_DATA));
+
+  STORE_VALID = true;
+  return true;
+}
+
+/**
+ * @brief Get the fob data mirrored from EEPROM
+ *
+ * @return the fob data, or NULL if an eeprom error occurred
+ */
+const FOB_DATA *store_eeprom_data(void) {
+  return STORE_VALID ? &eeprom_data : NULL;
+}
+
+/**
+ * @brief Get the fob state replayed from the flash log
+ *
+ * @return the fob state
+ */
+const FOB_DATA *store_fob_data(void) {
+  return &fob_data;
+}
+
+/**
+ * @brief Record that this fob is now paired
+ *
+ * @param car_privkey [in] The car private key received from the paired fob
+ * @param pin         [in] The pairing pin received from the paired fob
+ *
+ * @return true if the pairing was queued for flash, false otherwise
+ */
+bool store_save_pairing(const sb_sw_private_t *car_privkey, uint32_t pin) {
+  FOB_PAIRING pairing;
+  bool ok;
+
+  pairing.pin = pin;
+  memcpy(&pairing.car_privkey, car_privkey, sizeof(sb_sw_private_t));
+  ok = fob_append(FOB_RECORD_PAIRING, &pairing, sizeof(pairing));
+  memset(&pairing, 0, sizeof(pairing));
+  return ok;
+}
+
+/**
+ * @brief Record a newly enabled feature package
+ *
+ * @param feature_idx [in] The index of the feature, starting at 0
+ * @param package     [in] The feature package
+ *
+ * @return true if the package was queued for flash, false otherwise
+ */
+bool store_save_feature(uint32_t feature_idx, const PACKAGE *package) {
+  if (feature_idx >= NUM_FEATURES) return false;
+  return fob_append(FOB_RECORD_FEATURE | feature_idx, package, sizeof(PACKAGE));
+}
+
+/**
+ * @brief Wait until every queued record has reached flash
+ *
+ * @return true if all flash operations since the last flush succeeded, false otherwise
+ */
+bool store_flush(void) {
+  return flash_queue_flush();
+}
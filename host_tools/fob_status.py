@@ -0,0 +1,59 @@
+# @file fob_status.py
+# @author Spartan State Security Team
+# @brief status frames the fob answers host commands with, shared by the host tools
+# @date 2023
+#
+#  This source file is part of our designed system
+#  for MITRE's 2023 Embedded System CTF (eCTF).
+#
+#  Imported by enable_tool and pair_tool, and copied next to them.
+
+import socket
+import time
+
+# Status frame a fob sends once a host command finishes, must match fob firmware.h
+STATUS_START = 0x5E
+STATUS_OK = 0x00
+STATUS_MESSAGES = {
+    0x01: "rejected by the fob",
+    0x02: "wrong pairing PIN",
+    0x03: "could not be stored on the fob",
+}
+
+
+# @brief Function to wait for the status frame of a fob command
+# @param sock, socket bridged to the fob
+# @param cmd, the command byte the frame answers
+# @param timeout, seconds to wait for the frame
+# @return the status code, or None if no frame arrived in time
+def wait_status(sock, cmd, timeout):
+    deadline = time.monotonic() + timeout
+    frame = b""
+    while True:
+        # Skip anything before the start of a frame
+        start = frame.find(bytes([STATUS_START]))
+        frame = frame[start:] if start >= 0 else b""
+        if len(frame) >= 3:
+            if frame[1] == cmd:
+                return frame[2]
+            frame = frame[1:]
+            continue
+
+        remaining = deadline - time.monotonic()
+        if remaining <= 0:
+            return None
+        sock.settimeout(remaining)
+        try:
+            data = sock.recv(64)
+        except socket.timeout:
+            return None
+        if not data:
+            return None
+        frame += data
+
+
+# @brief Function to describe a status code
+# @param status, the status code
+# @return the reason the command failed
+def status_message(status):
+    return STATUS_MESSAGES.get(status, hex(status))
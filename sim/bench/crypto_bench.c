@@ -0,0 +1,220 @@
+/**
+ * @file crypto_bench.c
+ * @author Spartan State Security Team
+ * @brief Times the signature and hash operations the car and fob depend on
+ * @date 2023
+ *
+ * This source file is part of our designed system
+ * for MITRE's 2023 Embedded System CTF (eCTF).
+ *
+ * Built once per Sweet B configuration by `make -C sim crypto_bench`,
+ * and run natively or under qemu-arm. Each operation is repeated and
+ * its mean and fastest time printed as one JSON object, with the
+ * inputs sized as the firmware uses them. Times are nanoseconds of the
+ * host's CLOCK_MONOTONIC, not board cycles.
+ *
+ * Signing, hashing and the DRBG are Sweet B's. Verification is timed
+ * on the car's own path instead, p256_verify_comb for the unlock
+ * signature alone and p256_verify_batch for the feature packages
+ * together with it, linked with the test car's secrets and checked
+ * against the known answers vectors.py computed for them. It does not
+ * use Sweet B, so it takes the same time in every configuration.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sb_all.h"
+
+#include "p256.h"
+#include "firmware.h"
+#include "vectors.h"
+
+/*** Macro Definitions ***/
+// Input sizes used by the firmware
+#define ENTROPY_SIZE 0x400
+#define CHALLENGE_SIZE 64
+
+#define DEFAULT_ITERATIONS 200
+
+// Fast operations repeat this many times more than signing and verifying
+#define FAST_FACTOR 50
+
+/*** Structure definitions ***/
+// Defines the timing of one operation in host nanoseconds
+typedef struct {
+  const char *name;
+  uint64_t total;
+  uint64_t min;
+  uint32_t count;
+} TIMING;
+
+/*** Globals ***/
+sb_sw_context_t ctx;
+sb_hmac_drbg_state_t drbg;
+sb_sha256_state_t sha;
+
+uint8_t entropy[ENTROPY_SIZE];
+uint8_t challenge[CHALLENGE_SIZE];
+sb_sw_private_t priv;
+sb_sw_public_t pub;
+sb_sw_message_digest_t digest;
+sb_sw_signature_t signature;
+
+/**
+ * @brief Read the monotonic clock
+ *
+ * @return the current time in nanoseconds
+ */
+uint64_t now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Record one timed run of an operation
+ *
+ * @param timing [in,out] The timing to update
+ * @param start  [in]     When the run started
+ */
+void record(TIMING *timing, uint64_t start) {
+  uint64_t elapsed = now_ns() - start;
+
+  timing->total += elapsed;
+  if (timing->count == 0 || elapsed < timing->min) {
+    timing->min = elapsed;
+  }
+  timing->count++;
+}
+
+/**
+ * @brief Seed the DRBG as the firmware does on boot
+ *
+ * @return SB_SUCCESS on success, a Sweet B error otherwise
+ */
+sb_error_t seed_drbg(void) {
+  uint32_t tick = 0;
+
+  return sb_hmac_drbg_init(&drbg, entropy, sizeof(entropy), pub.bytes, sizeof(pub),
+                           (sb_byte_t *)&tick, sizeof(tick));
+}
+
+/**
+ * @brief Print a timing as a member of the JSON result
+ *
+ * @param timing [in] The timing to print
+ * @param last   [in] Whether it is the last member
+ */
+void print_timing(const TIMING *timing, int last) {
+  printf("  \"%s\": {\"runs\": %u, \"mean_ns\": %llu, \"min_ns\": %llu}%s\n", timing->name,
+         timing->count, (unsigned long long)(timing->total / timing->count),
+         (unsigned long long)timing->min, last ? "" : ",");
+}
+
+/**
+ * @brief Main function for the crypto benchmark
+ *
+ * Takes an optional iteration count for signing and verifying.
+ */
+int main(int argc, char **argv) {
+  TIMING sign = { "sign" }, verify = { "verify" }, batch = { "verify_batch" }, sha256 = { "sha256" };
+  TIMING generate = { "drbg_generate" }, init = { "drbg_init" };
+  uint32_t iterations = argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 0) : DEFAULT_ITERATIONS;
+  p256_verify_job_t jobs[NUM_FEATURES + 1];
+  uint64_t weights[NUM_FEATURES];
+  uint64_t start;
+  uint32_t i;
+
+  if (iterations == 0) {
+    fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+    return 1;
+  }
+
+  // Fixed inputs, so every configuration does the same work
+  for (i = 0; i < sizeof(entropy); i++) {
+    entropy[i] = (uint8_t)(i * 7 + 1);
+  }
+  for (i = 0; i < sizeof(challenge); i++) {
+    challenge[i] = (uint8_t)(i * 13 + 5);
+  }
+
+  if (seed_drbg() != SB_SUCCESS ||
+      sb_sw_generate_private_key(&ctx, &priv, &drbg, SB_SW_CURVE_P256) != SB_SUCCESS ||
+      sb_sw_compute_public_key(&ctx, &pub, &priv, &drbg, SB_SW_CURVE_P256,
+                               SB_DATA_ENDIAN_BIG) != SB_SUCCESS) {
+    fprintf(stderr, "key generation failed\n");
+    return 1;
+  }
+  sb_sha256_message(&sha, digest.bytes, challenge, sizeof(challenge));
+
+  // Every feature package, then the unlock signature, verified in one batch
+  for (i = 0; i < NUM_FEATURES; i++) {
+    jobs[i] = (p256_verify_job_t){ FEATURE_PACKAGES[i], DEVICE_SECRETS.feature_digest[i].bytes,
+                                   DEVICE_SECRETS.host_pubkey_comb };
+    weights[i] = 0x9E3779B97F4A7C15 * (i + 1);
+  }
+  jobs[NUM_FEATURES] = (p256_verify_job_t){ UNLOCK_SIGNATURE, UNLOCK_DIGEST, DEVICE_SECRETS.car_pubkey_comb };
+
+  for (i = 0; i < iterations; i++) {
+    start = now_ns();
+    if (sb_sw_sign_message_digest(&ctx, &signature, &priv, &digest, &drbg, SB_SW_CURVE_P256,
+                                  SB_DATA_ENDIAN_BIG) != SB_SUCCESS) {
+      fprintf(stderr, "sign failed\n");
+      return 1;
+    }
+    record(&sign, start);
+
+    start = now_ns();
+    if (!p256_verify_comb(UNLOCK_SIGNATURE, UNLOCK_DIGEST, P256_G_COMB, DEVICE_SECRETS.car_pubkey_comb)) {
+      fprintf(stderr, "verify failed\n");
+      return 1;
+    }
+    record(&verify, start);
+
+    start = now_ns();
+    if (!p256_verify_batch(jobs, weights, NUM_FEATURES + 1, P256_G_COMB)) {
+      fprintf(stderr, "verify batch failed\n");
+      return 1;
+    }
+    record(&batch, start);
+  }
+
+  for (i = 0; i < iterations * FAST_FACTOR; i++) {
+    start = now_ns();
+    sb_sha256_message(&sha, digest.bytes, challenge, sizeof(challenge));
+    record(&sha256, start);
+
+    start = now_ns();
+    if (seed_drbg() != SB_SUCCESS) {
+      fprintf(stderr, "drbg init failed\n");
+      return 1;
+    }
+    record(&init, start);
+
+    // Freshly seeded each time, so no reseed is ever required
+    start = now_ns();
+    if (sb_hmac_drbg_generate(&drbg, challenge, sizeof(challenge)) != SB_SUCCESS) {
+      fprintf(stderr, "drbg generate failed\n");
+      return 1;
+    }
+    record(&generate, start);
+  }
+
+  printf("{\n");
+  print_timing(&sign, 0);
+  print_timing(&verify, 0);
+  print_timing(&batch, 0);
+  print_timing(&sha256, 0);
+  print_timing(&generate, 0);
+  print_timing(&init, 1);
+  printf("}\n");
+
+  return 0;
+}
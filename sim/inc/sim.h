@@ -0,0 +1,56 @@
+/**
+ * @file sim.h
+ * @author Spartan State Security Team
+ * @brief File that defines the internals of the host simulation of the boards
+ * @date 2023
+ *
+ * This source file is part of our designed system
+ * for MITRE's 2023 Embedded System CTF (eCTF).
+ */
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*** Macro Definitions ***/
+// Clock the firmware believes it runs at, must match SPEED in firmware.h
+#define SIM_SPEED 80000000
+
+// Interval between simulated interrupts, in microseconds
+#define SIM_TICK_US 50
+
+// Part of flash backed by the flash file, which must hold every page the firmware stores to
+#define SIM_FLASH_BASE 0x20000
+#define SIM_FLASH_END 0x40000
+#define SIM_FLASH_PAGE_SIZE 0x400
+
+// Size of the EEPROM, in bytes
+#define SIM_EEPROM_SIZE 0x800
+
+// Depth of the hardware UART FIFOs
+#define SIM_UART_FIFO_SIZE 16
+
+// Value held by NVIC_ST_CURRENT until the firmware writes to it
+#define SIM_ST_CURRENT_IDLE 0xFFFFFFFF
+
+/*** Globals ***/
+// Set while simulated interrupts are being delivered
+extern volatile bool sim_in_isr;
+
+/*** Function declarations ***/
+// Core Functions
+void sim_lock(void);
+void sim_unlock(void);
+uint64_t sim_cycles(void);
+void sim_sleep_cycles(uint64_t cycles);
+const char *sim_config(const char *name, const char *fallback);
+
+// Peripheral Functions
+void sim_flash_setup(void);
+void sim_flash_tick(void);
+void sim_uart_setup(void);
+void sim_uart_tick(void);
+
+#endif // SIM_H
@@ -0,0 +1,353 @@
+/**
+ * @file sim_core.c
+ * @author Spartan State Security Team
+ * @brief Host simulation of the processor core, SysTick, GPIO and clocking
+ * @date 2023
+ *
+ * This source file is part of our designed system
+ * for MITRE's 2023 Embedded System CTF (eCTF).
+ *
+ * The firmware sources are compiled for Linux unchanged and linked
+ * against these stand-ins for the TivaWare driver library.
+ * Interrupts are a SIGALRM raised every SIM_TICK_US, whose handler
+ * moves bytes, finishes flash operations and calls the registered
+ * interrupt handlers. Masking interrupts blocks the signal, so the
+ * firmware's busy waits on interrupt-set flags behave as on the board.
+ *
+ * Registers the firmware touches directly through HWREG are ordinary
+ * memory pages mapped at their hardware addresses, as is the flash.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "inc/hw_memmap.h"
+#include "inc/hw_nvic.h"
+#include "inc/hw_types.h"
+#include "driverlib/gpio.h"
+#include "driverlib/interrupt.h"
+#include "driverlib/sysctl.h"
+#include "driverlib/systick.h"
+
+#include "sim.h"
+
+/*** Macro Definitions ***/
+// Data watchpoint and trace unit, used by the unlock profiler
+#define SIM_DWT_BASE 0xE0001000
+#define SIM_DWT_CYCCNT 0xE0001004
+
+// How long SIGUSR1 holds SW1 down, in cycles
+#define SIM_BUTTON_CYCLES (SIM_SPEED / 10)
+
+/*** Globals ***/
+volatile bool sim_in_isr = false;
+
+// Signals masked while the firmware has interrupts disabled
+static sigset_t sim_tick_set;
+static uint32_t sim_lock_depth = 0;
+static volatile bool sim_int_disabled = false;
+
+// Host time at power on
+static struct timespec sim_boot;
+
+// SysTick state
+static uint32_t systick_period = 0x1000000;
+static uint64_t systick_epoch = 0;
+static uint32_t systick_frozen = 0;
+static bool systick_enabled = false;
+
+// Cycle until which SW1 reads as pressed
+static volatile uint64_t sim_button_until = 0;
+
+// Last value written to each LED
+static uint8_t sim_leds = 0;
+
+/**
+ * @brief Reports a fatal simulation error and exits
+ *
+ * @param what [in] What failed
+ */
+static void sim_fail(const char *what) {
+  perror(what);
+  exit(1);
+}
+
+/**
+ * @brief Look up a simulation setting in the environment
+ *
+ * @param name     [in] The environment variable
+ * @param fallback [in] The value to use if it is not set
+ *
+ * @return the setting
+ */
+const char *sim_config(const char *name, const char *fallback) {
+  const char *value = getenv(name);
+  return value ? value : fallback;
+}
+
+/**
+ * @brief Count the cycles of the simulated clock since power on
+ *
+ * Safe to call from the interrupt signal.
+ *
+ * @return the cycle count
+ */
+uint64_t sim_cycles(void) {
+  struct timespec now;
+  uint64_t ns;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  ns = (uint64_t)(now.tv_sec - sim_boot.tv_sec) * 1000000000ull + now.tv_nsec - sim_boot.tv_nsec;
+  return ns * (SIM_SPEED / 1000000) / 1000;
+}
+
+/**
+ * @brief Let a number of cycles of the simulated clock pass,
+ * taking interrupts meanwhile
+ *
+ * @param cycles [in] The cycles to wait
+ */
+void sim_sleep_cycles(uint64_t cycles) {
+  struct timespec until;
+  uint64_t ns = cycles * 1000 / (SIM_SPEED / 1000000);
+
+  clock_gettime(CLOCK_MONOTONIC, &until);
+  until.tv_sec += ns / 1000000000ull;
+  until.tv_nsec += ns % 1000000000ull;
+  if (until.tv_nsec >= 1000000000) {
+    until.tv_sec++;
+    until.tv_nsec -= 1000000000;
+  }
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) == EINTR);
+}
+
+/**
+ * @brief Hold off simulated interrupts while simulated hardware state changes
+ *
+ * Calls nest, and do nothing from within an interrupt.
+ */
+void sim_lock(void) {
+  if (sim_in_isr) return;
+  if (sim_lock_depth++ == 0) {
+    sigprocmask(SIG_BLOCK, &sim_tick_set, NULL);
+  }
+}
+
+/**
+ * @brief Undo one sim_lock, taking interrupts again unless the firmware masked them
+ */
+void sim_unlock(void) {
+  if (sim_in_isr) return;
+  if (--sim_lock_depth == 0 && !sim_int_disabled) {
+    sigprocmask(SIG_UNBLOCK, &sim_tick_set, NULL);
+  }
+}
+
+/**
+ * @brief Deliver one round of simulated interrupts
+ *
+ * @param sig [in] The signal being handled
+ */
+static void sim_tick(int sig) {
+  int saved_errno = errno;
+
+  sim_in_isr = true;
+  HWREG(SIM_DWT_CYCCNT) = (uint32_t)sim_cycles();
+  sim_flash_tick();
+  sim_uart_tick();
+  sim_in_isr = false;
+
+  errno = saved_errno;
+}
+
+/**
+ * @brief Press SW1 for a moment
+ *
+ * @param sig [in] The signal being handled
+ */
+static void sim_press(int sig) {
+  sim_button_until = sim_cycles() + SIM_BUTTON_CYCLES;
+}
+
+/**
+ * @brief Map zeroed memory at a fixed address, standing in for registers
+ *
+ * @param addr [in] The page-aligned address
+ * @param len  [in] The length of the mapping
+ */
+static void sim_map_registers(uint32_t addr, uint32_t len) {
+  void *want = (void *)(uintptr_t)addr;
+
+  if (mmap(want, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE,
+           -1, 0) != want) {
+    sim_fail("sim: mapping registers");
+  }
+}
+
+/**
+ * @brief Power on the simulated board before the firmware's main runs
+ */
+__attribute__((constructor)) static void sim_setup(void) {
+  struct sigaction sa = { 0 };
+  struct itimerval tick = { { 0, SIM_TICK_US }, { 0, SIM_TICK_US } };
+
+  clock_gettime(CLOCK_MONOTONIC, &sim_boot);
+
+  // System control space (SysTick, NVIC, debug) and the DWT unit
+  sim_map_registers(0xE000E000, 0x1000);
+  sim_map_registers(SIM_DWT_BASE, 0x1000);
+  HWREG(NVIC_ST_CURRENT) = SIM_ST_CURRENT_IDLE;
+
+  sim_flash_setup();
+  sim_uart_setup();
+
+  sigemptyset(&sim_tick_set);
+  sigaddset(&sim_tick_set, SIGALRM);
+
+  sa.sa_handler = sim_press;
+  sa.sa_flags = SA_RESTART;
+  if (sigaction(SIGUSR1, &sa, NULL)) sim_fail("sim: SIGUSR1");
+
+  sa.sa_handler = sim_tick;
+  sa.sa_mask = sim_tick_set;
+  if (sigaction(SIGALRM, &sa, NULL)) sim_fail("sim: SIGALRM");
+  if (setitimer(ITIMER_REAL, &tick, NULL)) sim_fail("sim: setitimer");
+}
+
+/*** Interrupt controller ***/
+
+bool IntMasterEnable(void) {
+  bool was_disabled = sim_int_disabled;
+
+  sim_int_disabled = false;
+  if (!sim_in_isr && sim_lock_depth == 0) {
+    sigprocmask(SIG_UNBLOCK, &sim_tick_set, NULL);
+  }
+  return was_disabled;
+}
+
+bool IntMasterDisable(void) {
+  bool was_disabled = sim_int_disabled;
+
+  if (!sim_in_isr) {
+    sigprocmask(SIG_BLOCK, &sim_tick_set, NULL);
+  }
+  sim_int_disabled = true;
+  return was_disabled;
+}
+
+/*** System control ***/
+
+void SysCtlClockSet(uint32_t ui32Config) {
+}
+
+void SysCtlPeripheralEnable(uint32_t ui32Peripheral) {
+}
+
+bool SysCtlPeripheralReady(uint32_t ui32Peripheral) {
+  return true;
+}
+
+void SysCtlDelay(uint32_t ui32Count) {
+  // Each loop of the real delay takes 3 cycles
+  sim_sleep_cycles((uint64_t)ui32Count * 3);
+}
+
+/*** SysTick ***/
+
+/**
+ * @brief Restart the count if the firmware wrote NVIC_ST_CURRENT
+ *
+ * @param now [in] The current cycle count
+ */
+static void systick_check_clear(uint64_t now) {
+  if (HWREG(NVIC_ST_CURRENT) != SIM_ST_CURRENT_IDLE) {
+    HWREG(NVIC_ST_CURRENT) = SIM_ST_CURRENT_IDLE;
+    systick_epoch = now;
+  }
+}
+
+void SysTickPeriodSet(uint32_t ui32Period) {
+  sim_lock();
+  systick_period = ui32Period;
+  sim_unlock();
+}
+
+void SysTickEnable(void) {
+  sim_lock();
+  if (!systick_enabled) {
+    systick_epoch = sim_cycles() - (systick_period - 1 - systick_frozen);
+  }
+  systick_enabled = true;
+  sim_unlock();
+}
+
+void SysTickDisable(void) {
+  sim_lock();
+  systick_frozen = SysTickValueGet();
+  systick_enabled = false;
+  sim_unlock();
+}
+
+uint32_t SysTickValueGet(void) {
+  uint64_t now = sim_cycles();
+  uint32_t value;
+
+  sim_lock();
+  systick_check_clear(now);
+  if (systick_enabled) {
+    value = systick_period - 1 - (uint32_t)((now - systick_epoch) % systick_period);
+  } else {
+    value = systick_frozen;
+  }
+  sim_unlock();
+  return value;
+}
+
+/*** GPIO ***/
+
+void GPIOPinConfigure(uint32_t ui32PinConfig) {
+}
+
+void GPIOPinTypeUART(uint32_t ui32Port, uint8_t ui8Pins) {
+}
+
+void GPIOPinTypeGPIOInput(uint32_t ui32Port, uint8_t ui8Pins) {
+}
+
+void GPIOPadConfigSet(uint32_t ui32Port, uint8_t ui8Pins, uint32_t ui32Strength,
+                      uint32_t ui32PadType) {
+}
+
+int32_t GPIOPinRead(uint32_t ui32Port, uint8_t ui8Pins) {
+  // SW1 is on PF4 with a pull-up, reading 0 while pressed
+  if (ui32Port == GPIO_PORTF_BASE && sim_cycles() >= sim_button_until) {
+    return ui8Pins & GPIO_PIN_4;
+  }
+  return 0;
+}
+
+void GPIOPinWrite(uint32_t ui32Port, uint8_t ui8Pins, uint8_t ui8Val) {
+  static const char *const names[] = { "red", "blue", "green" };
+  uint8_t leds;
+  uint32_t i;
+
+  if (ui32Port != GPIO_PORTF_BASE) return;
+
+  leds = (sim_leds & ~ui8Pins) | (ui8Val & ui8Pins);
+  for (i = 0; i < 3; i++) {
+    if ((leds ^ sim_leds) & (GPIO_PIN_1 << i)) {
+      fprintf(stderr, "sim: %s LED %s\n", names[i], (leds & (GPIO_PIN_1 << i)) ? "on" : "off");
+    }
+  }
+  sim_leds = leds;
+}
@@ -0,0 +1,245 @@
+/**
+ * @file sim_flash.c
+ * @author Spartan State Security Team
+ * @brief Host simulation of the flash controller and EEPROM
+ * @date 2023
+ *
+ * This source file is part of our designed system
+ * for MITRE's 2023 Embedded System CTF (eCTF).
+ *
+ * The flash file is mapped at SIM_FLASH_BASE, so the firmware reads
+ * its stores through ordinary pointers just as on the board. Programming
+ * can only clear bits, and erasing sets a whole page back to 0xFF.
+ * Operations started through the FMA/FMD/FMC registers complete on
+ * the next simulated interrupt, which then raises the flash interrupt.
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "inc/hw_flash.h"
+#include "inc/hw_types.h"
+#include "driverlib/eeprom.h"
+#include "driverlib/flash.h"
+
+#include "sim.h"
+
+/*** Globals ***/
+// Handler registered for the flash interrupt
+static void (*flash_handler)(void) = NULL;
+
+// File backing the EEPROM, or -1 if none was given
+static int eeprom_fd = -1;
+
+/**
+ * @brief Open a backing file, creating it filled with 0xFF if it is missing
+ *
+ * @param path [in] The path of the file
+ * @param size [in] The size the file must have
+ *
+ * @return the open file
+ */
+static int sim_backing_file(const char *path, uint32_t size) {
+  uint8_t blank[SIM_FLASH_PAGE_SIZE];
+  struct stat st;
+  uint32_t at;
+  int fd;
+
+  fd = open(path, O_RDWR | O_CREAT, 0644);
+  if (fd < 0 || fstat(fd, &st)) {
+    perror(path);
+    exit(1);
+  }
+
+  memset(blank, 0xFF, sizeof(blank));
+  for (at = (uint32_t)st.st_size; at < size; at += sizeof(blank)) {
+    if (pwrite(fd, blank, size - at < sizeof(blank) ? size - at : sizeof(blank), at) < 0) {
+      perror(path);
+      exit(1);
+    }
+  }
+  return fd;
+}
+
+/**
+ * @brief Map the flash file and the flash controller registers
+ *
+ * The flash file holds the whole part of flash from SIM_FLASH_BASE
+ * to SIM_FLASH_END. Without SIM_FLASH the contents start erased
+ * and are lost at exit.
+ */
+void sim_flash_setup(void) {
+  const char *path = sim_config("SIM_FLASH", NULL);
+  void *want = (void *)(uintptr_t)SIM_FLASH_BASE;
+  uint32_t size = SIM_FLASH_END - SIM_FLASH_BASE;
+  void *flash;
+  int fd;
+
+  if (path) {
+    fd = sim_backing_file(path, size);
+    flash = mmap(want, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED_NOREPLACE, fd, 0);
+    close(fd);
+  } else {
+    flash = mmap(want, size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    if (flash == want) memset(flash, 0xFF, size);
+  }
+
+  if (flash != want ||
+      mmap((void *)(uintptr_t)FLASH_FMA, 0x1000, PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0) != (void *)(uintptr_t)FLASH_FMA) {
+    perror("sim: mapping flash");
+    exit(1);
+  }
+
+  // The EEPROM image is used as deployed, without padding it out
+  path = sim_config("SIM_EEPROM", NULL);
+  if (path) {
+    eeprom_fd = open(path, O_RDWR);
+    if (eeprom_fd < 0) {
+      perror(path);
+      exit(1);
+    }
+  }
+}
+
+/**
+ * @brief Check that a flash operation stays within the simulated flash
+ *
+ * @param addr [in] The first address
+ * @param len  [in] The length in bytes
+ *
+ * @return true if every address is backed, false otherwise
+ */
+static bool flash_in_range(uint32_t addr, uint32_t len) {
+  return addr >= SIM_FLASH_BASE && addr <= SIM_FLASH_END && len <= SIM_FLASH_END - addr;
+}
+
+/**
+ * @brief Program one word, which can only clear bits
+ *
+ * @param addr [in] The word-aligned address
+ * @param data [in] The word to program
+ *
+ * @return true if the word is backed, false otherwise
+ */
+static bool flash_program_word(uint32_t addr, uint32_t data) {
+  if ((addr & 3) || !flash_in_range(addr, sizeof(uint32_t))) return false;
+  *(volatile uint32_t *)(uintptr_t)addr &= data;
+  return true;
+}
+
+/**
+ * @brief Erase one page back to 0xFF
+ *
+ * @param addr [in] The page-aligned address
+ *
+ * @return true if the page is backed, false otherwise
+ */
+static bool flash_erase_page(uint32_t addr) {
+  if ((addr & (SIM_FLASH_PAGE_SIZE - 1)) || !flash_in_range(addr, SIM_FLASH_PAGE_SIZE)) return false;
+  memset((void *)(uintptr_t)addr, 0xFF, SIM_FLASH_PAGE_SIZE);
+  return true;
+}
+
+/**
+ * @brief Finish an operation started through the flash controller registers,
+ * raising the flash interrupt
+ *
+ * Runs from the simulated interrupt.
+ */
+void sim_flash_tick(void) {
+  uint32_t fmc = HWREG(FLASH_FMC);
+  bool ok;
+
+  if ((fmc & 0xFFFF0000) != FLASH_FMC_WRKEY || !(fmc & (FLASH_FMC_WRITE | FLASH_FMC_ERASE))) {
+    return;
+  }
+
+  if (fmc & FLASH_FMC_ERASE) {
+    ok = flash_erase_page(HWREG(FLASH_FMA));
+  } else {
+    ok = flash_program_word(HWREG(FLASH_FMA), HWREG(FLASH_FMD));
+  }
+  HWREG(FLASH_FMC) = 0;
+  HWREG(FLASH_FCRIS) |= ok ? FLASH_FCRIS_PRIS : FLASH_FCRIS_ARIS;
+
+  if ((HWREG(FLASH_FCRIS) & HWREG(FLASH_FCIM)) && flash_handler) {
+    flash_handler();
+  }
+}
+
+int32_t FlashErase(uint32_t ui32Address) {
+  int32_t rc;
+
+  sim_lock();
+  rc = flash_erase_page(ui32Address) ? 0 : -1;
+  sim_unlock();
+  return rc;
+}
+
+int32_t FlashProgram(uint32_t *pui32Data, uint32_t ui32Address, uint32_t ui32Count) {
+  int32_t rc = 0;
+  uint32_t i;
+
+  sim_lock();
+  for (i = 0; i < ui32Count / sizeof(uint32_t); i++) {
+    if (!flash_program_word(ui32Address + i * sizeof(uint32_t), pui32Data[i])) {
+      rc = -1;
+      break;
+    }
+  }
+  sim_unlock();
+  return rc;
+}
+
+void FlashIntRegister(void (*pfnHandler)(void)) {
+  flash_handler = pfnHandler;
+}
+
+void FlashIntEnable(uint32_t ui32IntFlags) {
+  sim_lock();
+  HWREG(FLASH_FCIM) |= ui32IntFlags;
+  sim_unlock();
+}
+
+uint32_t FlashIntStatus(bool bMasked) {
+  return bMasked ? HWREG(FLASH_FCRIS) & HWREG(FLASH_FCIM) : HWREG(FLASH_FCRIS);
+}
+
+void FlashIntClear(uint32_t ui32IntFlags) {
+  sim_lock();
+  HWREG(FLASH_FCRIS) &= ~ui32IntFlags;
+  sim_unlock();
+}
+
+/*** EEPROM ***/
+
+uint32_t EEPROMInit(void) {
+  return EEPROM_INIT_OK;
+}
+
+void EEPROMRead(uint32_t *pui32Data, uint32_t ui32Address, uint32_t ui32Count) {
+  // Anything past the end of the image reads as erased
+  memset(pui32Data, 0xFF, ui32Count);
+  if (eeprom_fd >= 0 && pread(eeprom_fd, pui32Data, ui32Count, ui32Address) < 0) {
+    perror("sim: reading EEPROM");
+  }
+}
+
+uint32_t EEPROMProgram(uint32_t *pui32Data, uint32_t ui32Address, uint32_t ui32Count) {
+  if (eeprom_fd < 0 || ui32Address + ui32Count > SIM_EEPROM_SIZE ||
+      pwrite(eeprom_fd, pui32Data, ui32Count, ui32Address) != (ssize_t)ui32Count) {
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,536 @@
+/**
+ * @file sim_uart.c
+ * @author Spartan State Security Team
+ * @brief Host simulation of the UARTs and of the uDMA controller
+ * @date 2023
+ *
+ * This source file is part of our designed system
+ * for MITRE's 2023 Embedded System CTF (eCTF).
+ *
+ * Each UART is a TCP connection, set up by SIM_UART0 and SIM_UART1 as
+ * either "listen:PORT" or "connect:[HOST:]PORT". A listening UART takes
+ * a new connection whenever the previous one closes, and a connecting
+ * UART keeps retrying, so boards can be started in any order. Bytes sent
+ * while nothing is connected are lost, as on an unplugged cable.
+ *
+ * Transmission is paced at the configured baud rate through a 16 byte
+ * FIFO. Reception only takes bytes from the connection while the FIFO
+ * has room, so the simulation never overruns on its own.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "inc/hw_memmap.h"
+#include "inc/hw_types.h"
+#include "driverlib/uart.h"
+#include "driverlib/udma.h"
+
+#include "sim.h"
+
+/*** Macro Definitions ***/
+#define SIM_UARTS 2
+#define SIM_DMA_CHANNELS 32
+
+// Interrupt levels set by the firmware with UARTFIFOLevelSet
+#define SIM_UART_RX_LEVEL (SIM_UART_FIFO_SIZE / 2)
+#define SIM_UART_TX_LEVEL (SIM_UART_FIFO_SIZE / 4)
+
+/*** Structure definitions ***/
+// Defines a hardware FIFO
+typedef struct {
+  uint8_t data[SIM_UART_FIFO_SIZE];
+  uint32_t head;
+  uint32_t count;
+} SIM_FIFO;
+
+// Defines one uDMA channel
+typedef struct {
+  bool enabled;
+  uint32_t mode;
+  uint8_t *src;
+  uint8_t *dst;
+  uint32_t count;
+} SIM_DMA;
+
+// Defines one UART and the connection standing in for its pins
+typedef struct {
+  uint32_t base;
+  uint32_t rx_channel;
+  uint32_t tx_channel;
+
+  bool connecting;            // true to connect out, false to listen
+  struct sockaddr_storage peer;
+  socklen_t peer_len;
+  int listen_fd;
+  int fd;                     // the connection, or -1
+  bool pending;               // fd is still connecting
+  uint64_t retry_at;
+
+  SIM_FIFO rx;
+  SIM_FIFO tx;
+  uint32_t baud;
+  uint64_t line_free_at;      // cycle at which the transmitter can start the next byte
+  uint32_t im;
+  uint32_t dma_flags;
+  bool dma_done;              // a channel stopped since the last interrupt
+  void (*handler)(void);
+} SIM_UART;
+
+/*** Globals ***/
+static SIM_UART sim_uarts[SIM_UARTS] = {
+  { .base = UART0_BASE, .rx_channel = UDMA_CHANNEL_UART0RX, .tx_channel = UDMA_CHANNEL_UART0TX,
+    .listen_fd = -1, .fd = -1, .baud = 115200 },
+  { .base = UART1_BASE, .rx_channel = UDMA_CHANNEL_UART1RX, .tx_channel = UDMA_CHANNEL_UART1TX,
+    .listen_fd = -1, .fd = -1, .baud = 115200 },
+};
+
+static SIM_DMA sim_dma[SIM_DMA_CHANNELS];
+static bool sim_dma_enabled = false;
+
+/**
+ * @brief Find the simulation of a UART
+ *
+ * @param base [in] The base address of the UART
+ *
+ * @return the UART
+ */
+static SIM_UART *sim_uart(uint32_t base) {
+  return &sim_uarts[base == UART0_BASE ? 0 : 1];
+}
+
+/*** FIFOs ***/
+
+static bool fifo_push(SIM_FIFO *fifo, uint8_t c) {
+  if (fifo->count == SIM_UART_FIFO_SIZE) return false;
+  fifo->data[(fifo->head + fifo->count++) % SIM_UART_FIFO_SIZE] = c;
+  return true;
+}
+
+static int32_t fifo_pop(SIM_FIFO *fifo) {
+  uint8_t c;
+
+  if (fifo->count == 0) return -1;
+  c = fifo->data[fifo->head];
+  fifo->head = (fifo->head + 1) % SIM_UART_FIFO_SIZE;
+  fifo->count--;
+  return c;
+}
+
+/*** Connections ***/
+
+/**
+ * @brief Set up the connection of a UART from its setting
+ *
+ * @param u    [in] The UART
+ * @param name [in] The environment variable holding its setting
+ */
+static void sim_uart_configure(SIM_UART *u, const char *name) {
+  const char *setting = sim_config(name, NULL);
+  struct addrinfo hints = { 0 };
+  struct addrinfo *ai;
+  char host[256] = "127.0.0.1";
+  const char *port;
+  const char *colon;
+  int one = 1;
+
+  if (!setting) return;
+
+  if (!strncmp(setting, "listen:", 7)) {
+    u->connecting = false;
+    port = setting + 7;
+  } else if (!strncmp(setting, "connect:", 8)) {
+    u->connecting = true;
+    port = setting + 8;
+    colon = strrchr(port, ':');
+    if (colon) {
+      snprintf(host, sizeof(host), "%.*s", (int)(colon - port), port);
+      port = colon + 1;
+    }
+  } else {
+    fprintf(stderr, "sim: %s must be listen:PORT or connect:[HOST:]PORT\n", name);
+    exit(1);
+  }
+
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(host, port, &hints, &ai)) {
+    fprintf(stderr, "sim: cannot resolve %s\n", setting);
+    exit(1);
+  }
+  memcpy(&u->peer, ai->ai_addr, ai->ai_addrlen);
+  u->peer_len = ai->ai_addrlen;
+  freeaddrinfo(ai);
+
+  if (u->connecting) return;
+
+  // Closed on exec, so a program which starts itself again can listen on the port once more
+  u->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  setsockopt(u->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  if (u->listen_fd < 0 || bind(u->listen_fd, (struct sockaddr *)&u->peer, u->peer_len) ||
+      listen(u->listen_fd, 1)) {
+    perror(setting);
+    exit(1);
+  }
+}
+
+/**
+ * @brief Set up both UARTs
+ */
+void sim_uart_setup(void) {
+  sim_uart_configure(&sim_uarts[0], "SIM_UART0");
+  sim_uart_configure(&sim_uarts[1], "SIM_UART1");
+}
+
+/**
+ * @brief Drop the connection of a UART
+ *
+ * @param u [in] The UART
+ */
+static void sim_uart_disconnect(SIM_UART *u) {
+  close(u->fd);
+  u->fd = -1;
+  u->pending = false;
+  u->retry_at = sim_cycles() + SIM_SPEED / 10;
+}
+
+/**
+ * @brief Send each byte as soon as it leaves the FIFO
+ *
+ * Without this, bytes sent a few at a time wait for the peer to
+ * acknowledge the previous ones, which can take 40 ms.
+ *
+ * @param u [in] The UART
+ */
+static void sim_uart_nodelay(SIM_UART *u) {
+  int one = 1;
+
+  if (u->fd >= 0) {
+    setsockopt(u->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+}
+
+/**
+ * @brief Accept or make the connection of a UART if it has none
+ *
+ * Runs from the simulated interrupt, so never blocks.
+ *
+ * @param u [in] The UART
+ */
+static void sim_uart_connect(SIM_UART *u) {
+  struct pollfd p;
+  socklen_t len = sizeof(int);
+  int err = 0;
+
+  if (u->fd >= 0 && !u->pending) return;
+
+  if (!u->connecting) {
+    if (u->listen_fd >= 0) {
+      u->fd = accept4(u->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+      sim_uart_nodelay(u);
+    }
+    return;
+  }
+
+  if (u->pending) {
+    p.fd = u->fd;
+    p.events = POLLOUT;
+    if (poll(&p, 1, 0) == 1) {
+      getsockopt(u->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+      if (err) {
+        sim_uart_disconnect(u);
+      } else {
+        u->pending = false;
+      }
+    }
+    return;
+  }
+
+  if (u->peer_len == 0 || sim_cycles() < u->retry_at) return;
+
+  u->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (u->fd < 0) return;
+  sim_uart_nodelay(u);
+  if (connect(u->fd, (struct sockaddr *)&u->peer, u->peer_len) == 0) {
+    return;
+  }
+  if (errno == EINPROGRESS) {
+    u->pending = true;
+  } else {
+    sim_uart_disconnect(u);
+  }
+}
+
+/*** Data movement ***/
+
+/**
+ * @brief Move received bytes from the connection into the FIFO,
+ * and from the FIFO to an active receive transfer
+ *
+ * @param u [in] The UART
+ */
+static void sim_uart_receive(SIM_UART *u) {
+  SIM_DMA *dma = &sim_dma[u->rx_channel];
+  uint8_t buf[SIM_UART_FIFO_SIZE];
+  ssize_t got;
+  ssize_t i;
+
+  if (u->fd >= 0 && !u->pending && u->rx.count < SIM_UART_FIFO_SIZE) {
+    got = recv(u->fd, buf, SIM_UART_FIFO_SIZE - u->rx.count, 0);
+    if (got == 0 || (got < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+      sim_uart_disconnect(u);
+    }
+    for (i = 0; i < got; i++) {
+      fifo_push(&u->rx, buf[i]);
+    }
+  }
+
+  // The controller empties the FIFO as fast as the bytes arrive
+  if (!sim_dma_enabled || !dma->enabled || !(u->dma_flags & UART_DMA_RX)) return;
+  while (dma->count && u->rx.count) {
+    *dma->dst++ = (uint8_t)fifo_pop(&u->rx);
+    if (--dma->count == 0) {
+      dma->mode = UDMA_MODE_STOP;
+      u->dma_done = true;
+    }
+  }
+}
+
+/**
+ * @brief Send bytes from the FIFO at the baud rate, refilling it
+ * from an active transmit transfer
+ *
+ * @param u [in] The UART
+ */
+static void sim_uart_transmit(SIM_UART *u) {
+  SIM_DMA *dma = &sim_dma[u->tx_channel];
+  uint8_t buf[512];
+  uint32_t len = 0;
+  uint64_t now = sim_cycles();
+  uint64_t per_byte = (uint64_t)SIM_SPEED * 10 / u->baud;
+  bool dma_on = sim_dma_enabled && dma->enabled && (u->dma_flags & UART_DMA_TX);
+
+  while (len < sizeof(buf)) {
+    while (dma_on && dma->count && u->tx.count < SIM_UART_FIFO_SIZE) {
+      fifo_push(&u->tx, *dma->src++);
+      if (--dma->count == 0) {
+        dma->mode = UDMA_MODE_STOP;
+        u->dma_done = true;
+      }
+    }
+
+    // An idle line does not save up time for later bytes
+    if (u->tx.count == 0) {
+      u->line_free_at = now;
+      break;
+    }
+    if (u->line_free_at + per_byte > now) break;
+
+    buf[len++] = (uint8_t)fifo_pop(&u->tx);
+    u->line_free_at += per_byte;
+  }
+
+  // Without a connection the bytes fall on the floor
+  if (len && u->fd >= 0 && !u->pending &&
+      send(u->fd, buf, len, MSG_NOSIGNAL) < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+    sim_uart_disconnect(u);
+  }
+}
+
+/**
+ * @brief Compute the raw interrupt status of a UART
+ *
+ * @param u [in] The UART
+ *
+ * @return the raised UART_INT_ flags
+ */
+static uint32_t sim_uart_status(SIM_UART *u) {
+  uint32_t status = 0;
+
+  if (u->rx.count >= SIM_UART_RX_LEVEL) status |= UART_INT_RX;
+  if (u->rx.count > 0) status |= UART_INT_RT;
+  if (u->tx.count <= SIM_UART_TX_LEVEL) status |= UART_INT_TX;
+  return status;
+}
+
+/**
+ * @brief Service both UARTs, calling their interrupt handlers
+ *
+ * Runs from the simulated interrupt.
+ */
+void sim_uart_tick(void) {
+  SIM_UART *u;
+  uint32_t i;
+
+  for (i = 0; i < SIM_UARTS; i++) {
+    u = &sim_uarts[i];
+    sim_uart_connect(u);
+    sim_uart_receive(u);
+    sim_uart_transmit(u);
+
+    // A stopped uDMA channel raises its UART's interrupt
+    if (u->handler && (u->dma_done || (sim_uart_status(u) & u->im))) {
+      u->dma_done = false;
+      u->handler();
+    }
+  }
+}
+
+/*** UART driver ***/
+
+void UARTConfigSetExpClk(uint32_t ui32Base, uint32_t ui32UARTClk, uint32_t ui32Baud,
+                         uint32_t ui32Config) {
+  sim_lock();
+  sim_uart(ui32Base)->baud = ui32Baud;
+  sim_unlock();
+}
+
+void UARTFIFOEnable(uint32_t ui32Base) {
+}
+
+void UARTFIFOLevelSet(uint32_t ui32Base, uint32_t ui32TxLevel, uint32_t ui32RxLevel) {
+}
+
+void UARTTxIntModeSet(uint32_t ui32Base, uint32_t ui32Mode) {
+}
+
+void UARTIntRegister(uint32_t ui32Base, void (*pfnHandler)(void)) {
+  sim_lock();
+  sim_uart(ui32Base)->handler = pfnHandler;
+  sim_unlock();
+}
+
+void UARTIntEnable(uint32_t ui32Base, uint32_t ui32IntFlags) {
+  sim_lock();
+  sim_uart(ui32Base)->im |= ui32IntFlags;
+  sim_unlock();
+}
+
+void UARTIntDisable(uint32_t ui32Base, uint32_t ui32IntFlags) {
+  sim_lock();
+  sim_uart(ui32Base)->im &= ~ui32IntFlags;
+  sim_unlock();
+}
+
+uint32_t UARTIntStatus(uint32_t ui32Base, bool bMasked) {
+  SIM_UART *u = sim_uart(ui32Base);
+  uint32_t status;
+
+  sim_lock();
+  status = sim_uart_status(u);
+  if (bMasked) status &= u->im;
+  sim_unlock();
+  return status;
+}
+
+void UARTIntClear(uint32_t ui32Base, uint32_t ui32IntFlags) {
+  // Every simulated interrupt is level triggered
+}
+
+bool UARTCharsAvail(uint32_t ui32Base) {
+  return sim_uart(ui32Base)->rx.count > 0;
+}
+
+bool UARTSpaceAvail(uint32_t ui32Base) {
+  return sim_uart(ui32Base)->tx.count < SIM_UART_FIFO_SIZE;
+}
+
+bool UARTBusy(uint32_t ui32Base) {
+  return sim_uart(ui32Base)->tx.count > 0;
+}
+
+int32_t UARTCharGetNonBlocking(uint32_t ui32Base) {
+  int32_t c;
+
+  sim_lock();
+  c = fifo_pop(&sim_uart(ui32Base)->rx);
+  sim_unlock();
+  return c;
+}
+
+int32_t UARTCharGet(uint32_t ui32Base) {
+  int32_t c;
+
+  while ((c = UARTCharGetNonBlocking(ui32Base)) < 0);
+  return c;
+}
+
+bool UARTCharPutNonBlocking(uint32_t ui32Base, unsigned char ucData) {
+  bool put;
+
+  sim_lock();
+  put = fifo_push(&sim_uart(ui32Base)->tx, ucData);
+  sim_unlock();
+  return put;
+}
+
+void UARTDMAEnable(uint32_t ui32Base, uint32_t ui32DMAFlags) {
+  sim_lock();
+  sim_uart(ui32Base)->dma_flags |= ui32DMAFlags;
+  sim_unlock();
+}
+
+void UARTDMADisable(uint32_t ui32Base, uint32_t ui32DMAFlags) {
+  sim_lock();
+  sim_uart(ui32Base)->dma_flags &= ~ui32DMAFlags;
+  sim_unlock();
+}
+
+/*** uDMA driver ***/
+
+void uDMAEnable(void) {
+  sim_dma_enabled = true;
+}
+
+void uDMAControlBaseSet(void *pControlTable) {
+}
+
+void uDMAChannelAssign(uint32_t ui32Mapping) {
+}
+
+void uDMAChannelAttributeDisable(uint32_t ui32ChannelNum, uint32_t ui32Attr) {
+}
+
+void uDMAChannelControlSet(uint32_t ui32ChannelStructIndex, uint32_t ui32Control) {
+}
+
+void uDMAChannelTransferSet(uint32_t ui32ChannelStructIndex, uint32_t ui32Mode,
+                            void *pvSrcAddr, void *pvDstAddr, uint32_t ui32TransferSize) {
+  SIM_DMA *dma = &sim_dma[ui32ChannelStructIndex % SIM_DMA_CHANNELS];
+
+  sim_lock();
+  dma->mode = ui32Mode;
+  dma->src = pvSrcAddr;
+  dma->dst = pvDstAddr;
+  dma->count = ui32TransferSize;
+  sim_unlock();
+}
+
+void uDMAChannelEnable(uint32_t ui32ChannelNum) {
+  sim_lock();
+  sim_dma[ui32ChannelNum % SIM_DMA_CHANNELS].enabled = true;
+  sim_unlock();
+}
+
+void uDMAChannelDisable(uint32_t ui32ChannelNum) {
+  sim_lock();
+  sim_dma[ui32ChannelNum % SIM_DMA_CHANNELS].enabled = false;
+  sim_unlock();
+}
+
+uint32_t uDMAChannelModeGet(uint32_t ui32ChannelStructIndex) {
+  return sim_dma[ui32ChannelStructIndex % SIM_DMA_CHANNELS].mode;
+}
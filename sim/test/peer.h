@@ -0,0 +1,146 @@
+/**
+ * @file peer.h
+ * @author Spartan State Security Team
+ * @brief Lets a host test sit on the other end of a simulated UART
+ * @date 2023
+ *
+ * This source file is part of our designed system
+ * for MITRE's 2023 Embedded System CTF (eCTF).
+ *
+ * The simulation reads SIM_UART0 and SIM_UART1 before main runs, so a
+ * test picks a free port, sets the variable and starts itself again.
+ * It then connects to the port and talks to the firmware over the
+ * socket, as the host or the other board would.
+ */
+
+#ifndef PEER_H
+#define PEER_H
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+/**
+ * @brief Start the test again with a UART listening on a free local port, unless it already is
+ *
+ * The simulation's interrupt timer survives the exec, so it is stopped
+ * first and any tick already raised is discarded.
+ *
+ * @param name [in] The UART's variable, SIM_UART0 or SIM_UART1
+ * @param argv [in] The test's arguments
+ */
+static inline void peer_listen(const char *name, char **argv) {
+  struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+  struct itimerval stop = { 0 };
+  socklen_t len = sizeof(addr);
+  sigset_t alarm;
+  char setting[32];
+  int fd;
+
+  if (getenv(name)) {
+    return;
+  }
+
+  fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0 || bind(fd, (struct sockaddr *)&addr, len) || getsockname(fd, (struct sockaddr *)&addr, &len)) {
+    perror("peer: finding a port");
+    exit(EXIT_FAILURE);
+  }
+  close(fd);
+
+  snprintf(setting, sizeof(setting), "listen:%u", ntohs(addr.sin_port));
+  setenv(name, setting, 1);
+
+  sigemptyset(&alarm);
+  sigaddset(&alarm, SIGALRM);
+  sigprocmask(SIG_BLOCK, &alarm, NULL);
+  setitimer(ITIMER_REAL, &stop, NULL);
+  signal(SIGALRM, SIG_IGN);
+  sigprocmask(SIG_UNBLOCK, &alarm, NULL);
+  execv("/proc/self/exe", argv);
+  perror("peer: restarting");
+  exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief Connect to a UART set up by peer_listen
+ *
+ * Bytes only flow once the simulation has taken the connection.
+ *
+ * @param name [in] The UART's variable, SIM_UART0 or SIM_UART1
+ *
+ * @return the connected socket
+ */
+static inline int peer_connect(const char *name) {
+  struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+
+  // Small writes go out at once, as they would on the line
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  addr.sin_port = htons(atoi(getenv(name) + 7));
+  while (connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+    if (errno != EINTR) {
+      perror("peer: connecting");
+      exit(EXIT_FAILURE);
+    }
+  }
+  return fd;
+}
+
+/**
+ * @brief Send bytes, retrying when the simulated interrupt cuts in
+ *
+ * @param fd  [in] The socket
+ * @param buf [in] The bytes to send
+ * @param len [in] The number of bytes
+ */
+static inline void peer_send(int fd, const void *buf, uint32_t len) {
+  const uint8_t *p = (const uint8_t *)buf;
+  ssize_t sent;
+
+  while (len) {
+    sent = send(fd, p, len, 0);
+    if (sent > 0) {
+      p += sent;
+      len -= sent;
+    }
+  }
+}
+
+/**
+ * @brief Receive an exact number of bytes, retrying when the simulated interrupt cuts in
+ *
+ * @param fd  [in]  The socket
+ * @param buf [out] Where to store the bytes
+ * @param len [in]  The number of bytes
+ *
+ * @return true if every byte arrived, false if the connection closed
+ */
+static inline bool peer_recv(int fd, void *buf, uint32_t len) {
+  uint8_t *p = (uint8_t *)buf;
+  ssize_t got;
+
+  while (len) {
+    got = recv(fd, p, len, 0);
+    if (got == 0) {
+      return false;
+    }
+    if (got > 0) {
+      p += got;
+      len -= got;
+    }
+  }
+  return true;
+}
+
+#endif // PEER_H
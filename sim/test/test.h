@@ -0,0 +1,52 @@
+/**
+ * @file test.h
+ * @author Spartan State Security Team
+ * @brief Minimal checks shared by the host tests
+ * @date 2023
+ *
+ * This source file is part of our designed system
+ * for MITRE's 2023 Embedded System CTF (eCTF).
+ *
+ * Each test is a program that runs its checks, prints the ones that
+ * fail, and exits nonzero if any did, so `make -C sim test` can run
+ * them one after another.
+ */
+
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*** Globals ***/
+static uint32_t test_checks = 0;
+static uint32_t test_failures = 0;
+
+/*** Macro Definitions ***/
+// Record one check, printing where it failed
+#define CHECK(cond) do { \
+    test_checks++; \
+    if (!(cond)) { \
+      test_failures++; \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+    } \
+  } while (0)
+
+// Record one check that two buffers match
+#define CHECK_MEM(a, b, n) CHECK(memcmp((a), (b), (n)) == 0)
+
+/**
+ * @brief Print the outcome of a test program
+ *
+ * @param name [in] The test's name
+ *
+ * @return the exit status for main
+ */
+static inline int test_summary(const char *name) {
+  printf("%s: %u checks, %u failed\n", name, test_checks, test_failures);
+  return test_failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+#endif // TEST_H
@@ -0,0 +1,120 @@
+/**
+ * @file test_car_challenge.c
+ * @author Spartan State Security Team
+ * @brief Measures the car's request-to-challenge latency, with and without the challenge pool
+ * @date 2023
+ *
+ * This source file is part of our designed system
+ * for MITRE's 2023 Embedded System CTF (eCTF).
+ *
+ * Linked with the test car's firmware and run on its EEPROM image.
+ * Without the pool, gen_challenge generates each challenge once the fob
+ * has asked, and the first unlock after boot also initializes the DRBG.
+ * With it, the main loop fills the pool while idle and a request only
+ * copies a challenge out. Both are timed for the first unlock after boot
+ * and for later ones, and every challenge handed out must be new.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sb_all.h"
+
+#include "sim.h"
+#include "store.h"
+#include "uart.h"
+#include "firmware.h"
+#include "test.h"
+
+/*** Macro Definitions ***/
+#define RUNS 32
+
+/*** Globals ***/
+extern bool DRBG_INITIALIZED;
+extern CHALLENGE challenge_pool[CHALLENGE_POOL_SIZE];
+extern uint32_t challenge_pool_count;
+
+// Every challenge handed out, to check none repeats
+CHALLENGE seen[2 * (RUNS + 1)];
+uint32_t seen_count = 0;
+
+/**
+ * @brief Take a challenge as an unlock does, and check it was never handed out before
+ *
+ * @return the cycles gen_challenge took
+ */
+uint64_t take_challenge(void) {
+  CHALLENGE challenge;
+  uint64_t start = sim_cycles();
+  uint32_t i;
+
+  CHECK(gen_challenge(&challenge));
+  start = sim_cycles() - start;
+
+  for (i = 0; i < seen_count; i++) {
+    CHECK(memcmp(&seen[i], &challenge, sizeof(CHALLENGE)));
+  }
+  memcpy(&seen[seen_count++], &challenge, sizeof(CHALLENGE));
+  return start;
+}
+
+/**
+ * @brief Forget the DRBG and the pool, as a boot does
+ */
+void reboot(void) {
+  memset(challenge_pool, 0, sizeof(challenge_pool));
+  challenge_pool_count = 0;
+  DRBG_INITIALIZED = false;
+}
+
+int main(void) {
+  uint64_t first_before, steady_before = 0, first_after, steady_after = 0;
+  uint64_t start, fill = 0;
+  CHALLENGE zero;
+  uint32_t i;
+
+  uart_init();
+  CHECK(store_init());
+  memset(&zero, 0, sizeof(zero));
+
+  // Without the pool, the DRBG starts and generates once the fob has asked
+  reboot();
+  first_before = take_challenge();
+  for (i = 0; i < RUNS; i++) {
+    steady_before += take_challenge();
+  }
+  CHECK(challenge_pool_count == 0);
+
+  // With it, the idle loop after boot starts the DRBG and fills the pool
+  reboot();
+  start = sim_cycles();
+  tryFillChallenges();
+  fill += sim_cycles() - start;
+  CHECK(DRBG_INITIALIZED);
+  CHECK(challenge_pool_count == CHALLENGE_POOL_SIZE);
+
+  first_after = take_challenge();
+  CHECK(challenge_pool_count == CHALLENGE_POOL_SIZE - 1);
+  CHECK_MEM(&challenge_pool[challenge_pool_count], &zero, sizeof(CHALLENGE));
+
+  // The idle loop between unlocks tops the pool up in batches
+  for (i = 0; i < RUNS; i++) {
+    start = sim_cycles();
+    tryFillChallenges();
+    fill += sim_cycles() - start;
+    CHECK(challenge_pool_count > CHALLENGE_POOL_LOW);
+    steady_after += take_challenge();
+  }
+
+  printf("request to challenge, cycles:  first unlock  later unlocks\n");
+  printf("generated on request          %12llu  %13llu\n",
+         (unsigned long long)first_before, (unsigned long long)(steady_before / RUNS));
+  printf("taken from the pool           %12llu  %13llu\n",
+         (unsigned long long)first_after, (unsigned long long)(steady_after / RUNS));
+  printf("pool refills while idle: %llu cycles in all\n", (unsigned long long)fill);
+
+  CHECK(first_after < first_before);
+  CHECK(steady_after < steady_before);
+
+  return test_summary("test_car_challenge");
+}
@@ -0,0 +1,168 @@
+/**
+ * @file test_car_entropy.c
+ * @author Spartan State Security Team
+ * @brief Boots the car's entropy journal 100,000 times on the simulated flash
+ * @date 2023
+ *
+ * This source file is part of our designed system
+ * for MITRE's 2023 Embedded System CTF (eCTF).
+ *
+ * Linked with the car's entropy.c and the simulated flash, with the flash
+ * driver calls wrapped to count them. Each boot forgets what the journal
+ * found, loads the newest seed, which must be the one the previous boot
+ * committed, and appends a new one. Now and then an append is cut off
+ * before its commit word, and the boot after must get the older seed.
+ *
+ * The simulated flash takes no time, so the latency of each refresh is
+ * modelled from the erases and words programmed, at FLASH_ERASE_US and
+ * FLASH_WORD_US each, typical figures for the TM4C123 flash. Erases are
+ * reported per page, against the one page the journal replaced, which
+ * was erased and rewritten with 1 KB on every boot. Cut off appends are
+ * left out of the latency, as the reset ends them.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "sim.h"
+#include "entropy.h"
+#include "test.h"
+
+/*** Macro Definitions ***/
+#define BOOTS 100000
+
+// One in this many appends is cut off before its commit word
+#define TEAR_EVERY 997
+
+// Modelled flash timings, in microseconds
+#define FLASH_ERASE_US 12000
+#define FLASH_WORD_US 30
+
+/*** Globals ***/
+extern int32_t entropy_latest;
+extern bool entropy_scanned;
+
+uint32_t page_erases[ENTROPY_JOURNAL_PAGES];
+uint32_t other_erases = 0;
+
+// Flash work done by the refresh in progress
+uint32_t refresh_erases = 0;
+uint32_t refresh_words = 0;
+
+// Set to drop the next commit word, as a reset would
+bool tear = false;
+
+// Appends cut off in the first slot of a page, which has the page erased again
+uint32_t torn_first = 0;
+
+/*** Flash driver, counted ***/
+int32_t __real_FlashErase(uint32_t ui32Address);
+int32_t __real_FlashProgram(uint32_t *pui32Data, uint32_t ui32Address, uint32_t ui32Count);
+
+int32_t __wrap_FlashErase(uint32_t ui32Address) {
+  uint32_t page = (ui32Address - ENTROPY_JOURNAL_BASE) / ENTROPY_PAGE_SIZE;
+
+  if (ui32Address >= ENTROPY_JOURNAL_BASE && page < ENTROPY_JOURNAL_PAGES) {
+    page_erases[page]++;
+  } else {
+    other_erases++;
+  }
+  refresh_erases++;
+  return __real_FlashErase(ui32Address);
+}
+
+int32_t __wrap_FlashProgram(uint32_t *pui32Data, uint32_t ui32Address, uint32_t ui32Count) {
+  if (tear && ui32Count == sizeof(uint32_t)) {
+    tear = false;
+    torn_first += (ui32Address - ENTROPY_JOURNAL_BASE) % ENTROPY_PAGE_SIZE < sizeof(ENTROPY_RECORD);
+    return -1;
+  }
+  refresh_words += ui32Count / sizeof(uint32_t);
+  return __real_FlashProgram(pui32Data, ui32Address, ui32Count);
+}
+
+/**
+ * @brief Fill a seed with a value unique to one boot
+ *
+ * @param seed [out] The seed
+ * @param boot [in]  The boot it belongs to
+ */
+void boot_seed(uint8_t seed[ENTROPY_SEED_SIZE], uint32_t boot) {
+  uint32_t i;
+
+  for (i = 0; i < ENTROPY_SEED_SIZE; i++) {
+    seed[i] = (uint8_t)((boot >> (8 * (i % 4))) + i);
+  }
+}
+
+int main(void) {
+  uint8_t seed[ENTROPY_SEED_SIZE], expected[ENTROPY_SEED_SIZE], zero[ENTROPY_SEED_SIZE] = { 0 };
+  uint64_t latency, total = 0, fastest = UINT64_MAX, slowest = 0, old_latency;
+  uint32_t erasing = 0, torn = 0, mistakes = 0;
+  uint32_t least = UINT32_MAX, most = 0;
+  uint32_t boot, i;
+
+  // Start from an erased journal
+  for (i = 0; i < ENTROPY_JOURNAL_PAGES; i++) {
+    CHECK(__real_FlashErase(ENTROPY_JOURNAL_BASE + i * ENTROPY_PAGE_SIZE) == 0);
+  }
+  memcpy(expected, zero, sizeof(expected));
+
+  for (boot = 0; boot < BOOTS; boot++) {
+    entropy_latest = -1;
+    entropy_scanned = false;
+
+    // The newest committed seed survives the reset
+    entropy_journal_seed(seed);
+    if (memcmp(seed, expected, ENTROPY_SEED_SIZE)) mistakes++;
+
+    boot_seed(seed, boot);
+    refresh_erases = refresh_words = 0;
+    tear = boot % TEAR_EVERY == TEAR_EVERY - 1;
+    if (!entropy_journal_append(seed)) {
+      torn++;
+      continue;
+    }
+    memcpy(expected, seed, ENTROPY_SEED_SIZE);
+
+    latency = (uint64_t)refresh_erases * FLASH_ERASE_US + (uint64_t)refresh_words * FLASH_WORD_US;
+    total += latency;
+    fastest = latency < fastest ? latency : fastest;
+    slowest = latency > slowest ? latency : slowest;
+    erasing += refresh_erases != 0;
+  }
+
+  // The page the journal replaced was erased and given a 1 KB block on every boot
+  old_latency = FLASH_ERASE_US + (ENTROPY_PAGE_SIZE / sizeof(uint32_t)) * FLASH_WORD_US;
+
+  printf("%u boots, %u appends cut off, %u of them in the first slot of a page, %u wrong seeds\n",
+         BOOTS, torn, torn_first, mistakes);
+  printf("erases per page:");
+  for (i = 0; i < ENTROPY_JOURNAL_PAGES; i++) {
+    printf(" %u", page_erases[i]);
+    least = page_erases[i] < least ? page_erases[i] : least;
+    most = page_erases[i] > most ? page_erases[i] : most;
+  }
+  printf(", before: %u on one page\n", BOOTS);
+  printf("refresh latency, us: %llu fastest, %llu mean, %llu slowest, %u refreshes erased a page\n",
+         (unsigned long long)fastest, (unsigned long long)(total / (BOOTS - torn)), (unsigned long long)slowest,
+         erasing);
+  printf("before: %llu on every refresh\n", (unsigned long long)old_latency);
+
+  CHECK(torn == BOOTS / TEAR_EVERY);
+  CHECK(mistakes == 0);
+  CHECK(other_erases == 0);
+
+  // Wear is spread evenly, a page erased once each time the journal wraps past it,
+  // and again when an append in its first slot is cut off
+  CHECK(most - least <= 1 + torn_first);
+  CHECK(most <= (BOOTS + torn) / ENTROPY_RECORDS + 1 + torn_first);
+
+  // Only the refreshes which start a page wait for an erase
+  CHECK(erasing <= (BOOTS + torn) / ENTROPY_RECORDS_PER_PAGE);
+  CHECK(fastest == (sizeof(ENTROPY_RECORD) / sizeof(uint32_t)) * FLASH_WORD_US);
+  CHECK(total / (BOOTS - torn) < old_latency / 10);
+
+  return test_summary("test_car_entropy");
+}
@@ -0,0 +1,127 @@
+/**
+ * @file test_car_feature_cache.c
+ * @author Spartan State Security Team
+ * @brief Replays one fob response through the car's verification, with and without the feature cache
+ * @date 2023
+ *
+ * This source file is part of our designed system
+ * for MITRE's 2023 Embedded System CTF (eCTF).
+ *
+ * Linked with the test car's firmware and run on its EEPROM image.
+ * The same response, with every feature, is verified over and over,
+ * first with the feature cache emptied before each run and then with
+ * it kept, and the mean latency of each is reported. Packages must
+ * still be rejected once altered, or when sent for another feature,
+ * and are only cached once the unlock signature verified with them.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sb_all.h"
+
+#include "sim.h"
+#include "store.h"
+#include "firmware.h"
+#include "test.h"
+#include "vectors.h"
+
+/*** Macro Definitions ***/
+#define RUNS 50
+
+/*** Globals ***/
+extern FEATURE_CACHE_ENTRY feature_cache[FEATURE_CACHE_SIZE];
+extern uint32_t feature_cache_next;
+extern uint32_t feature_cache_hits;
+extern uint32_t feature_cache_misses;
+
+RESPONSE response;
+CHALLENGE challenge;
+VERIFICATION verification;
+
+/**
+ * @brief Empty the feature cache and its counters
+ */
+void reset_cache(void) {
+  memset(feature_cache, 0, sizeof(feature_cache));
+  feature_cache_next = 0;
+  feature_cache_hits = 0;
+  feature_cache_misses = 0;
+}
+
+/**
+ * @brief Verify the response as an unlock does
+ *
+ * @param cycles [out] The cycles the verification took
+ *
+ * @return true if the response is valid, false otherwise
+ */
+bool verify(uint64_t *cycles) {
+  uint64_t start = sim_cycles();
+  bool ok = verify_features(&verification, &response) && verify_response(&verification, &challenge, &response);
+
+  *cycles = sim_cycles() - start;
+  return ok;
+}
+
+int main(void) {
+  uint64_t cycles, cold = 0, warm = 0;
+  uint32_t i;
+
+  CHECK(store_init());
+
+  for (i = 0; i < NUM_FEATURES; i++) {
+    PRESENT_SET(response.present, i);
+  }
+  memcpy(response.unlock.bytes, UNLOCK_SIGNATURE, sizeof(response.unlock));
+  memcpy(response.feature, FEATURE_PACKAGES, sizeof(response.feature));
+  memcpy(challenge.data, UNLOCK_CHALLENGE, sizeof(challenge));
+
+  // Every package verified on every run
+  for (i = 0; i < RUNS; i++) {
+    reset_cache();
+    CHECK(verify(&cycles));
+    CHECK(feature_cache_misses == NUM_FEATURES && feature_cache_hits == 0);
+    cold += cycles;
+  }
+
+  // Only the unlock signature verified after the first run
+  reset_cache();
+  CHECK(verify(&cycles));
+  for (i = 0; i < RUNS; i++) {
+    CHECK(verify(&cycles));
+    warm += cycles;
+  }
+  CHECK(feature_cache_misses == NUM_FEATURES && feature_cache_hits == NUM_FEATURES * RUNS);
+
+  printf("mean cycles per unlock: %llu uncached, %llu cached, %llu saved\n",
+         (unsigned long long)(cold / RUNS), (unsigned long long)(warm / RUNS),
+         (unsigned long long)((cold - warm) / RUNS));
+  CHECK(warm < cold);
+
+  // A changed package misses the cache and fails verification
+  response.feature[1].bytes[40] ^= 1;
+  CHECK(!verify(&cycles));
+  response.feature[1].bytes[40] ^= 1;
+
+  // A cached package only counts for the feature it was verified for
+  memcpy(&response.feature[1], FEATURE_PACKAGES[0], sizeof(PACKAGE));
+  CHECK(!verify(&cycles));
+  memcpy(&response.feature[1], FEATURE_PACKAGES[1], sizeof(PACKAGE));
+
+  // A cache hit never excuses a bad unlock signature
+  response.unlock.bytes[10] ^= 1;
+  CHECK(!verify(&cycles));
+  response.unlock.bytes[10] ^= 1;
+  CHECK(verify(&cycles));
+
+  // Packages batched with a bad unlock signature are not cached
+  reset_cache();
+  response.unlock.bytes[10] ^= 1;
+  CHECK(!verify(&cycles));
+  response.unlock.bytes[10] ^= 1;
+  CHECK(verify(&cycles));
+  CHECK(feature_cache_misses == 2 * NUM_FEATURES && feature_cache_hits == 0);
+
+  return test_summary("test_car_feature_cache");
+}
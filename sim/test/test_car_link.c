@@ -0,0 +1,216 @@
+/**
+ * @file test_car_link.c
+ * @author Spartan State Security Team
+ * @brief Checks the car falls back to a slower board link rate within an unlock, and climbs back
+ * @date 2023
+ *
+ * This source file is part of our designed system
+ * for MITRE's 2023 Embedded System CTF (eCTF).
+ *
+ * Linked with the car's board link and UART driver. A thread plays the
+ * fob on the other end of UART 1 while the car runs the exchange. The
+ * simulated line carries every rate, so a noisy one is played by the
+ * fob: it garbles the check pattern, or never answers the challenge.
+ * Either must be retried at the next slower rate in the same unlock,
+ * and enough exchanges completed at a lowered rate must bring the
+ * faster one back.
+ */
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "inc/hw_memmap.h"
+
+#include "sim.h"
+#include "uart.h"
+#include "board_link.h"
+#include "firmware.h"
+#include "peer.h"
+#include "test.h"
+
+/*** Structure definitions ***/
+// How the fob answers one exchange
+typedef struct {
+  uint8_t rate;     // the rate the car must offer
+  bool garble;      // garble the check pattern
+  bool silent;      // never answer the challenge
+} FOB_PLAY;
+
+/*** Globals ***/
+extern uint8_t link_rate;
+extern uint8_t link_rate_current;
+
+int peer = -1;
+
+// The fob's side of an unlock, one exchange at a time
+FOB_PLAY play[8];
+uint32_t play_count;
+
+// What the fob saw, checked once its thread ends
+uint32_t fob_mistakes;
+uint32_t fob_dones;
+
+/**
+ * @brief Expect a byte from the car
+ *
+ * @param expected [in] The byte the car must send
+ */
+void fob_expect(uint8_t expected) {
+  uint8_t c = 0;
+
+  if (!peer_recv(peer, &c, 1) || c != expected) {
+    fob_mistakes++;
+  }
+}
+
+/**
+ * @brief Play the fob through each exchange of one unlock, then read LINK_DONE
+ *
+ * @param arg [in] Unused
+ *
+ * @return NULL
+ */
+void *fob_thread(void *arg) {
+  static const uint8_t check[4] = { 0x55, 0xAA, 0x0F, 0xF0 };
+  uint8_t ack[2] = { BAUD_ACK, 0 };
+  uint8_t reply[1 + PRESENT_SIZE + 1 + sizeof(sb_sw_signature_t)];
+  uint8_t buf[sizeof(CHALLENGE)];
+  uint32_t i;
+
+  for (i = 0; i < play_count; i++) {
+    fob_expect(BAUD_OFFER);
+    fob_expect(play[i].rate);
+    ack[1] = play[i].rate;
+    peer_send(peer, ack, sizeof(ack));
+
+    if (play[i].rate != 0) {
+      if (!peer_recv(peer, buf, sizeof(check)) || memcmp(buf, check, sizeof(check))) fob_mistakes++;
+      memcpy(buf, check, sizeof(check));
+      if (play[i].garble) {
+        buf[2] ^= 0x10;
+      }
+      peer_send(peer, buf, sizeof(check));
+      if (play[i].garble) {
+        continue;
+      }
+    }
+
+    fob_expect(CHAL_START);
+    if (!peer_recv(peer, buf, sizeof(CHALLENGE))) fob_mistakes++;
+    if (play[i].silent) {
+      continue;
+    }
+
+    // No features, then the signature
+    memset(reply, 0x3C, sizeof(reply));
+    reply[0] = RESP_START;
+    memset(&reply[1], 0, PRESENT_SIZE);
+    reply[1 + PRESENT_SIZE] = SIG_START;
+    peer_send(peer, reply, sizeof(reply));
+  }
+
+  fob_expect(LINK_DONE);
+  fob_dones++;
+  return NULL;
+}
+
+/**
+ * @brief Run one unlock's exchanges as tryUnlock does, with the fob playing its part
+ *
+ * @param exchanges [out] The number of exchanges the car ran
+ *
+ * @return true if the last exchange received the whole response, false otherwise
+ */
+bool unlock(uint32_t *exchanges) {
+  CHALLENGE challenge;
+  RESPONSE response;
+  pthread_t fob;
+  sigset_t alarm;
+  bool received;
+
+  // The simulated interrupts must land on this thread, which runs the car
+  sigemptyset(&alarm);
+  sigaddset(&alarm, SIGALRM);
+  pthread_sigmask(SIG_BLOCK, &alarm, NULL);
+  pthread_create(&fob, NULL, fob_thread, NULL);
+  pthread_sigmask(SIG_UNBLOCK, &alarm, NULL);
+
+  *exchanges = 0;
+  memset(&challenge, 0x11, sizeof(challenge));
+  do {
+    memset(&response, 0, sizeof(response));
+    (*exchanges)++;
+    received = negotiate_baud() &&
+               send_challenge(&challenge) &&
+               get_response_features(&response) &&
+               get_response_signature(&response);
+  } while (finish_response());
+
+  // Send LINK_DONE before waiting for the fob, as the car's main loop carries on meanwhile
+  uart_flush(FOB_UART);
+  pthread_join(fob, NULL);
+  return received;
+}
+
+int main(int argc, char **argv) {
+  uint8_t probe = 0xA5;
+  uint32_t exchanges;
+  uint32_t i;
+
+  peer_listen("SIM_UART1", argv);
+
+  uart_init();
+  setup_board_link();
+  peer = peer_connect("SIM_UART1");
+
+  // The first byte through proves the connection is up
+  peer_send(peer, &probe, 1);
+  CHECK(uart_readb(FOB_UART) == probe);
+
+  // A garbled check moves the same unlock to the next rate at once
+  play[0] = (FOB_PLAY){ .rate = LINK_BAUD_COUNT - 1, .garble = true };
+  play[1] = (FOB_PLAY){ .rate = LINK_BAUD_COUNT - 2 };
+  play_count = 2;
+  CHECK(unlock(&exchanges));
+  CHECK(exchanges == 1);
+  CHECK(link_rate == LINK_BAUD_COUNT - 2);
+  CHECK(link_rate_current == 0);
+
+  // A response lost at a negotiated rate is tried again with a new exchange one rate down
+  play[0] = (FOB_PLAY){ .rate = LINK_BAUD_COUNT - 2, .silent = true };
+  play[1] = (FOB_PLAY){ .rate = LINK_BAUD_COUNT - 3 };
+  play_count = 2;
+  CHECK(unlock(&exchanges));
+  CHECK(exchanges == 2);
+  CHECK(link_rate == LINK_BAUD_COUNT - 3);
+
+  // Once the lowered rate has carried enough responses, the retried one above among them,
+  // the faster one is offered again
+  play[0] = (FOB_PLAY){ .rate = LINK_BAUD_COUNT - 3 };
+  play_count = 1;
+  for (i = 1; i < LINK_RAISE_AFTER; i++) {
+    CHECK(unlock(&exchanges));
+    CHECK(exchanges == 1);
+  }
+  CHECK(link_rate == LINK_BAUD_COUNT - 2);
+
+  play[0] = (FOB_PLAY){ .rate = LINK_BAUD_COUNT - 2 };
+  CHECK(unlock(&exchanges));
+  CHECK(link_rate == LINK_BAUD_COUNT - 2);
+
+  // A response lost at BAUD is not retried
+  link_rate = 0;
+  play[0] = (FOB_PLAY){ .rate = 0, .silent = true };
+  CHECK(!unlock(&exchanges));
+  CHECK(exchanges == 1);
+
+  printf("fob: %u unlocks ended with LINK_DONE, %u unexpected bytes\n", fob_dones, fob_mistakes);
+  CHECK(fob_dones == LINK_RAISE_AFTER + 3);
+  CHECK(fob_mistakes == 0);
+
+  return test_summary("test_car_link");
+}
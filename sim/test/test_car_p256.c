@@ -0,0 +1,240 @@
+/**
+ * @file test_car_p256.c
+ * @author Spartan State Security Team
+ * @brief Known-answer tests for the car's fixed-base comb verification
+ * @date 2023
+ *
+ * This source file is part of our designed system
+ * for MITRE's 2023 Embedded System CTF (eCTF).
+ *
+ * Linked with the secrets gen_secret.py generated for the test car.
+ * The combs it built must hold the multiples of G and of the host and
+ * car keys that pycryptodome computes, and signatures pycryptodome made
+ * with those keys must verify against them, while altered ones fail,
+ * alone or as part of a batch. In a batch every signature but the last
+ * is checked through the R its recovery byte picks, which package_tool
+ * computed, so a wrong recovery byte must fail too.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "p256.h"
+#include "firmware.h"
+#include "test.h"
+#include "vectors.h"
+
+/*** Macro Definitions ***/
+#define NUM_COMBS 3
+
+/*** Globals ***/
+// Indexed as in vectors.py: G, the host key, then the car key
+const p256_affine_t *combs[NUM_COMBS];
+
+// Batch weights, as the car would draw them from its DRBG
+const uint64_t WEIGHTS[P256_MAX_BATCH] = {
+  0x9E3779B97F4A7C15, 0x0123456789ABCDEF, 0xD1B54A32D192ED03, 0x0000000000000000,
+  0xFFFFFFFFFFFFFFFF, 0x8000000000000001, 0x243F6A8885A308D3, 0x13198A2E03707344,
+};
+
+/**
+ * @brief Check the comb entries against points from scalar multiplication
+ */
+void test_comb_entries(void) {
+  p256_int_t one = {{1}};
+  p256_int_t t;
+  uint8_t bytes[P256_BYTES];
+  uint32_t i;
+
+  for (i = 0; i < COUNT(COMB_VECTORS); i++) {
+    const COMB_VECTOR *v = &COMB_VECTORS[i];
+    const p256_affine_t *point = &combs[v->comb][v->v - 1];
+
+    // Multiplying by 1 leaves Montgomery form
+    p256_mont_mul(&t, &point->x, &one, &P256_P);
+    p256_to_bytes(bytes, &t);
+    CHECK_MEM(bytes, v->x, P256_BYTES);
+    p256_mont_mul(&t, &point->y, &one, &P256_P);
+    p256_to_bytes(bytes, &t);
+    CHECK_MEM(bytes, v->y, P256_BYTES);
+  }
+
+  // Each key's comb is recognized as its own, and only its own
+  CHECK(p256_comb_matches(combs[1], HOST_PUBKEY));
+  CHECK(p256_comb_matches(combs[2], CAR_PUBKEY));
+  CHECK(!p256_comb_matches(combs[1], CAR_PUBKEY));
+  CHECK(!p256_comb_matches(combs[2], HOST_PUBKEY));
+}
+
+/**
+ * @brief Check a signature verifies, and that altering it in any way makes it fail
+ *
+ * @param sig    [in] The signature r || s
+ * @param digest [in] The signed digest
+ * @param key    [in] The signer's comb index
+ */
+void check_signature(const uint8_t sig[2 * P256_BYTES], const uint8_t digest[P256_BYTES], uint32_t key) {
+  uint8_t bad_sig[2 * P256_BYTES];
+  uint8_t bad_digest[P256_BYTES];
+  uint32_t i;
+
+  CHECK(p256_verify_comb(sig, digest, P256_G_COMB, combs[key]));
+
+  // The other key
+  CHECK(!p256_verify_comb(sig, digest, P256_G_COMB, combs[key == 1 ? 2 : 1]));
+
+  // A different digest
+  memcpy(bad_digest, digest, P256_BYTES);
+  bad_digest[P256_BYTES - 1] ^= 1;
+  CHECK(!p256_verify_comb(sig, bad_digest, P256_G_COMB, combs[key]));
+
+  // A changed r or s
+  for (i = 0; i < 2; i++) {
+    memcpy(bad_sig, sig, sizeof(bad_sig));
+    bad_sig[i * P256_BYTES + 7] ^= 0x10;
+    CHECK(!p256_verify_comb(bad_sig, digest, P256_G_COMB, combs[key]));
+  }
+
+  // r or s out of range, zero or n
+  for (i = 0; i < 2; i++) {
+    memcpy(bad_sig, sig, sizeof(bad_sig));
+    memset(&bad_sig[i * P256_BYTES], 0, P256_BYTES);
+    CHECK(!p256_verify_comb(bad_sig, digest, P256_G_COMB, combs[key]));
+    p256_to_bytes(&bad_sig[i * P256_BYTES], &P256_N.m);
+    CHECK(!p256_verify_comb(bad_sig, digest, P256_G_COMB, combs[key]));
+  }
+}
+
+/**
+ * @brief Check batches of every size, valid and with one bad signature in each position
+ */
+void test_batches(void) {
+  p256_verify_job_t jobs[P256_MAX_BATCH + 1];
+  uint8_t bad_sig[2 * P256_BYTES + 1];
+  p256_verify_job_t good;
+  uint32_t count, i;
+
+  for (i = 0; i <= P256_MAX_BATCH; i++) {
+    const SIGNATURE_VECTOR *v = &SIGNATURE_VECTORS[i % COUNT(SIGNATURE_VECTORS)];
+    jobs[i] = (p256_verify_job_t){ v->sig, v->digest, combs[v->key] };
+  }
+
+  // Empty and oversized batches are refused
+  CHECK(!p256_verify_batch(jobs, WEIGHTS, 0, P256_G_COMB));
+  CHECK(!p256_verify_batch(jobs, WEIGHTS, P256_MAX_BATCH + 1, P256_G_COMB));
+
+  for (count = 1; count <= P256_MAX_BATCH; count++) {
+    CHECK(p256_verify_batch(jobs, WEIGHTS, count, P256_G_COMB));
+
+    // Any weights pass a valid batch
+    CHECK(p256_verify_batch(jobs, &WEIGHTS[P256_MAX_BATCH - count], count, P256_G_COMB));
+
+    for (i = 0; i < count; i++) {
+      good = jobs[i];
+
+      // A changed s, which also changes the shared inversion
+      memcpy(bad_sig, good.sig, sizeof(bad_sig));
+      bad_sig[2 * P256_BYTES - 1] ^= 1;
+      jobs[i].sig = bad_sig;
+      CHECK(!p256_verify_batch(jobs, WEIGHTS, count, P256_G_COMB));
+
+      // A changed r, which moves R off the signature's point
+      memcpy(bad_sig, good.sig, sizeof(bad_sig));
+      bad_sig[P256_BYTES - 1] ^= 1;
+      CHECK(!p256_verify_batch(jobs, WEIGHTS, count, P256_G_COMB));
+
+      // A zero s, refused before any work
+      memcpy(bad_sig, good.sig, sizeof(bad_sig));
+      memset(&bad_sig[P256_BYTES], 0, P256_BYTES);
+      CHECK(!p256_verify_batch(jobs, WEIGHTS, count, P256_G_COMB));
+
+      // The other y, the x of r + n, which is past p, or an unknown recovery bit,
+      // all ignored for the last signature, which is compared on x
+      memcpy(bad_sig, good.sig, sizeof(bad_sig));
+      bad_sig[2 * P256_BYTES] ^= P256_RECOVERY_ODD_Y;
+      CHECK(p256_verify_batch(jobs, WEIGHTS, count, P256_G_COMB) == (i == count - 1));
+      memcpy(bad_sig, good.sig, sizeof(bad_sig));
+      bad_sig[2 * P256_BYTES] ^= P256_RECOVERY_HIGH_X;
+      CHECK(p256_verify_batch(jobs, WEIGHTS, count, P256_G_COMB) == (i == count - 1));
+      memcpy(bad_sig, good.sig, sizeof(bad_sig));
+      bad_sig[2 * P256_BYTES] ^= 0x80;
+      CHECK(p256_verify_batch(jobs, WEIGHTS, count, P256_G_COMB) == (i == count - 1));
+
+      // The wrong key
+      jobs[i] = good;
+      jobs[i].q_comb = combs[good.q_comb == combs[1] ? 2 : 1];
+      CHECK(!p256_verify_batch(jobs, WEIGHTS, count, P256_G_COMB));
+
+      jobs[i] = good;
+    }
+  }
+}
+
+/**
+ * @brief Check a batch whose last signature is given once the others are recovered, or while the walk waits for it
+ */
+void test_last_later(void) {
+  p256_verify_ctx_t ctx;
+  p256_verify_job_t jobs[P256_MAX_BATCH];
+  uint32_t count, i;
+
+  for (i = 0; i < P256_MAX_BATCH; i++) {
+    const SIGNATURE_VECTOR *v = &SIGNATURE_VECTORS[i % COUNT(SIGNATURE_VECTORS)];
+    jobs[i] = (p256_verify_job_t){ v->sig, v->digest, combs[v->key] };
+  }
+
+  for (count = 0; count < P256_MAX_BATCH; count++) {
+    // The recovery stops to wait, undecided
+    CHECK(p256_verify_start(&ctx, jobs, WEIGHTS, count, P256_G_COMB));
+    while (!p256_verify_continue(&ctx)) {
+    }
+    CHECK(ctx.phase == P256_VERIFY_WAIT);
+    CHECK(!p256_verify_finish(&ctx));
+
+    // Then finishes once the last signature is in, and takes no other
+    CHECK(p256_verify_last(&ctx, &jobs[count]));
+    CHECK(!p256_verify_last(&ctx, &jobs[count]));
+    CHECK(ctx.phase == P256_VERIFY_FAILED);
+
+    CHECK(p256_verify_start(&ctx, jobs, WEIGHTS, count, P256_G_COMB));
+    while (!p256_verify_continue(&ctx)) {
+    }
+    CHECK(p256_verify_last(&ctx, &jobs[count]));
+    while (!p256_verify_continue(&ctx)) {
+    }
+    CHECK(p256_verify_finish(&ctx));
+
+    // Or is given it while the weight bits above the comb columns are walked
+    if (count) {
+      CHECK(p256_verify_start(&ctx, jobs, WEIGHTS, count, P256_G_COMB));
+      while (ctx.phase == P256_VERIFY_RECOVER && !p256_verify_continue(&ctx)) {
+      }
+      CHECK(ctx.phase == P256_VERIFY_WEIGHTS);
+      CHECK(p256_verify_last(&ctx, &jobs[count]));
+      while (!p256_verify_continue(&ctx)) {
+      }
+      CHECK(p256_verify_finish(&ctx));
+    }
+  }
+
+  // A batch which can no longer take a last signature
+  CHECK(!p256_verify_start(&ctx, jobs, WEIGHTS, P256_MAX_BATCH, P256_G_COMB));
+  CHECK(!p256_verify_last(&ctx, &jobs[0]));
+}
+
+int main(void) {
+  uint32_t i;
+
+  combs[0] = P256_G_COMB;
+  combs[1] = DEVICE_SECRETS.host_pubkey_comb;
+  combs[2] = DEVICE_SECRETS.car_pubkey_comb;
+
+  test_comb_entries();
+  for (i = 0; i < COUNT(SIGNATURE_VECTORS); i++) {
+    check_signature(SIGNATURE_VECTORS[i].sig, SIGNATURE_VECTORS[i].digest, SIGNATURE_VECTORS[i].key);
+  }
+  test_batches();
+  test_last_later();
+
+  return test_summary("test_car_p256");
+}
@@ -0,0 +1,144 @@
+/**
+ * @file test_car_store.c
+ * @author Spartan State Security Team
+ * @brief Checks the car reads its EEPROM once at boot, and never during an unlock
+ * @date 2023
+ *
+ * This source file is part of our designed system
+ * for MITRE's 2023 Embedded System CTF (eCTF).
+ *
+ * Linked with the test car's firmware, with the EEPROM driver calls
+ * wrapped to count them. The mirror must hold the keys gen_secret.py
+ * wrote, and a full unlock, from the challenge to the last feature
+ * message, must not touch the EEPROM.
+ *
+ * The simulated EEPROM takes no time, so the time saved per unlock is
+ * modelled from the calls the car made before the mirror, at
+ * EEPROM_INIT_CYCLES per initialization and EEPROM_WORD_CYCLES per word
+ * read. These are assumed figures for the TivaWare driver on the
+ * TM4C123, not measured on a board: the initialization resets the
+ * EEPROM and waits for its controller twice, a read selects the block
+ * and takes each word through the increment register.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sb_all.h"
+
+#include "sim.h"
+#include "store.h"
+#include "uart.h"
+#include "firmware.h"
+#include "test.h"
+#include "vectors.h"
+
+/*** Macro Definitions ***/
+// Modelled EEPROM driver timings, in cycles
+#define EEPROM_INIT_CYCLES 1000
+#define EEPROM_WORD_CYCLES 8
+
+// What an unlock with every feature read before the mirror: the car's
+// keys and unlock message, and one feature message per feature
+#define OLD_UNLOCK_INITS (2 + NUM_FEATURES)
+#define OLD_UNLOCK_READS (3 + NUM_FEATURES)
+#define OLD_UNLOCK_BYTES (2 * sizeof(sb_sw_public_t) + UNLOCK_EEPROM_SIZE + NUM_FEATURES * FEATURE_SIZE)
+
+// and the first unlock after boot also read the car's key to start the DRBG
+#define OLD_FIRST_INITS 1
+#define OLD_FIRST_READS 1
+#define OLD_FIRST_BYTES sizeof(sb_sw_public_t)
+
+#define EEPROM_CYCLES(inits, bytes) \
+  ((uint64_t)(inits) * EEPROM_INIT_CYCLES + (uint64_t)(bytes) / sizeof(uint32_t) * EEPROM_WORD_CYCLES)
+
+/*** Globals ***/
+uint32_t eeprom_inits = 0;
+uint32_t eeprom_reads = 0;
+uint32_t eeprom_bytes = 0;
+
+/*** EEPROM driver, counted ***/
+uint32_t __real_EEPROMInit(void);
+void __real_EEPROMRead(uint32_t *pui32Data, uint32_t ui32Address, uint32_t ui32Count);
+
+uint32_t __wrap_EEPROMInit(void) {
+  eeprom_inits++;
+  return __real_EEPROMInit();
+}
+
+void __wrap_EEPROMRead(uint32_t *pui32Data, uint32_t ui32Address, uint32_t ui32Count) {
+  eeprom_reads++;
+  eeprom_bytes += ui32Count;
+  __real_EEPROMRead(pui32Data, ui32Address, ui32Count);
+}
+
+int main(void) {
+  const CAR_DATA *car_data;
+  CHALLENGE challenge;
+  RESPONSE response;
+  VERIFICATION verification;
+  uint32_t i;
+
+  uart_init();
+
+  // One initialization, and a handful of reads of the whole image
+  CHECK(store_init());
+  printf("boot: %u EEPROM initializations, %u reads of %u bytes\n", eeprom_inits, eeprom_reads, eeprom_bytes);
+  CHECK(eeprom_inits == 1);
+  CHECK(eeprom_reads > 0);
+
+  // The mirror holds what gen_secret.py wrote
+  car_data = store_car_data();
+  CHECK(car_data != NULL);
+  if (car_data) {
+    CHECK_MEM(car_data->host_pubkey.bytes, HOST_PUBKEY, sizeof(HOST_PUBKEY));
+    CHECK_MEM(car_data->car_pubkey.bytes, CAR_PUBKEY, sizeof(CAR_PUBKEY));
+  }
+  CHECK(store_unlock_message() != NULL);
+  for (i = 0; i < NUM_FEATURES; i++) {
+    CHECK(store_feature_message(i) != NULL);
+  }
+  CHECK(store_feature_message(NUM_FEATURES) == NULL);
+
+  // The first unlock with every feature, which starts the DRBG
+  eeprom_inits = eeprom_reads = eeprom_bytes = 0;
+  memset(&response, 0, sizeof(response));
+  for (i = 0; i < NUM_FEATURES; i++) {
+    PRESENT_SET(response.present, i);
+  }
+  memcpy(response.unlock.bytes, UNLOCK_SIGNATURE, sizeof(response.unlock));
+  memcpy(response.feature, FEATURE_PACKAGES, sizeof(response.feature));
+
+  CHECK(gen_challenge(&challenge));
+  memcpy(challenge.data, UNLOCK_CHALLENGE, sizeof(challenge));
+  CHECK(verify_features(&verification, &response));
+  CHECK(verify_response(&verification, &challenge, &response));
+  CHECK(unlockCar(&response));
+  CHECK(startCar(&response));
+
+  printf("first unlock: %u EEPROM initializations, %u reads of %u bytes, was %u, %u of %u\n", eeprom_inits,
+         eeprom_reads, eeprom_bytes, OLD_FIRST_INITS + OLD_UNLOCK_INITS, OLD_FIRST_READS + OLD_UNLOCK_READS,
+         (uint32_t)(OLD_FIRST_BYTES + OLD_UNLOCK_BYTES));
+  printf("first unlock: %llu modelled EEPROM cycles saved\n",
+         (unsigned long long)EEPROM_CYCLES(OLD_FIRST_INITS + OLD_UNLOCK_INITS, OLD_FIRST_BYTES + OLD_UNLOCK_BYTES));
+  CHECK(eeprom_inits == 0);
+  CHECK(eeprom_reads == 0);
+
+  // A later unlock, the DRBG already running
+  eeprom_inits = eeprom_reads = eeprom_bytes = 0;
+  CHECK(gen_challenge(&challenge));
+  memcpy(challenge.data, UNLOCK_CHALLENGE, sizeof(challenge));
+  CHECK(verify_features(&verification, &response));
+  CHECK(verify_response(&verification, &challenge, &response));
+  CHECK(unlockCar(&response));
+  CHECK(startCar(&response));
+
+  printf("later unlock: %u EEPROM initializations, %u reads of %u bytes, was %u, %u of %u\n", eeprom_inits,
+         eeprom_reads, eeprom_bytes, OLD_UNLOCK_INITS, OLD_UNLOCK_READS, (uint32_t)OLD_UNLOCK_BYTES);
+  printf("later unlock: %llu modelled EEPROM cycles saved\n",
+         (unsigned long long)EEPROM_CYCLES(OLD_UNLOCK_INITS, OLD_UNLOCK_BYTES));
+  CHECK(eeprom_inits == 0);
+  CHECK(eeprom_reads == 0);
+
+  return test_summary("test_car_store");
+}
@@ -0,0 +1,202 @@
+/**
+ * @file test_car_verify_slices.c
+ * @author Spartan State Security Team
+ * @brief Times the car's verification slices, and checks no byte is lost while they run
+ * @date 2023
+ *
+ * This source file is part of our designed system
+ * for MITRE's 2023 Embedded System CTF (eCTF).
+ *
+ * Linked with the test car's firmware, with service_response wrapped
+ * to time the slice before each call. The car receives the feature
+ * packages and starts verifying them as tryUnlock does, then finishes
+ * the batch with the unlock signature. Meanwhile a thread plays the
+ * fob, sending the signature
+ * right behind the packages, and the host, streaming into UART 0. The
+ * signature must be picked up between slices, and both streams must
+ * arrive whole with no overrun.
+ *
+ * The slices run at the host's speed, so their length only shows the
+ * work is split evenly. The longest is checked against the time the
+ * fastest board link rate takes to fill the receive FIFO, which bounds
+ * it with room to spare here; on the boards the cycles each stage takes
+ * come from UNLOCK_PROFILE.
+ */
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "inc/hw_memmap.h"
+
+#include "sim.h"
+#include "uart.h"
+#include "board_link.h"
+#include "firmware.h"
+#include "store.h"
+#include "peer.h"
+#include "test.h"
+#include "vectors.h"
+
+/*** Macro Definitions ***/
+// The feature part of a response: bitmap, then the packages present
+#define FEATURES_SIZE(num_present) (PRESENT_SIZE + (num_present) * sizeof(PACKAGE))
+
+// Bytes the host streams while the car verifies
+#define HOST_BYTES 256
+
+// Time the fastest board link rate takes to fill the receive FIFO, in cycles
+#define FIFO_FILL_CYCLES ((uint64_t)SIM_SPEED * 10 * SIM_UART_FIFO_SIZE / 2000000)
+
+/*** Globals ***/
+extern bool part_sized;
+
+int fob = -1, host = -1;
+
+// Slice lengths, measured from the start of a verification or the previous call
+uint64_t slice_start;
+uint64_t slice_longest = 0;
+uint64_t slice_total = 0;
+uint32_t slices = 0;
+
+// Calls which found the signature arriving and started its transfer
+uint32_t picked_up = 0;
+
+/*** Board link, timed ***/
+void __real_service_response(RESPONSE *response);
+
+void __wrap_service_response(RESPONSE *response) {
+  uint64_t now = sim_cycles();
+  bool sized = part_sized;
+
+  slice_total += now - slice_start;
+  slice_longest = now - slice_start > slice_longest ? now - slice_start : slice_longest;
+  slices++;
+
+  __real_service_response(response);
+  picked_up += !sized && part_sized;
+  slice_start = sim_cycles();
+}
+
+/**
+ * @brief Play the fob and the host: the response with every feature, and a stream into UART 0
+ *
+ * @param arg [in] Unused
+ *
+ * @return NULL
+ */
+void *peers_thread(void *arg) {
+  uint8_t reply[1 + FEATURES_SIZE(NUM_FEATURES) + 1 + sizeof(UNLOCK_SIGNATURE)];
+  uint8_t stream[HOST_BYTES];
+  uint32_t i;
+
+  reply[0] = RESP_START;
+  memset(&reply[1], 0, PRESENT_SIZE);
+  for (i = 0; i < NUM_FEATURES; i++) {
+    PRESENT_SET(&reply[1], i);
+    memcpy(&reply[1 + FEATURES_SIZE(i)], FEATURE_PACKAGES[i], sizeof(PACKAGE));
+  }
+  reply[1 + FEATURES_SIZE(NUM_FEATURES)] = SIG_START;
+  memcpy(&reply[2 + FEATURES_SIZE(NUM_FEATURES)], UNLOCK_SIGNATURE, sizeof(UNLOCK_SIGNATURE));
+
+  for (i = 0; i < HOST_BYTES; i++) {
+    stream[i] = (uint8_t)(i * 7 + 1);
+  }
+
+  // The line paces both, so they arrive while the car works
+  peer_send(fob, reply, sizeof(reply));
+  peer_send(host, stream, sizeof(stream));
+  return NULL;
+}
+
+/**
+ * @brief Start timing the slices of a verification stage
+ */
+void slices_start(void) {
+  slice_start = sim_cycles();
+}
+
+/**
+ * @brief Time the last slice of a verification stage
+ *
+ * @param response [out] The response still being received
+ */
+void slices_end(RESPONSE *response) {
+  __wrap_service_response(response);
+}
+
+int main(int argc, char **argv) {
+  VERIFICATION verification;
+  uint8_t stream[HOST_BYTES];
+  CHALLENGE challenge;
+  RESPONSE response;
+  pthread_t peers;
+  sigset_t alarm;
+  uint8_t probe = 0xA5;
+  uint32_t i, wrong = 0;
+
+  peer_listen("SIM_UART0", argv);
+  peer_listen("SIM_UART1", argv);
+
+  // The batch weights come from the DRBG, seeded by the challenge tryUnlock generates first
+  CHECK(store_init());
+  CHECK(gen_challenge(&challenge));
+  uart_init();
+  setup_board_link();
+  host = peer_connect("SIM_UART0");
+  fob = peer_connect("SIM_UART1");
+
+  // The first byte through each proves the connection is up
+  peer_send(host, &probe, 1);
+  CHECK(uart_readb(HOST_UART) == probe);
+  peer_send(fob, &probe, 1);
+  CHECK(uart_readb(FOB_UART) == probe);
+
+  // The simulated interrupts must land on this thread, which runs the car
+  sigemptyset(&alarm);
+  sigaddset(&alarm, SIGALRM);
+  pthread_sigmask(SIG_BLOCK, &alarm, NULL);
+  pthread_create(&peers, NULL, peers_thread, NULL);
+  pthread_sigmask(SIG_UNBLOCK, &alarm, NULL);
+
+  // The packages, then the start of their verification while the signature arrives
+  memset(&response, 0, sizeof(response));
+  CHECK(get_response_features(&response));
+  for (i = 0; i < NUM_FEATURES; i++) {
+    CHECK_MEM(&response.feature[i], FEATURE_PACKAGES[i], sizeof(PACKAGE));
+  }
+  slices_start();
+  CHECK(verify_features(&verification, &response));
+  slices_end(&response);
+  CHECK(picked_up == 1);
+
+  // Then the unlock signature, finishing the batch
+  CHECK(get_response_signature(&response));
+  CHECK_MEM(response.unlock.bytes, UNLOCK_SIGNATURE, sizeof(UNLOCK_SIGNATURE));
+  memcpy(challenge.data, UNLOCK_CHALLENGE, sizeof(challenge));
+  slices_start();
+  CHECK(verify_response(&verification, &challenge, &response));
+  slices_end(&response);
+  finish_response();
+
+  // The host's stream waited in the ring buffer throughout
+  pthread_join(peers, NULL);
+  CHECK(uart_read(HOST_UART, stream, HOST_BYTES) == HOST_BYTES);
+  for (i = 0; i < HOST_BYTES; i++) {
+    wrong += stream[i] != (uint8_t)(i * 7 + 1);
+  }
+  CHECK(wrong == 0);
+  CHECK(uart_overruns(HOST_UART) == 0);
+  CHECK(uart_overruns(FOB_UART) == 0);
+
+  printf("%u slices, mean %.1f us, longest %.1f us, against %.1f us to fill the FIFO at 2 Mbaud\n", slices,
+         (double)slice_total / slices * 1000000 / SIM_SPEED, (double)slice_longest * 1000000 / SIM_SPEED,
+         (double)FIFO_FILL_CYCLES * 1000000 / SIM_SPEED);
+  printf("signature picked up between slices %u time(s), %u host bytes wrong\n", picked_up, wrong);
+  CHECK(slice_longest < FIFO_FILL_CYCLES);
+
+  return test_summary("test_car_verify_slices");
+}
@@ -0,0 +1,151 @@
+/**
+ * @file test_fob_link.c
+ * @author Spartan State Security Team
+ * @brief Measures the unlock response on the board link for every feature combination
+ * @date 2023
+ *
+ * This source file is part of our designed system
+ * for MITRE's 2023 Embedded System CTF (eCTF).
+ *
+ * Linked with the fob's board link and UART driver. The test is the
+ * car on the other end of UART 1: for each combination of features it
+ * receives the response the fob sends, checks every byte against the
+ * bitmap and packages it should carry, and times it at BAUD. The full
+ * response the fob used to send, a start byte and 256 bytes with every
+ * package slot filled, is timed the same way and the bytes and
+ * milliseconds saved are reported.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "inc/hw_memmap.h"
+
+#include "sim.h"
+#include "uart.h"
+#include "board_link.h"
+#include "firmware.h"
+#include "peer.h"
+#include "test.h"
+#include "vectors.h"
+
+/*** Macro Definitions ***/
+// The full response: start byte, signature and a package slot for every feature
+#define FULL_SIZE (1 + 64 + NUM_FEATURES * sizeof(PACKAGE))
+
+// The compact response: the feature part and the signature, each with its start byte
+#define COMPACT_SIZE(num_present) (1 + RESPONSE_FEATURES_SIZE(num_present) + 1 + sizeof(sb_sw_signature_t))
+
+// Milliseconds in a number of cycles
+#define MS(cycles) ((double)(cycles) * 1000 / SIM_SPEED)
+
+/*** Globals ***/
+int peer = -1;
+
+/**
+ * @brief Receive the full response, as the fob sent it before the compact format
+ *
+ * @return the cycles from the first byte queued to the last one received
+ */
+uint64_t time_full(void) {
+  static uint8_t out[FULL_SIZE], in[FULL_SIZE];
+  uint64_t start;
+
+  out[0] = RESP_START;
+  memcpy(&out[1], UNLOCK_SIGNATURE, sizeof(UNLOCK_SIGNATURE));
+  memcpy(&out[1 + sizeof(UNLOCK_SIGNATURE)], FEATURE_PACKAGES, sizeof(FEATURE_PACKAGES));
+
+  start = sim_cycles();
+  uart_write(BOARD_UART, out, FULL_SIZE);
+  CHECK(peer_recv(peer, in, FULL_SIZE));
+  start = sim_cycles() - start;
+
+  CHECK_MEM(in, out, FULL_SIZE);
+  return start;
+}
+
+/**
+ * @brief Receive the compact response for one combination of features
+ *
+ * @param features [in] The features present, one bit each
+ * @param size     [out] The bytes the response took
+ *
+ * @return the cycles from the first byte queued to the last one received
+ */
+uint64_t time_compact(uint32_t features, uint32_t *size) {
+  static uint8_t expected[COMPACT_SIZE(NUM_FEATURES)], in[COMPACT_SIZE(NUM_FEATURES)];
+  RESPONSE response;
+  uint32_t count = 0, len;
+  uint64_t start;
+  uint32_t i;
+
+  // Absent slots hold junk the fob must not send
+  memset(&response, 0xA5, sizeof(response));
+  memset(response.present, 0, PRESENT_SIZE);
+  memcpy(response.unlock.bytes, UNLOCK_SIGNATURE, sizeof(UNLOCK_SIGNATURE));
+  for (i = 0; i < NUM_FEATURES; i++) {
+    if (features & (1 << i)) {
+      PRESENT_SET(response.present, i);
+      memcpy(response.feature[i].bytes, FEATURE_PACKAGES[i], sizeof(PACKAGE));
+    }
+  }
+
+  // Start byte and bitmap, the present packages in feature order, then the signature
+  expected[0] = RESP_START;
+  memcpy(&expected[1], response.present, PRESENT_SIZE);
+  for (i = 0; i < NUM_FEATURES; i++) {
+    if (features & (1 << i)) {
+      memcpy(&expected[1 + RESPONSE_FEATURES_SIZE(count++)], FEATURE_PACKAGES[i], sizeof(PACKAGE));
+    }
+  }
+  len = 1 + RESPONSE_FEATURES_SIZE(count);
+  expected[len] = SIG_START;
+  memcpy(&expected[len + 1], UNLOCK_SIGNATURE, sizeof(UNLOCK_SIGNATURE));
+  *size = COMPACT_SIZE(count);
+
+  start = sim_cycles();
+  send_features(&response);
+  finalize_unlock(&response);
+  CHECK(peer_recv(peer, in, *size));
+  start = sim_cycles() - start;
+
+  CHECK_MEM(in, expected, *size);
+  return start;
+}
+
+int main(int argc, char **argv) {
+  uint64_t full, compact;
+  uint32_t features, size;
+  uint8_t probe = 0xA5;
+
+  peer_listen("SIM_UART1", argv);
+
+  uart_init();
+  setup_board_link();
+  peer = peer_connect("SIM_UART1");
+
+  // The first byte through proves the connection is up
+  peer_send(peer, &probe, 1);
+  CHECK(uart_readb(BOARD_UART) == probe);
+
+  full = time_full();
+  printf("full response: %u bytes in %.2f ms\n", (uint32_t)FULL_SIZE, MS(full));
+  printf("features  bytes  saved      ms  saved ms\n");
+
+  for (features = 0; features < (1 << NUM_FEATURES); features++) {
+    compact = time_compact(features, &size);
+    printf("%8x  %5u  %5d  %6.2f  %8.2f\n", features, size, (int)FULL_SIZE - (int)size,
+           MS(compact), MS(full) - MS(compact));
+
+    // Each package left out saves its 64 bytes on the line
+    CHECK(size + (NUM_FEATURES - __builtin_popcount(features)) * sizeof(PACKAGE) == COMPACT_SIZE(NUM_FEATURES));
+    if (size < FULL_SIZE) {
+      CHECK(compact < full);
+    }
+  }
+
+  return test_summary("test_fob_link");
+}
@@ -0,0 +1,128 @@
+/**
+ * @file test_fob_p256.c
+ * @author Spartan State Security Team
+ * @brief Known-answer tests for the fob's scalar arithmetic
+ * @date 2023
+ *
+ * This source file is part of our designed system
+ * for MITRE's 2023 Embedded System CTF (eCTF).
+ *
+ * Checks the arithmetic modulo n behind presigning against values
+ * computed in Python by vectors.py, then finishes each presigned
+ * signature the way sign_presigned does and compares it with the
+ * signature pycryptodome verified.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "p256.h"
+#include "test.h"
+#include "vectors.h"
+
+/**
+ * @brief Check that a Montgomery form value matches an expected integer
+ *
+ * @param mont     [in] The value in Montgomery form
+ * @param expected [in] The expected integer, big-endian
+ */
+void check_mont(const p256_int_t *mont, const uint8_t expected[P256_BYTES]) {
+  p256_int_t one = {{1}};
+  p256_int_t t;
+  uint8_t bytes[P256_BYTES];
+
+  // Multiplying by 1 leaves Montgomery form
+  p256_mont_mul(&t, mont, &one, &P256_N);
+  p256_to_bytes(bytes, &t);
+  CHECK_MEM(bytes, expected, P256_BYTES);
+}
+
+/**
+ * @brief Check conversion, addition, multiplication and inversion modulo n
+ */
+void test_scalars(void) {
+  p256_int_t a, b, am, bm, t;
+  uint8_t bytes[P256_BYTES];
+  uint32_t i;
+
+  for (i = 0; i < COUNT(SCALAR_VECTORS); i++) {
+    const SCALAR_VECTOR *v = &SCALAR_VECTORS[i];
+
+    p256_from_bytes(&a, v->a);
+    p256_from_bytes(&b, v->b);
+    p256_to_bytes(bytes, &a);
+    CHECK_MEM(bytes, v->a, P256_BYTES);
+    CHECK(!p256_is_zero(&a));
+
+    p256_mod_add(&t, &a, &b, &P256_N);
+    p256_to_bytes(bytes, &t);
+    CHECK_MEM(bytes, v->sum, P256_BYTES);
+
+    p256_to_mont(&am, &a, &P256_N);
+    p256_to_mont(&bm, &b, &P256_N);
+    check_mont(&am, v->a);
+
+    p256_mont_mul(&t, &am, &bm, &P256_N);
+    check_mont(&t, v->product);
+
+    // Mixing forms drops one factor of R, as sign_presigned relies on
+    p256_mont_mul(&t, &am, &b, &P256_N);
+    p256_to_bytes(bytes, &t);
+    CHECK_MEM(bytes, v->product, P256_BYTES);
+
+    p256_mont_inv(&t, &am, &P256_N);
+    check_mont(&t, v->inverse);
+  }
+
+  for (i = 0; i < COUNT(REDUCE_VECTORS); i++) {
+    p256_from_bytes(&t, REDUCE_VECTORS[i].x);
+    p256_mod_reduce(&t, &P256_N);
+    p256_to_bytes(bytes, &t);
+    CHECK_MEM(bytes, REDUCE_VECTORS[i].reduced, P256_BYTES);
+  }
+
+  // n itself reduces to zero
+  p256_from_bytes(&t, REDUCE_VECTORS[0].x);
+  p256_mod_reduce(&t, &P256_N);
+  CHECK(p256_is_zero(&t));
+}
+
+/**
+ * @brief Finish presigned signatures as sign_presigned does
+ *
+ * presign keeps r and k^-1 in Montgomery form and the key stays plain,
+ * so s = k^-1 * (z + r * d) comes out plain after two multiplications.
+ */
+void test_presigned(void) {
+  p256_int_t k_inv, r, d, z, s;
+  uint8_t bytes[P256_BYTES];
+  uint32_t i;
+
+  for (i = 0; i < COUNT(PRESIGN_VECTORS); i++) {
+    const PRESIGN_VECTOR *v = &PRESIGN_VECTORS[i];
+
+    // Offline half, as presign computes it from k and x(kG)
+    p256_from_bytes(&r, v->r);
+    p256_to_mont(&r, &r, &P256_N);
+    p256_from_bytes(&k_inv, v->k);
+    p256_to_mont(&k_inv, &k_inv, &P256_N);
+    p256_mont_inv(&k_inv, &k_inv, &P256_N);
+
+    // Online half
+    p256_from_bytes(&d, v->d);
+    p256_from_bytes(&z, v->digest);
+    p256_mod_reduce(&z, &P256_N);
+    p256_mont_mul(&s, &r, &d, &P256_N);
+    p256_mod_add(&s, &s, &z, &P256_N);
+    p256_mont_mul(&s, &k_inv, &s, &P256_N);
+
+    p256_to_bytes(bytes, &s);
+    CHECK_MEM(bytes, v->s, P256_BYTES);
+  }
+}
+
+int main(void) {
+  test_scalars();
+  test_presigned();
+  return test_summary("test_fob_p256");
+}
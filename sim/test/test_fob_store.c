@@ -0,0 +1,102 @@
+/**
+ * @file test_fob_store.c
+ * @author Spartan State Security Team
+ * @brief Checks the fob reads its EEPROM once at boot, and never while signing
+ * @date 2023
+ *
+ * This source file is part of our designed system
+ * for MITRE's 2023 Embedded System CTF (eCTF).
+ *
+ * Linked with the paired fob's firmware, with the EEPROM driver calls
+ * wrapped to count them. Looking up the fob's secrets, as every
+ * unlock and pairing does, must be served from the RAM mirror.
+ *
+ * The time saved per unlock is modelled as in test_car_store, from the
+ * initialization and the read of the car's private key that
+ * sign_presigned() made before the mirror.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sb_all.h"
+
+#include "sim.h"
+#include "store.h"
+#include "firmware.h"
+#include "test.h"
+
+/*** Macro Definitions ***/
+// Pairing pin of the test fob, as given to gen_secret.py
+#define TEST_PIN 0x123456
+
+// Modelled EEPROM driver timings, in cycles, as in test_car_store
+#define EEPROM_INIT_CYCLES 1000
+#define EEPROM_WORD_CYCLES 8
+
+// What signing an unlock read before the mirror
+#define OLD_UNLOCK_INITS 1
+#define OLD_UNLOCK_READS 1
+#define OLD_UNLOCK_BYTES sizeof(sb_sw_private_t)
+
+/*** Globals ***/
+extern PRESIGN presign_pool[PRESIGN_POOL_SIZE];
+
+uint32_t eeprom_inits = 0;
+uint32_t eeprom_reads = 0;
+uint32_t eeprom_bytes = 0;
+
+/*** EEPROM driver, counted ***/
+uint32_t __real_EEPROMInit(void);
+void __real_EEPROMRead(uint32_t *pui32Data, uint32_t ui32Address, uint32_t ui32Count);
+
+uint32_t __wrap_EEPROMInit(void) {
+  eeprom_inits++;
+  return __real_EEPROMInit();
+}
+
+void __wrap_EEPROMRead(uint32_t *pui32Data, uint32_t ui32Address, uint32_t ui32Count) {
+  eeprom_reads++;
+  eeprom_bytes += ui32Count;
+  __real_EEPROMRead(pui32Data, ui32Address, ui32Count);
+}
+
+int main(void) {
+  sb_sw_private_t priv;
+  sb_sw_signature_t sig;
+  CHALLENGE challenge;
+  uint32_t pin;
+  uint32_t i;
+
+  CHECK(store_init());
+  CHECK(eeprom_inits == 1);
+  CHECK(eeprom_reads > 0);
+
+  // The mirror holds what gen_secret.py wrote
+  CHECK(pfob());
+  CHECK(get_secret(NULL, &pin));
+  CHECK(pin == TEST_PIN);
+
+  // Everything an unlock reads comes from RAM
+  eeprom_inits = eeprom_reads = eeprom_bytes = 0;
+  memset(&challenge, 0, sizeof(challenge));
+  for (i = 0; i < 16; i++) {
+    CHECK(get_secret(&priv, &pin));
+    CHECK(pfob());
+  }
+  CHECK(init_drbg());
+  CHECK(presign(&presign_pool[0]));
+  CHECK(eeprom_inits == 0);
+  CHECK(eeprom_reads == 0);
+
+  CHECK(sign_presigned(&challenge, &sig));
+  printf("unlock: %u EEPROM initializations, %u reads of %u bytes, was %u, %u of %u\n", eeprom_inits, eeprom_reads,
+         eeprom_bytes, OLD_UNLOCK_INITS, OLD_UNLOCK_READS, (uint32_t)OLD_UNLOCK_BYTES);
+  printf("unlock: %llu modelled EEPROM cycles saved\n",
+         (unsigned long long)(OLD_UNLOCK_INITS * EEPROM_INIT_CYCLES +
+                              OLD_UNLOCK_BYTES / sizeof(uint32_t) * EEPROM_WORD_CYCLES));
+  CHECK(eeprom_inits == 0);
+  CHECK(eeprom_reads == 0);
+
+  return test_summary("test_fob_store");
+}
@@ -0,0 +1,193 @@
+/**
+ * @file test_fob_store_tear.c
+ * @author Spartan State Security Team
+ * @brief Cuts the fob's flash log off after every flash operation and checks what boots back
+ * @date 2023
+ *
+ * This source file is part of our designed system
+ * for MITRE's 2023 Embedded System CTF (eCTF).
+ *
+ * Linked with the fob's store and flash queue on the simulated flash.
+ * The fob is paired and then given features over and over, each change
+ * flushed as the host commands do, until the log has been compacted
+ * into the other page several times. The flash interrupt is wrapped
+ * to copy both log pages after every operation the queue retires,
+ * which is the flash a reset at that moment leaves behind. Each copy
+ * is then booted: the fob state must be the one before or after the
+ * change in progress, and the log must take a new change and keep it.
+ * Last, operations the flash controller refuses must be reported by
+ * the flush at the next point the fob's writes must be durable.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "driverlib/flash.h"
+
+#include "sim.h"
+#include "store.h"
+#include "firmware.h"
+#include "entropy.h"
+#include "test.h"
+
+/*** Macro Definitions ***/
+// Changes made after pairing, enough to compact the log several times
+#define CHANGES (4 * FOB_RECORDS_PER_PAGE)
+
+// Room for a copy after every operation the changes queue
+#define MAX_TEARS (CHANGES * 2 * (sizeof(FOB_RECORD) / sizeof(uint32_t)))
+
+// Pairing pin given to the fob
+#define TEST_PIN 0x123456
+
+/*** Structure definitions ***/
+// Defines a struct for the flash a reset leaves behind
+typedef struct {
+  uint8_t pages[2 * FOB_STORE_PAGE_SIZE];
+  uint32_t step;  // the change in progress
+} TEAR;
+
+/*** Globals ***/
+extern uint32_t fob_generation;
+
+// The fob state after each change, the first before any
+FOB_DATA states[CHANGES + 2];
+
+TEAR tears[MAX_TEARS];
+uint32_t tear_count = 0;
+bool tearing = false;
+uint32_t step = 0;
+
+// Set to have the flash controller refuse the next operation
+bool refuse = false;
+
+/*** Flash driver, copied after every operation ***/
+uint32_t __real_FlashIntStatus(bool bMasked);
+
+uint32_t __wrap_FlashIntStatus(bool bMasked) {
+  // The queue reads the status once an operation has finished
+  if (tearing && tear_count < MAX_TEARS) {
+    memcpy(tears[tear_count].pages, (const void *)FOB_STORE_PAGE_A, sizeof(tears[0].pages));
+    tears[tear_count++].step = step;
+  }
+  if (refuse) {
+    refuse = false;
+    return __real_FlashIntStatus(bMasked) | FLASH_INT_ACCESS;
+  }
+  return __real_FlashIntStatus(bMasked);
+}
+
+/**
+ * @brief Check whether a stored feature slot holds a package, as the fob's firmware does
+ *
+ * @param package [in] The stored feature slot
+ *
+ * @return true if the slot holds a package, false otherwise
+ */
+bool feature_enabled(const PACKAGE *package) {
+  const uint8_t *bytes = (const uint8_t *)package;
+  uint32_t i;
+
+  for (i = 0; i < sizeof(PACKAGE); i++) {
+    if (bytes[i] != 0xFF) return true;
+  }
+  return false;
+}
+
+/**
+ * @brief Fill a package with a value unique to one change
+ *
+ * @param package [out] The package
+ * @param change  [in]  The change it belongs to
+ */
+void change_package(PACKAGE *package, uint32_t change) {
+  memset(package, (uint8_t)change, sizeof(PACKAGE));
+  memcpy(package, &change, sizeof(change));
+}
+
+/**
+ * @brief Put both log pages back as a reset left them, and boot the store on them
+ *
+ * @param pages [in] The contents of both pages
+ */
+void reboot(const uint8_t *pages) {
+  memcpy((void *)FOB_STORE_PAGE_A, pages, 2 * FOB_STORE_PAGE_SIZE);
+  CHECK(store_init());
+}
+
+int main(void) {
+  uint8_t erased[2 * FOB_STORE_PAGE_SIZE];
+  uint8_t seed[ENTROPY_SEED_SIZE] = { 0 };
+  sb_sw_private_t car_privkey;
+  FOB_DATA booted;
+  PACKAGE package;
+  uint32_t i, wrong = 0, lost = 0;
+
+  memset(erased, 0xFF, sizeof(erased));
+  reboot(erased);
+  memcpy(&states[0], store_fob_data(), sizeof(FOB_DATA));
+
+  // Pair, then change the features round and round, flushing each as the host commands do
+  memset(&car_privkey, 0x5A, sizeof(car_privkey));
+  tearing = true;
+  CHECK(store_save_pairing(&car_privkey, TEST_PIN) && store_flush());
+  memcpy(&states[++step], store_fob_data(), sizeof(FOB_DATA));
+
+  for (i = 0; i < CHANGES; i++) {
+    change_package(&package, i);
+    CHECK(store_save_feature(i % NUM_FEATURES, &package) && store_flush());
+    memcpy(&states[++step], store_fob_data(), sizeof(FOB_DATA));
+  }
+  tearing = false;
+  CHECK(tear_count < MAX_TEARS);
+  CHECK(fob_generation > 3);
+
+  // Boot every flash a reset can leave
+  for (i = 0; i < tear_count; i++) {
+    reboot(tears[i].pages);
+    memcpy(&booted, store_fob_data(), sizeof(FOB_DATA));
+    CHECK(fob_generation != FOB_STORE_ERASED);
+    if (memcmp(&booted, &states[tears[i].step], sizeof(FOB_DATA)) &&
+        memcmp(&booted, &states[tears[i].step + 1], sizeof(FOB_DATA))) {
+      wrong++;
+    }
+
+    // The log goes on from there, and keeps what it is given
+    change_package(&package, CHANGES + i);
+    CHECK(store_save_feature(0, &package) && store_flush());
+    CHECK(store_init());
+    memcpy(&booted.feature[0], &package, sizeof(PACKAGE));
+    if (memcmp(store_fob_data(), &booted, sizeof(FOB_DATA))) {
+      lost++;
+    }
+  }
+
+  printf("%u changes, %u flash operations each cut off: %u booted a wrong state, %u lost a later change\n",
+         step, tear_count, wrong, lost);
+  CHECK(wrong == 0);
+  CHECK(lost == 0);
+
+  // A page whose header has its magic but an erased generation is not the newest
+  reboot(erased);
+  CHECK(store_save_pairing(&car_privkey, TEST_PIN) && store_flush());
+  i = FOB_STORE_MAGIC;
+  CHECK(FlashProgram(&i, FOB_STORE_PAGE_B + offsetof(FOB_STORE_HEADER, magic), sizeof(i)) == 0);
+  CHECK(store_init());
+  CHECK(store_fob_data()->paired == YES_PAIRED);
+  CHECK(fob_generation == 1);
+
+  // A refused write fails the flush that should have made it durable, and only that one
+  change_package(&package, 1);
+  refuse = true;
+  CHECK(!(store_save_feature(1, &package) && store_flush()));
+  CHECK(store_save_feature(2, &package) && store_flush());
+
+  seed[0] = 0x3C;
+  refuse = true;
+  CHECK(!entropy_journal_append(seed));
+  CHECK(entropy_journal_append(seed));
+
+  return test_summary("test_fob_store_tear");
+}
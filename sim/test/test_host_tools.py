@@ -0,0 +1,414 @@
+#!/usr/bin/python3 -u
+
+# @file test_host_tools.py
+# @author Spartan State Security Team
+# @brief Runs the host tools against local socket stand-ins for the bridges
+# @date 2023
+#
+#  This source file is part of our designed system
+#  for MITRE's 2023 Embedded System CTF (eCTF).
+#
+#  Each stand-in listens on a free local port in place of a bridge,
+#  checks what the tool sends, then answers as the device would: at
+#  once, after a delay, split across writes, behind stray bytes, or not
+#  at all. The tools are loaded as modules with their bridge host and
+#  deadlines pointed at the stand-ins. A tool that fails exits with its
+#  reason, which must be the one the stand-in caused. The car's stand-in
+#  sends unlock reports instead, which unlock_tool must take whole by
+#  their header and return from as soon as the last byte is in.
+#
+#  The car secrets store is checked in a temporary secrets directory: a
+#  car_secrets.json deployment migrated into it, cars built into it in
+#  parallel, and package_tool reading cars back from it.
+
+import contextlib
+import importlib.machinery
+import importlib.util
+import io
+import json
+import socket
+import sqlite3
+import struct
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+from pathlib import Path
+
+import Crypto.PublicKey.ECC as ecc
+from Crypto.Hash import SHA256
+from Crypto.Signature import DSS
+
+REPO = Path(__file__).resolve().parents[2]
+HOST_TOOLS = REPO / "host_tools"
+
+# The tools import their shared modules from host_tools, which must stay free of bytecode
+sys.dont_write_bytecode = True
+sys.path.insert(0, str(HOST_TOOLS))
+
+import fob_status as status  # noqa: E402
+
+# Deadlines the tools are given, short so the silent cases finish quickly
+TIMEOUT = 0.5
+
+# Time a stand-in waits before answering, well inside TIMEOUT
+DELAY = 0.1
+
+# Cars built at once into the same secrets store
+PARALLEL_CARS = 8
+
+checks = 0
+failures = 0
+
+
+# @brief Function to record one check, printing where it failed
+# @param cond, the outcome
+# @param what, description of the check
+def check(cond, what):
+    global checks, failures
+    checks += 1
+    if not cond:
+        failures += 1
+        print(f"{__file__}: check failed: {what}", file=sys.stderr)
+
+
+# @brief Function to load a script as a module
+# @param path, the script
+# @return the module
+def load_module(path):
+    loader = importlib.machinery.SourceFileLoader(path.name, str(path))
+    module = importlib.util.module_from_spec(importlib.util.spec_from_loader(path.name, loader))
+    loader.exec_module(module)
+    return module
+
+
+# @brief Function to load a host tool as a module
+# @param name, the tool's file name in host_tools
+# @return the module
+def load_tool(name):
+    module = load_module(HOST_TOOLS / name)
+    module.BRIDGE_HOST = "127.0.0.1"
+    return module
+
+
+# @brief Function to run a script as the deployment does, without writing bytecode next to it
+# @param path, the script
+# @param args, its arguments
+# @return the completed process
+def run_script(path, *args):
+    return subprocess.run([sys.executable, "-B", str(path), *(str(a) for a in args)],
+                          capture_output=True, text=True)
+
+
+# @brief Function to create the host keys of a deployment, as gen_host_secrets.py does
+# @param secrets_dir, the secrets directory
+# @return the host private key
+def make_host_keys(secrets_dir):
+    privkey = ecc.generate(curve="secp256r1")
+    (secrets_dir / "host_privkey.PEM").write_text(privkey.export_key(format="PEM"))
+    (secrets_dir / "host_pubkey.PEM").write_text(privkey.public_key().export_key(format="PEM"))
+    return privkey
+
+
+# @brief Function to read every car in a secrets store
+# @param secrets_dir, the secrets directory
+# @return dict of car id to (private key PEM, public key PEM)
+def read_store(secrets_dir):
+    db = sqlite3.connect(secrets_dir / "car_secrets.db")
+    rows = db.execute("SELECT car_id, privkey_pem, pubkey_pem FROM cars").fetchall()
+    db.close()
+    return {car_id: (privkey_pem, pubkey_pem) for car_id, privkey_pem, pubkey_pem in rows}
+
+
+# @brief Function to get a public key as the car holds it, x || y
+# @param pubkey_pem, the public key
+# @return the key's bytes
+def pubkey_bytes(pubkey_pem):
+    point = ecc.import_key(pubkey_pem).pointQ
+    return int(point.x).to_bytes(32, "big") + int(point.y).to_bytes(32, "big")
+
+
+# Defines a bridge stand-in, serving one connection in a thread of its own
+class StandIn:
+    # @brief Function to listen on a free port
+    # @param expect, number of bytes the tool must send before the answer
+    # @param answer, list of (delay, bytes) to send in turn, None to close the connection
+    def __init__(self, expect, answer):
+        self.expect = expect
+        self.answer = answer
+        self.received = b""
+        self.listener = socket.create_server(("127.0.0.1", 0))
+        self.port = self.listener.getsockname()[1]
+        self.thread = threading.Thread(target=self.serve, daemon=True)
+        self.thread.start()
+
+    # @brief Function to take the tool's connection, read its command and answer it
+    def serve(self):
+        conn, _ = self.listener.accept()
+        with conn:
+            conn.settimeout(TIMEOUT * 4)
+            while len(self.received) < self.expect:
+                data = conn.recv(4096)
+                if not data:
+                    return
+                self.received += data
+            for delay, data in self.answer:
+                time.sleep(delay)
+                if data is None:
+                    return
+                conn.sendall(data)
+            # Hold the connection open until the tool is done with it
+            try:
+                conn.recv(1)
+            except OSError:
+                pass
+
+    # @brief Function to wait for the stand-in to finish
+    def join(self):
+        self.thread.join(TIMEOUT * 8)
+        self.listener.close()
+
+
+# @brief Function to run a tool's function, catching its exit
+# @param function, the function
+# @param args, its arguments
+# @return the exit reason, None if it returned, and the seconds it took
+def run(function, *args):
+    start = time.monotonic()
+    try:
+        function(*args)
+        reason = None
+    except SystemExit as e:
+        reason = str(e.code)
+    return reason, time.monotonic() - start
+
+
+# @brief Function to check enable_tool against a fob stand-in
+def test_enable(tempdir):
+    enable_tool = load_tool("enable_tool")
+    enable_tool.PACKAGE_DIR = tempdir
+    enable_tool.ENABLE_TIMEOUT = TIMEOUT
+    package = bytes(range(66))
+    (tempdir / "feature").write_bytes(package)
+
+    def frame(cmd, code):
+        return bytes([status.STATUS_START, cmd, code])
+
+    cmd = enable_tool.ENABLE_CMD
+    cases = [
+        # answer, expected exit reason, whether the deadline must pass
+        ([(DELAY, frame(cmd, status.STATUS_OK))], None, False),
+        # stray bytes, a start byte in them, and a frame for another command come first
+        ([(0, b"\x00\x5e\xff"), (0, frame(0x20, 0x01)), (DELAY, frame(cmd, status.STATUS_OK))], None, False),
+        # the frame split across writes
+        ([(0, frame(cmd, status.STATUS_OK)[:1]), (DELAY, frame(cmd, status.STATUS_OK)[1:])], None, False),
+        ([(DELAY, frame(cmd, 0x01))], "Failed to enable feature: rejected by the fob", False),
+        ([(DELAY, frame(cmd, 0x03))], "Failed to enable feature: could not be stored on the fob", False),
+        ([(DELAY, frame(cmd, 0x7F))], "Failed to enable feature: 0x7f", False),
+        ([(DELAY, frame(cmd, 0x01)[:2])], "Fob did not answer the enable command", True),
+        ([(DELAY, None)], "Fob did not answer the enable command", False),
+        ([], "Fob did not answer the enable command", True),
+    ]
+    for answer, expected, waits in cases:
+        fob = StandIn(1 + len(package), answer)
+        reason, elapsed = run(enable_tool.enable, fob.port, "feature")
+        fob.join()
+        check(fob.received == bytes([cmd]) + package, f"enable sent {fob.received.hex()}")
+        check(reason == expected, f"enable {answer}: {reason!r}, expected {expected!r}")
+        check((elapsed >= TIMEOUT) == waits, f"enable {answer}: took {elapsed:.2f}s")
+
+
+# @brief Function to check pair_tool against a stand-in for each fob
+def test_pair():
+    pair_tool = load_tool("pair_tool")
+    pair_tool.PAIR_TIMEOUT = TIMEOUT
+    ok = status.STATUS_OK
+
+    def frame(cmd, code):
+        return bytes([status.STATUS_START, cmd, code])
+
+    p_cmd, u_cmd = pair_tool.P_PAIR_CMD, pair_tool.U_PAIR_CMD
+    cases = [
+        # paired fob's answer, unpaired fob's answer, expected exit reason
+        ([(DELAY, frame(p_cmd, ok))], [(2 * DELAY, frame(u_cmd, ok))], None),
+        # the unpaired fob answers first, it is still read after the paired fob
+        ([(2 * DELAY, frame(p_cmd, ok))], [(0, frame(u_cmd, ok))], None),
+        ([(DELAY, frame(p_cmd, 0x02))], [], "Failed to pair, paired fob: wrong pairing PIN"),
+        ([(DELAY, frame(p_cmd, ok))], [(DELAY, frame(u_cmd, 0x03))],
+         "Failed to pair, unpaired fob: could not be stored on the fob"),
+        ([], [], "Paired fob did not answer the pair command"),
+        ([(DELAY, frame(p_cmd, ok))], [(DELAY, frame(p_cmd, ok))], "Unpaired fob did not answer the pair command"),
+    ]
+    for paired_answer, unpaired_answer, expected in cases:
+        paired = StandIn(5, paired_answer)
+        unpaired = StandIn(1, unpaired_answer)
+        reason, _ = run(pair_tool.pair, unpaired.port, paired.port, "123456")
+        paired.join()
+        unpaired.join()
+        check(paired.received == bytes([p_cmd]) + (0x123456).to_bytes(4, "little"),
+              f"pair sent {paired.received.hex()} to the paired fob")
+        check(unpaired.received == bytes([u_cmd]), f"pair sent {unpaired.received.hex()} to the unpaired fob")
+        check(reason == expected, f"pair {paired_answer} {unpaired_answer}: {reason!r}, expected {expected!r}")
+
+
+# @brief Function to check unlock_tool against a car stand-in
+def test_unlock():
+    unlock_tool = load_tool("unlock_tool")
+    unlock_tool.REPORT_BODY_TIMEOUT = TIMEOUT
+    size = unlock_tool.MESSAGE_SIZE
+
+    def report(features, length=None):
+        body = bytes([0xA0 + i for i in range(1 + features) for _ in range(size)])
+        header = struct.pack("<BBH", unlock_tool.REPORT_START, features, len(body) if length is None else length)
+        return header, body
+
+    header, body = report(3)
+    empty_header, empty_body = report(0)
+    cases = [
+        # answer, expected exit reason, whether a deadline must pass, the report body printed
+        ([(DELAY, header + body)], None, False, body),
+        ([(DELAY, empty_header + empty_body)], None, False, empty_body),
+        # stray bytes first, then the report a few bytes at a time
+        ([(0, b"\x00\xff\x5e")] + [(0.001, (header + body)[i:i + 7]) for i in range(0, len(header + body), 7)],
+         None, False, body),
+        # the header on its own, the unlock message, then the feature messages
+        ([(DELAY, header), (DELAY, body[:size]), (DELAY, body[size:])], None, False, body),
+        # bytes after the report are not waited for
+        ([(DELAY, header + body + b"\x5d\x01")], None, False, body),
+        ([(DELAY, report(3, 3 * size)[0] + body)], "Malformed unlock report", False, None),
+        ([(DELAY, header + body[:size + 1])], "Unlock report incomplete", True, None),
+        ([(DELAY, header[:3])], "Failed to unlock", True, None),
+        ([], "Failed to unlock", True, None),
+    ]
+    for answer, expected, waits, printed in cases:
+        car = StandIn(0, answer)
+        out = io.StringIO()
+        with contextlib.redirect_stdout(out):
+            reason, elapsed = run(unlock_tool.unlock, car.port, TIMEOUT)
+        car.join()
+        lines = out.getvalue().splitlines()
+        check(reason == expected, f"unlock {len(answer)} writes: {reason!r}, expected {expected!r}")
+        check((elapsed >= TIMEOUT) == waits, f"unlock {len(answer)} writes: took {elapsed:.2f}s")
+        if printed is not None:
+            check(lines[:1] == [str(printed)], f"unlock printed {lines[:1]}")
+            check(f"{len(printed) // size - 1} feature messages" in out.getvalue(), "unlock counted the features")
+
+
+# @brief Function to check both copies of the car secrets store's schema agree
+def test_schema():
+    gen_secret = load_module(REPO / "car" / "gen_secret.py")
+    sys.path.insert(0, str(REPO / "deployment"))
+    try:
+        gen_host_secrets = load_module(REPO / "deployment" / "gen_host_secrets.py")
+    finally:
+        sys.path.remove(str(REPO / "deployment"))
+    check(gen_secret.SECRETS_SCHEMA == gen_host_secrets.SECRETS_SCHEMA, "car/gen_secret.py has another schema")
+    check(gen_secret.SECRETS_STORE == gen_host_secrets.SECRETS_STORE, "car/gen_secret.py has another store")
+
+
+# @brief Function to check migrate_car_secrets.py moves every car of car_secrets.json into the store
+# @param secrets_dir, an empty secrets directory
+# @return the migrated cars, dict of car id to (private key PEM, public key PEM)
+def test_migrate(secrets_dir):
+    cars = {}
+    for car_id in (1, 7, 250):
+        privkey = ecc.generate(curve="secp256r1")
+        cars[car_id] = (privkey.export_key(format="PEM"), privkey.public_key().export_key(format="PEM"))
+    secrets = {str(car_id): {"privkey_pem": priv, "pubkey_pem": pub} for car_id, (priv, pub) in cars.items()}
+    (secrets_dir / "car_secrets.json").write_text(json.dumps(secrets))
+
+    # Migrating twice leaves the same cars, as each is replaced by itself
+    for _ in range(2):
+        result = run_script(REPO / "deployment" / "migrate_car_secrets.py", "--secrets-dir", secrets_dir)
+        check(result.returncode == 0, f"migrate_car_secrets.py failed: {result.stderr}")
+        check(f"Migrated {len(cars)} cars" in result.stdout, f"migrate_car_secrets.py printed {result.stdout!r}")
+        check(read_store(secrets_dir) == cars, "the store does not hold the cars of car_secrets.json")
+    return cars
+
+
+# @brief Function to check package_tool signs for a car it reads back from a migrated store
+# @param secrets_dir, the secrets directory the cars were migrated into
+# @param cars, the migrated cars
+def test_package(secrets_dir, cars):
+    host_privkey = make_host_keys(secrets_dir)
+    package_tool = load_tool("package_tool")
+    package_tool.HOST_PRIVKEY_FILE = str(secrets_dir / "host_privkey.PEM")
+    package_tool.SECRETS_FILE = str(secrets_dir / "car_secrets.db")
+    package_tool.PACKAGE_DIR = secrets_dir
+
+    # Every migrated car, and nothing for IDs which are not a car's or not a number
+    pubkeys = package_tool.load_car_pubkeys([str(car_id) for car_id in cars] + ["2", "999", "abc", "-1", "7a", ""])
+    check(set(pubkeys) == {str(car_id) for car_id in cars}, f"load_car_pubkeys found cars {sorted(pubkeys)}")
+    for car_id, (_, pub) in cars.items():
+        check(pubkeys.get(str(car_id)) == pubkey_bytes(pub), f"load_car_pubkeys read car {car_id} wrongly")
+
+    # A package for one of them verifies against the host key, over that car's key and the feature
+    out = io.StringIO()
+    with contextlib.redirect_stdout(out):
+        reason, _ = run(package_tool.package, "feature", "7", 2)
+    check(reason is None, f"package_tool failed: {reason!r}")
+    data = (secrets_dir / "feature").read_bytes()
+    check(len(data) == 66 and data[0] == 2, f"package_tool wrote {data.hex()}")
+    h = SHA256.new(pubkey_bytes(cars[7][1]) + bytes([2]))
+    try:
+        DSS.new(host_privkey.public_key(), "fips-186-3").verify(h, data[1:65])
+        verified = True
+    except ValueError:
+        verified = False
+    check(verified, "the package does not verify for the migrated car")
+
+    # A car missing from the store is refused
+    try:
+        package_tool.package("missing", "999", 2)
+        refused = False
+    except Exception as e:
+        refused = str(e) == "Car data not found in secrets store"
+    check(refused and not (secrets_dir / "missing").exists(), "package_tool packaged a missing car")
+
+    # No store at all finds no car
+    package_tool.SECRETS_FILE = str(secrets_dir / "absent.db")
+    check(package_tool.load_car_pubkeys(["7"]) == {}, "load_car_pubkeys found a car without a store")
+
+
+# @brief Function to check cars built at once into one secrets store all land in it
+# @param secrets_dir, an empty secrets directory
+def test_parallel_cars(secrets_dir):
+    make_host_keys(secrets_dir)
+    builds = [
+        subprocess.Popen([sys.executable, "-B", str(REPO / "car" / "gen_secret.py"), "--car-id", str(car_id),
+                          "--secrets-dir", str(secrets_dir), "--header-file", str(secrets_dir / f"car_{car_id}.h")],
+                         stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, text=True)
+        for car_id in range(1, PARALLEL_CARS + 1)
+    ]
+    for build in builds:
+        _, stderr = build.communicate()
+        check(build.returncode == 0, f"gen_secret.py failed: {stderr}")
+
+    cars = read_store(secrets_dir)
+    check(sorted(cars) == list(range(1, PARALLEL_CARS + 1)), f"the store holds cars {sorted(cars)}")
+    for car_id, (_, pub) in cars.items():
+        eeprom = secrets_dir / f"car_{car_id}_eeprom"
+        check(eeprom.is_file() and eeprom.read_bytes()[64:128] == pubkey_bytes(pub),
+              f"car {car_id}'s EEPROM does not hold its stored key")
+    check(len({pub for _, pub in cars.values()}) == PARALLEL_CARS, "two cars share a key")
+
+
+def main():
+    with tempfile.TemporaryDirectory() as tempdir:
+        test_enable(Path(tempdir))
+    test_pair()
+    test_unlock()
+
+    test_schema()
+    with tempfile.TemporaryDirectory() as tempdir:
+        test_package(Path(tempdir), test_migrate(Path(tempdir)))
+    with tempfile.TemporaryDirectory() as tempdir:
+        test_parallel_cars(Path(tempdir))
+
+    print(f"test_host_tools: {checks} checks, {failures} failed")
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
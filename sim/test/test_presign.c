@@ -0,0 +1,89 @@
+/**
+ * @file test_presign.c
+ * @author Spartan State Security Team
+ * @brief Checks presigned signatures against Sweet B's verifier, and times them
+ * @date 2023
+ *
+ * This source file is part of our designed system
+ * for MITRE's 2023 Embedded System CTF (eCTF).
+ *
+ * Linked with the paired fob's firmware and run on its EEPROM image.
+ * Every signature finished from the pool must verify under the fob's
+ * key, and only for the challenge it signed. The cycles spent signing
+ * online are compared with signing from scratch, as the unlock did
+ * before presigning.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sb_all.h"
+
+#include "sim.h"
+#include "store.h"
+#include "firmware.h"
+#include "test.h"
+
+/*** Macro Definitions ***/
+#define ROUNDS 32
+
+/*** Globals ***/
+extern sb_hmac_drbg_state_t drbg;
+extern PRESIGN presign_pool[PRESIGN_POOL_SIZE];
+
+sb_sw_context_t ctx;
+
+int main(void) {
+  sb_sw_private_t priv;
+  sb_sw_public_t pub;
+  sb_sw_message_digest_t digest;
+  sb_sw_signature_t sig;
+  CHALLENGE challenge;
+  uint64_t start;
+  uint64_t offline = 0, online = 0, full = 0;
+  uint32_t i;
+
+  CHECK(store_init());
+  CHECK(init_drbg());
+  CHECK(get_secret(&priv, NULL));
+  CHECK(sb_sw_compute_public_key(&ctx, &pub, &priv, &drbg, SB_SW_CURVE_P256, ENDIAN) == SB_SUCCESS);
+
+  // Nothing to sign with until the pool is filled
+  CHECK(!sign_presigned(&challenge, &sig));
+
+  for (i = 0; i < ROUNDS; i++) {
+    CHECK(sb_hmac_drbg_generate(&drbg, challenge.data, sizeof(challenge.data)) == SB_SUCCESS);
+
+    start = sim_cycles();
+    CHECK(presign(&presign_pool[0]));
+    offline += sim_cycles() - start;
+
+    start = sim_cycles();
+    CHECK(sign_presigned(&challenge, &sig));
+    online += sim_cycles() - start;
+
+    // The nonce is retired once used
+    CHECK(!presign_pool[0].ready);
+
+    CHECK(sb_sw_verify_signature_sha256(&ctx, &digest, &sig, &pub, challenge.data, sizeof(challenge.data),
+                                        &drbg, SB_SW_CURVE_P256, ENDIAN) == SB_SUCCESS);
+
+    // A signature only verifies for its own challenge
+    challenge.data[i % sizeof(challenge.data)] ^= 1;
+    CHECK(sb_sw_verify_signature_sha256(&ctx, &digest, &sig, &pub, challenge.data, sizeof(challenge.data),
+                                        &drbg, SB_SW_CURVE_P256, ENDIAN) != SB_SUCCESS);
+
+    start = sim_cycles();
+    CHECK(sb_sw_sign_message_sha256(&ctx, &digest, &sig, &priv, challenge.data, sizeof(challenge.data),
+                                    &drbg, SB_SW_CURVE_P256, ENDIAN) == SB_SUCCESS);
+    full += sim_cycles() - start;
+  }
+
+  // The online half must be a small fraction of a full signature
+  printf("mean cycles: presign %llu, online %llu, full sign %llu\n",
+         (unsigned long long)(offline / ROUNDS), (unsigned long long)(online / ROUNDS),
+         (unsigned long long)(full / ROUNDS));
+  CHECK(online * 10 < full);
+
+  return test_summary("test_presign");
+}
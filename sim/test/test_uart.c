@@ -0,0 +1,218 @@
+/**
+ * @file test_uart.c
+ * @author Spartan State Security Team
+ * @brief Checks the interrupt-driven UART driver's throughput and overrun handling
+ * @date 2023
+ *
+ * This source file is part of our designed system
+ * for MITRE's 2023 Embedded System CTF (eCTF).
+ *
+ * Linked with one device's uart.c and the simulated UARTs, and built
+ * for both devices. The test is the host on the other end of UART 0:
+ * it echoes a stream back while the driver sends and receives at once,
+ * which must run at the line rate without losing a byte, then floods
+ * the driver while nothing reads, which must keep the oldest bytes and
+ * count the rest as overruns. Last, blocks go each way by uDMA, whose
+ * completion must be reported once, and only after the last byte.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "inc/hw_memmap.h"
+
+#include "sim.h"
+#include "uart.h"
+#include "peer.h"
+#include "test.h"
+
+/*** Macro Definitions ***/
+#define TEST_BAUD 921600
+#define STREAM_SIZE 16384
+#define FLOOD_SIZE 2048
+#define DMA_SIZE 600
+
+// Cycles the line takes to carry a number of bytes, with 10 bits to a byte
+#define LINE_CYCLES(bytes) ((uint64_t)(bytes) * 10 * SIM_SPEED / TEST_BAUD)
+
+/*** Globals ***/
+int peer = -1;
+
+// Completions reported by the uDMA callbacks
+volatile uint32_t dma_done_count = 0;
+
+/**
+ * @brief Connect to UART 0 as the host, and wait until the simulation takes the connection
+ */
+void connect_peer(void) {
+  uint8_t probe = 0xA5, c = 0;
+
+  peer = peer_connect("SIM_UART0");
+
+  // The first byte through proves the connection is up
+  peer_send(peer, &probe, 1);
+  c = (uint8_t)uart_readb(UART0_BASE);
+  CHECK(c == probe);
+}
+
+/**
+ * @brief Stream bytes out and back through an echoing host, all without blocking
+ */
+void test_stream(void) {
+  static uint8_t out[STREAM_SIZE], in[STREAM_SIZE], echo[256];
+  uint32_t sent = 0, received = 0;
+  uint64_t start, queued, elapsed;
+  ssize_t n;
+  uint32_t i;
+
+  for (i = 0; i < STREAM_SIZE; i++) {
+    out[i] = (uint8_t)(i * 7 + (i >> 8));
+  }
+
+  // Queueing a response's worth of bytes returns long before the first leaves
+  start = sim_cycles();
+  sent = uart_write_nb(UART0_BASE, out, 256);
+  queued = sim_cycles() - start;
+  CHECK(sent == 256);
+  CHECK(queued < LINE_CYCLES(1));
+
+  while (received < STREAM_SIZE && sim_cycles() - start < 4 * LINE_CYCLES(STREAM_SIZE)) {
+    sent += uart_write_nb(UART0_BASE, &out[sent], STREAM_SIZE - sent);
+    n = recv(peer, echo, sizeof(echo), MSG_DONTWAIT);
+    if (n > 0) {
+      peer_send(peer, echo, n);
+    }
+    received += uart_read_nb(UART0_BASE, &in[received], STREAM_SIZE - received);
+  }
+  elapsed = sim_cycles() - start;
+
+  printf("stream: %u bytes each way in %llu cycles, %llu%% of the line rate, %u overruns\n",
+         received, (unsigned long long)elapsed,
+         (unsigned long long)(100 * LINE_CYCLES(received) / elapsed), uart_overruns(UART0_BASE));
+  CHECK(received == STREAM_SIZE);
+  CHECK_MEM(in, out, STREAM_SIZE);
+  CHECK(uart_overruns(UART0_BASE) == 0);
+
+  // Sending and receiving overlap, so both directions take little more than one direction alone
+  CHECK(elapsed < LINE_CYCLES(STREAM_SIZE) * 5 / 4);
+}
+
+/**
+ * @brief Flood the driver while nothing reads, then check what it kept
+ */
+void test_overrun(void) {
+  static uint8_t flood[FLOOD_SIZE], in[FLOOD_SIZE];
+  uint32_t kept = UART_RX_RING_SIZE - 1;
+  uint32_t overruns = uart_overruns(UART0_BASE);
+  uint64_t start;
+  uint32_t i;
+
+  for (i = 0; i < FLOOD_SIZE; i++) {
+    flood[i] = (uint8_t)(i ^ (i >> 8));
+  }
+
+  // The full ring keeps the oldest bytes and counts every later one
+  peer_send(peer, flood, FLOOD_SIZE);
+  start = sim_cycles();
+  while (uart_overruns(UART0_BASE) - overruns < FLOOD_SIZE - kept &&
+         sim_cycles() - start < 4 * LINE_CYCLES(FLOOD_SIZE)) {
+  }
+  printf("flood: %u bytes kept, %u overruns\n", kept, uart_overruns(UART0_BASE) - overruns);
+  CHECK(uart_overruns(UART0_BASE) - overruns == FLOOD_SIZE - kept);
+  CHECK(uart_read_nb(UART0_BASE, in, FLOOD_SIZE) == kept);
+  CHECK_MEM(in, flood, kept);
+  CHECK(!uart_avail(UART0_BASE));
+
+  // Reception carries on normally once the ring has room again
+  peer_send(peer, flood, 100);
+  CHECK(uart_read(UART0_BASE, in, 100) == 100);
+  CHECK_MEM(in, flood, 100);
+}
+
+/**
+ * @brief Count a completed uDMA transfer
+ *
+ * @param uart [in] The UART whose transfer completed
+ */
+void dma_done(uint32_t uart) {
+  dma_done_count++;
+}
+
+/**
+ * @brief Wait for a uDMA transfer to report completion
+ *
+ * @param bytes [in] The bytes the transfer carries
+ */
+void wait_dma_done(uint32_t bytes) {
+  uint64_t start = sim_cycles();
+
+  while (!dma_done_count && sim_cycles() - start < 4 * LINE_CYCLES(bytes)) {
+  }
+}
+
+/**
+ * @brief Move blocks each way by uDMA
+ */
+void test_dma(void) {
+  static uint8_t out[DMA_SIZE], in[DMA_SIZE];
+  uint32_t got = 0;
+  ssize_t n;
+  uint32_t i;
+
+  for (i = 0; i < DMA_SIZE; i++) {
+    out[i] = (uint8_t)(i * 13 + 5);
+  }
+  uart_dma_init();
+
+  // Reception takes the bytes already in the ring first, then the controller collects the rest
+  peer_send(peer, out, 100);
+  sim_sleep_cycles(2 * LINE_CYCLES(100));
+  dma_done_count = 0;
+  CHECK(uart_dma_read(UART0_BASE, in, DMA_SIZE, dma_done));
+  CHECK(dma_done_count == 0);
+  peer_send(peer, &out[100], DMA_SIZE - 100);
+  wait_dma_done(DMA_SIZE);
+  CHECK(dma_done_count == 1);
+  CHECK_MEM(in, out, DMA_SIZE);
+  CHECK(!uart_dma_busy(UART0_BASE));
+
+  // A block already in the ring completes at once
+  peer_send(peer, out, 50);
+  sim_sleep_cycles(2 * LINE_CYCLES(50));
+  dma_done_count = 0;
+  CHECK(uart_dma_read(UART0_BASE, in, 50, dma_done));
+  CHECK(dma_done_count == 1);
+  CHECK(!uart_dma_busy(UART0_BASE));
+
+  // Transmission
+  dma_done_count = 0;
+  CHECK(uart_dma_write(UART0_BASE, out, DMA_SIZE, dma_done));
+  CHECK(uart_write_nb(UART0_BASE, out, 1) == 0);
+  while (got < DMA_SIZE) {
+    n = recv(peer, &in[got], DMA_SIZE - got, 0);
+    if (n > 0) {
+      got += n;
+    }
+  }
+  wait_dma_done(DMA_SIZE);
+  CHECK(dma_done_count == 1);
+  CHECK_MEM(in, out, DMA_SIZE);
+  uart_flush(UART0_BASE);
+  CHECK(!uart_dma_busy(UART0_BASE));
+}
+
+int main(int argc, char **argv) {
+  peer_listen("SIM_UART0", argv);
+
+  uart_init();
+  uart_set_baud(UART0_BASE, TEST_BAUD);
+  connect_peer();
+
+  test_stream();
+  test_overrun();
+  test_dma();
+
+  return test_summary("test_uart");
+}
@@ -0,0 +1,212 @@
+/**
+ * @file test_unlock_e2e.c
+ * @author Spartan State Security Team
+ * @brief Times whole unlocks between a car and a fob process, with and without the pipelined response
+ * @date 2023
+ *
+ * This source file is part of our designed system
+ * for MITRE's 2023 Embedded System CTF (eCTF).
+ *
+ * Linked with the car's board link and UART driver. For each case it
+ * starts unlock_fob as a second process on the other end of UART 1, so
+ * both ends run their own board link code over the paced simulated
+ * line, then times each unlock from the request to the last verified
+ * signature, as tryUnlock runs it.
+ *
+ * Pipelined, the fob sends its feature packages before it signs, and
+ * the car recovers their R points and walks the high bits of their
+ * weights in slices while the signature is on its way, then finishes
+ * one batch with the signature. Sequential,
+ * the fob sends nothing until it has signed, and the car does all of it
+ * once the response is in. Sweet B only runs at the host's speed, so
+ * signing and verifying are stood in for by round figures of the cycles
+ * they take on the boards. What each package costs before and after
+ * the signature, against one signature verified alone, is taken from
+ * p256.c on the host.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/wait.h>
+
+#include "inc/hw_memmap.h"
+
+#include "sim.h"
+#include "uart.h"
+#include "board_link.h"
+#include "firmware.h"
+#include "peer.h"
+#include "test.h"
+
+/*** Macro Definitions ***/
+#define UNLOCKS 3
+
+// Modelled costs on the boards, in cycles at 80 MHz
+#define SIGN_PRESIGNED_CYCLES 80000   // finishing a presigned nonce
+#define SIGN_FULL_CYCLES 16000000     // a signature from scratch, the presign pool empty
+#define VERIFY_CYCLES 8000000         // one signature against its combs
+#define PACKAGE_START_CYCLES 3200000  // a package's work before the signature: its R and high weight bits
+#define PACKAGE_BATCH_CYCLES 1600000  // what a package adds to the batch once the signature is in
+
+// Cycles of a verification slice, after which the board link is serviced
+#define SLICE_CYCLES (VERIFY_CYCLES / 64)
+
+// Host scheduling noise allowed between two timings, in cycles
+#define SLACK_CYCLES (SIM_SPEED / 200)
+
+// Milliseconds in a number of cycles
+#define MS(cycles) ((double)(cycles) * 1000 / SIM_SPEED)
+
+/*** Globals ***/
+char fob_path[4096];
+
+/**
+ * @brief Stand in for verifying in slices, servicing the board link between them
+ *
+ * @param cycles   [in]  The cycles the verification takes
+ * @param response [out] The response still being received
+ */
+void verify_modelled(uint64_t cycles, RESPONSE *response) {
+  uint64_t i;
+
+  for (i = 0; i < cycles / SLICE_CYCLES; i++) {
+    sim_sleep_cycles(SLICE_CYCLES);
+    service_response(response);
+  }
+}
+
+/**
+ * @brief Check a response holds what unlock_fob sends
+ *
+ * @param response [in] The response
+ * @param features [in] The features the fob has enabled
+ *
+ * @return true if every byte is as sent, false otherwise
+ */
+bool response_intact(const RESPONSE *response, uint32_t features) {
+  uint8_t expected[sizeof(PACKAGE)];
+  uint32_t i;
+
+  for (i = 0; i < NUM_FEATURES; i++) {
+    memset(expected, i < features ? 0xA0 + i : 0xFF, sizeof(expected));
+    if (PRESENT_GET(response->present, i) != (i < features) ||
+        memcmp(&response->feature[i], expected, sizeof(expected))) {
+      return false;
+    }
+  }
+  memset(expected, 0x5E, sizeof(sb_sw_signature_t));
+  return !memcmp(&response->unlock, expected, sizeof(sb_sw_signature_t));
+}
+
+/**
+ * @brief Run unlocks against a fob process started for them
+ *
+ * @param pipelined [in] true for the pipelined response, false for the sequential one
+ * @param sign      [in] The cycles the fob takes to sign
+ * @param features  [in] The features the fob has enabled
+ *
+ * @return the mean cycles from the request to the last verified signature
+ */
+uint64_t time_unlocks(bool pipelined, uint64_t sign, uint32_t features) {
+  char sign_arg[24], features_arg[12], unlocks_arg[12], setting[32];
+  CHALLENGE challenge;
+  RESPONSE response;
+  uint64_t start, total = 0;
+  uint32_t i, intact = 0;
+  bool received, exited = false;
+  int status = 0;
+  pid_t fob;
+
+  snprintf(sign_arg, sizeof(sign_arg), "%llu", (unsigned long long)sign);
+  snprintf(features_arg, sizeof(features_arg), "%u", features);
+  snprintf(unlocks_arg, sizeof(unlocks_arg), "%u", UNLOCKS);
+  snprintf(setting, sizeof(setting), "connect:%s", getenv("SIM_UART1") + 7);
+
+  // Child processes inherit no interval timer, so the fob's simulation starts its own
+  fob = fork();
+  if (fob == 0) {
+    setenv("SIM_UART1", setting, 1);
+    execl(fob_path, fob_path, pipelined ? "pipelined" : "sequential", sign_arg, features_arg, unlocks_arg,
+          (char *)NULL);
+    perror(fob_path);
+    _exit(EXIT_FAILURE);
+  }
+
+  memset(&challenge, 0x11, sizeof(challenge));
+  for (i = 0; i < UNLOCKS && !exited; i++) {
+    while (!fob_requests_unlock() && !exited) {
+      exited = waitpid(fob, &status, WNOHANG) == fob;
+    }
+    if (exited) break;
+    start = sim_cycles();
+
+    do {
+      memset(&response, 0, sizeof(response));
+      received = negotiate_baud() && send_challenge(&challenge) && get_response_features(&response);
+      if (received && pipelined) {
+        verify_modelled(features * PACKAGE_START_CYCLES, &response);
+      }
+      received = received && get_response_signature(&response);
+      if (received) {
+        verify_modelled(VERIFY_CYCLES + features * (PACKAGE_BATCH_CYCLES + (pipelined ? 0 : PACKAGE_START_CYCLES)),
+                        &response);
+      }
+    } while (finish_response());
+
+    total += sim_cycles() - start;
+    intact += received && response_intact(&response, features);
+  }
+
+  uart_flush(FOB_UART);
+  CHECK(exited || waitpid(fob, &status, 0) == fob);
+  CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  CHECK(intact == UNLOCKS);
+  return total / UNLOCKS;
+}
+
+int main(int argc, char **argv) {
+  static const struct {
+    const char *name;
+    uint64_t cycles;
+  } signs[] = {
+    { "presigned", SIGN_PRESIGNED_CYCLES },
+    { "full", SIGN_FULL_CYCLES },
+  };
+  uint64_t sequential, pipelined, hidden;
+  uint32_t features, s;
+  ssize_t len;
+
+  peer_listen("SIM_UART1", argv);
+
+  // unlock_fob is built next to the test
+  len = readlink("/proc/self/exe", fob_path, sizeof(fob_path) - 1);
+  CHECK(len > 0);
+  fob_path[len > 0 ? len : 0] = '\0';
+  strcpy(strrchr(fob_path, '/') + 1, "unlock_fob");
+
+  uart_init();
+  setup_board_link();
+
+  printf("modelled: one verification %.0f ms, and per package %.0f ms before the signature and %.0f ms after\n",
+         MS(VERIFY_CYCLES), MS(PACKAGE_START_CYCLES), MS(PACKAGE_BATCH_CYCLES));
+  printf("modelled: signing %.0f ms presigned, %.0f ms in full\n", MS(SIGN_PRESIGNED_CYCLES), MS(SIGN_FULL_CYCLES));
+  printf("signing    features  sequential ms  pipelined ms  saved ms\n");
+
+  for (s = 0; s < sizeof(signs) / sizeof(signs[0]); s++) {
+    for (features = 0; features <= NUM_FEATURES; features += NUM_FEATURES) {
+      sequential = time_unlocks(false, signs[s].cycles, features);
+      pipelined = time_unlocks(true, signs[s].cycles, features);
+      printf("%-9s  %8u  %13.1f  %12.1f  %8.1f\n", signs[s].name, features,
+             MS(sequential), MS(pipelined), MS(sequential) - MS(pipelined));
+
+      // The packages' work before the signature and signing overlap, so at least half the shorter of the two is saved
+      hidden = features * PACKAGE_START_CYCLES < signs[s].cycles ? features * PACKAGE_START_CYCLES : signs[s].cycles;
+      CHECK(pipelined + hidden / 2 < sequential + SLACK_CYCLES);
+    }
+  }
+
+  return test_summary("test_unlock_e2e");
+}
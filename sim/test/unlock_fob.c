@@ -0,0 +1,80 @@
+/**
+ * @file unlock_fob.c
+ * @author Spartan State Security Team
+ * @brief The fob's half of test_unlock_e2e, run as a process of its own
+ * @date 2023
+ *
+ * This source file is part of our designed system
+ * for MITRE's 2023 Embedded System CTF (eCTF).
+ *
+ * Linked with the fob's board link and UART driver, and connected to
+ * the car by SIM_UART1. Runs unlocks the way unlockCar does, with the
+ * signing stood in for by the cycles it is given. Pipelined, the
+ * feature packages go out before signing starts, as the fob sends them
+ * now; sequential, everything is sent once the signature is ready.
+ *
+ * Usage: unlock_fob pipelined|sequential SIGN_CYCLES FEATURES UNLOCKS
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "inc/hw_memmap.h"
+
+#include "sim.h"
+#include "uart.h"
+#include "board_link.h"
+#include "firmware.h"
+
+int main(int argc, char **argv) {
+  CHALLENGE challenge;
+  RESPONSE response;
+  uint64_t sign;
+  uint32_t features, unlocks, i;
+  bool pipelined, offered, answered;
+
+  if (argc != 5) return EXIT_FAILURE;
+  pipelined = !strcmp(argv[1], "pipelined");
+  sign = strtoull(argv[2], NULL, 0);
+  features = strtoul(argv[3], NULL, 0);
+  unlocks = strtoul(argv[4], NULL, 0);
+
+  uart_init();
+  setup_board_link();
+
+  // The first features are enabled, each package and the signature filled with its own byte
+  memset(&response, 0, sizeof(response));
+  for (i = 0; i < features && i < NUM_FEATURES; i++) {
+    PRESENT_SET(response.present, i);
+    memset(&response.feature[i], 0xA0 + i, sizeof(PACKAGE));
+  }
+  memset(&response.unlock, 0x5E, sizeof(response.unlock));
+
+  // Give the connection to the car time to come up, as a request sent before it is lost
+  sim_sleep_cycles(SIM_SPEED / 100);
+
+  // A request the car never answered is made again, as its user would press the button again
+  while (unlocks) {
+    request_unlock();
+    answered = false;
+    for (offered = accept_baud(); offered && get_challenge(&challenge); offered = accept_retry()) {
+      answered = true;
+      if (pipelined) {
+        send_features(&response);
+        sim_sleep_cycles(sign);
+      } else {
+        sim_sleep_cycles(sign);
+        send_features(&response);
+      }
+      finalize_unlock(&response);
+      restore_baud();
+    }
+    restore_baud();
+    unlocks -= answered;
+  }
+
+  uart_flush(BOARD_UART);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,229 @@
+#!/usr/bin/python3 -u
+
+# @file vectors.py
+# @author Spartan State Security Team
+# @brief Script to generate the known answers checked by the host tests
+# @date 2023
+#
+#  This source file is part of our designed system
+#  for MITRE's 2023 Embedded System CTF (eCTF).
+#
+#  Every expected value is computed here in Python, independently of the
+#  firmware's own arithmetic, and written to a header the tests include.
+#  Keys are those of the test deployment, and every other value comes
+#  from a fixed seed.
+
+import argparse
+import importlib.machinery
+import importlib.util
+import random
+import sqlite3
+import sys
+from pathlib import Path
+import Crypto.PublicKey.ECC as ecc
+from Crypto.Hash import SHA256
+from Crypto.Signature import DSS
+from Crypto.Util.number import long_to_bytes
+
+ECC_PRIVSIZE = 32
+
+# Order of the P-256 base point
+P256_N = 0xFFFFFFFF00000000FFFFFFFFFFFFFFFFBCE6FAADA7179E84F3B9CAC2FC632551
+
+SEED = 2023
+SCALAR_VECTORS = 64
+PRESIGN_VECTORS = 16
+SIGNATURE_VECTORS = 16
+
+# Comb entries checked for each key: every tooth alone, and a few sums of them
+COMB_ENTRIES = [1 << i for i in range(8)] + [3, 0x5A, 0x81, 0xFF]
+
+
+# @brief Load the car's gen_secret.py, which builds the combs the car verifies with
+def load_car_gen_secret():
+    path = Path(__file__).resolve().parents[2] / "car" / "gen_secret.py"
+    spec = importlib.util.spec_from_file_location("car_gen_secret", path)
+    module = importlib.util.module_from_spec(spec)
+    spec.loader.exec_module(module)
+    return module
+
+
+# @brief Load host_tools/package_tool, which adds the recovery byte to each package
+def load_package_tool():
+    path = Path(__file__).resolve().parents[2] / "host_tools" / "package_tool"
+
+    # host_tools must stay free of bytecode
+    sys.dont_write_bytecode = True
+    loader = importlib.machinery.SourceFileLoader("package_tool", str(path))
+    module = importlib.util.module_from_spec(importlib.util.spec_from_loader("package_tool", loader))
+    loader.exec_module(module)
+    return module
+
+
+# @brief Format bytes as a C initializer
+def c_bytes(data):
+    return "{" + ",".join(hex(b) for b in data) + "}"
+
+
+# @brief Format an integer as a big-endian 32 byte C initializer
+def c_int(value):
+    return c_bytes(long_to_bytes(value, ECC_PRIVSIZE))
+
+
+# @brief Format a list of structs as a C array definition
+# @param ctype, the struct type
+# @param name, the array name
+# @param rows, one list of field initializers per struct
+def c_array(ctype, name, rows):
+    body = ",\n".join("{" + ",".join(row) + "}" for row in rows)
+    return f"static const {ctype} {name}[] = {{\n{body} }};\n"
+
+
+# @brief Pick a scalar in [1, n - 1]
+def scalar(rng):
+    return rng.randrange(1, P256_N)
+
+
+# @brief Generate arithmetic modulo n, as used by the fob to finish presigned signatures
+def scalar_vectors(rng):
+    values = [1, 2, P256_N - 1, P256_N - 2] + [scalar(rng) for _ in range(SCALAR_VECTORS - 4)]
+    rows = []
+    for a in values:
+        b = scalar(rng)
+        rows.append([c_int(a), c_int(b), c_int(a * b % P256_N), c_int((a + b) % P256_N), c_int(pow(a, -1, P256_N))])
+
+    # Any 256-bit value reduces with a single subtraction
+    reduce_rows = [[c_int(x), c_int(x % P256_N)] for x in [P256_N, P256_N + 1, 2**256 - 1] + [rng.randrange(P256_N, 2**256) for _ in range(13)]]
+
+    out = "// a, b, a * b mod n, a + b mod n, a^-1 mod n\n"
+    out += "typedef struct { uint8_t a[32], b[32], product[32], sum[32], inverse[32]; } SCALAR_VECTOR;\n"
+    out += c_array("SCALAR_VECTOR", "SCALAR_VECTORS", rows)
+    out += "// x at least n, x mod n\n"
+    out += "typedef struct { uint8_t x[32], reduced[32]; } REDUCE_VECTOR;\n"
+    out += c_array("REDUCE_VECTOR", "REDUCE_VECTORS", reduce_rows)
+    return out
+
+
+# @brief Generate presigned ECDSA signatures, each checked with pycryptodome's verifier
+def presign_vectors(rng):
+    rows = []
+    for _ in range(PRESIGN_VECTORS):
+        key = ecc.construct(curve="P-256", d=scalar(rng))
+        challenge = bytes(rng.getrandbits(8) for _ in range(64))
+        h = SHA256.new(challenge)
+        z = int.from_bytes(h.digest(), "big") % P256_N
+
+        # r = x(kG) mod n, s = k^-1 * (z + r * d) mod n
+        k = scalar(rng)
+        r = int(ecc.construct(curve="P-256", d=k).pointQ.x) % P256_N
+        s = pow(k, -1, P256_N) * (z + r * int(key.d)) % P256_N
+        DSS.new(key.public_key(), "fips-186-3").verify(h, long_to_bytes(r, 32) + long_to_bytes(s, 32))
+
+        rows.append([c_int(int(key.d)), c_int(k), c_bytes(h.digest()), c_int(r), c_int(s)])
+
+    out = "// private key d, nonce k, SHA256(challenge), then the signature r, s\n"
+    out += "typedef struct { uint8_t d[32], k[32], digest[32], r[32], s[32]; } PRESIGN_VECTOR;\n"
+    out += c_array("PRESIGN_VECTOR", "PRESIGN_VECTORS", rows)
+    return out
+
+
+# @brief Load the host key and a car's key from a deployment
+def load_keys(secrets_dir, car_id):
+    with open(secrets_dir / "host_privkey.PEM") as fp:
+        host = ecc.import_key(fp.read())
+    db = sqlite3.connect(secrets_dir / "car_secrets.db")
+    (car_pem,) = db.execute("SELECT privkey_pem FROM cars WHERE car_id = ?", (car_id,)).fetchone()
+    db.close()
+    return host, ecc.import_key(car_pem)
+
+
+# @brief Format a public key as the car stores it, x || y
+def c_pubkey(key):
+    point = key.public_key().pointQ
+    return c_bytes(long_to_bytes(int(point.x), 32) + long_to_bytes(int(point.y), 32))
+
+
+# @brief Generate comb entries, computed by scalar multiplication rather than the comb's additions
+# Entry v - 1 of a comb is k * P, where k sets bit 32 * i for each bit i set in v
+def comb_vectors(gen_secret, keys):
+    rows = []
+    for which, key in enumerate(keys):
+        for v in COMB_ENTRIES:
+            k = sum(1 << (gen_secret.COMB_SPACING * i) for i in range(gen_secret.COMB_TEETH) if v >> i & 1)
+            if key is None:
+                point = ecc.EccPoint(gen_secret.P256_GX, gen_secret.P256_GY, curve="P-256") * k
+            else:
+                point = key.public_key().pointQ * k
+            rows.append([str(which), str(v), c_int(int(point.x)), c_int(int(point.y))])
+
+    out = "// comb 0 is G's, 1 the host key's and 2 the car key's, then v and the affine point of entry v - 1\n"
+    out += "typedef struct { uint32_t comb, v; uint8_t x[32], y[32]; } COMB_VECTOR;\n"
+    out += c_array("COMB_VECTOR", "COMB_VECTORS", rows)
+    return out
+
+
+# @brief Generate signatures by the host and car keys, as in feature packages and unlock responses
+def signature_vectors(rng, package_tool, keys):
+    rows = []
+    for i in range(SIGNATURE_VECTORS):
+        which = 1 + i % 2
+        h = SHA256.new(bytes(rng.getrandbits(8) for _ in range(64)))
+        sig = DSS.new(keys[which], "deterministic-rfc6979").sign(h)
+        rows.append([str(which), c_bytes(h.digest()), c_bytes(sig + package_tool.recovery_byte(keys[which].public_key(), h, sig))])
+
+    out = "// signer as in COMB_VECTOR, SHA256 of the signed message, then r || s and the recovery byte\n"
+    out += "typedef struct { uint32_t key; uint8_t digest[32], sig[65]; } SIGNATURE_VECTOR;\n"
+    out += c_array("SIGNATURE_VECTOR", "SIGNATURE_VECTORS", rows)
+    return out
+
+
+# @brief Generate the test car's feature packages, and one unlock signed by its key
+# Packages sign SHA256(car_pubkey || feature number) and add the recovery byte, as made by package_tool
+def unlock_vectors(rng, gen_secret, package_tool, host, car):
+    point = car.public_key().pointQ
+    car_pubkey = long_to_bytes(int(point.x), 32) + long_to_bytes(int(point.y), 32)
+    packages = []
+    for i in range(1, gen_secret.NUM_FEATURES + 1):
+        h = SHA256.new(car_pubkey + i.to_bytes(1, "little"))
+        sig = DSS.new(host, "deterministic-rfc6979").sign(h)
+        packages.append(c_bytes(sig + package_tool.recovery_byte(host.public_key(), h, sig)))
+
+    challenge = bytes(rng.getrandbits(8) for _ in range(64))
+    unlock = DSS.new(car, "deterministic-rfc6979").sign(SHA256.new(challenge))
+
+    out = f"static const uint8_t FEATURE_PACKAGES[{gen_secret.NUM_FEATURES}][65] = {{\n" + ",\n".join(packages) + " };\n"
+    out += f"static const uint8_t UNLOCK_CHALLENGE[64] = {c_bytes(challenge)};\n"
+    out += f"static const uint8_t UNLOCK_DIGEST[32] = {c_bytes(SHA256.new(challenge).digest())};\n"
+    out += f"static const uint8_t UNLOCK_SIGNATURE[64] = {c_bytes(unlock)};\n"
+    return out
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--header-file", type=Path, required=True)
+    parser.add_argument("--secrets-dir", type=Path, required=True)
+    parser.add_argument("--car-id", type=int, required=True)
+    args = parser.parse_args()
+
+    rng = random.Random(SEED)
+    gen_secret = load_car_gen_secret()
+    host, car = load_keys(args.secrets_dir, args.car_id)
+
+    with open(args.header_file, "w") as fp:
+        fp.write("#ifndef __TEST_VECTORS__\n")
+        fp.write("#define __TEST_VECTORS__\n\n")
+        fp.write("#include <stdint.h>\n\n")
+        fp.write("#define COUNT(a) (sizeof(a) / sizeof((a)[0]))\n\n")
+        fp.write(scalar_vectors(rng))
+        fp.write(presign_vectors(rng))
+        fp.write(f"static const uint8_t HOST_PUBKEY[64] = {c_pubkey(host)};\n")
+        fp.write(f"static const uint8_t CAR_PUBKEY[64] = {c_pubkey(car)};\n")
+        fp.write(comb_vectors(gen_secret, [None, host, car]))
+        package_tool = load_package_tool()
+        fp.write(signature_vectors(rng, package_tool, [None, host, car]))
+        fp.write(unlock_vectors(rng, gen_secret, package_tool, host, car))
+        fp.write("#endif\n")
+
+
+if __name__ == "__main__":
+    main()